@@ -8,12 +8,94 @@ in vec2 TexCoord;
 uniform sampler2D topViewTex;
 uniform sampler2D povTex;
 
+// The POV buffer is column-major, its texture is stored transposed
+uniform bool povTransposed;
+
+// TextureUpscale of texture_buffer_gl.h: 0 nearest, 1 sharp bilinear, 2 edge-aware.
+// The POV texture is sampled with GL_LINEAR, nearest and edge-aware fetch texels directly.
+uniform int povUpscale;
+
+// POV size in texels as the renderer sees it. The texture can be larger,
+// dynamic resolution only uses its bottom left corner (see textureBuffer_glResize).
+uniform ivec2 povExtent;
+
+vec2 povSize()
+{
+	return vec2(povExtent);
+}
+
+vec4 povFetch(ivec2 p)
+{
+	p = clamp(p, ivec2(0), povExtent - 1);
+	return texelFetch(povTex, povTransposed ? p.yx : p, 0);
+}
+
+// Bilinear sample at a position in texels, kept off the unused part of the texture
+vec4 povSample(vec2 texel)
+{
+	texel = clamp(texel, vec2(0.5), povSize() - 0.5);
+	vec2 p = povTransposed ? texel.yx : texel;
+	return texture(povTex, p / vec2(textureSize(povTex, 0)));
+}
+
+// Position within a texel (0..1) squeezed so the blend to the neighbour is one window pixel wide
+vec2 sharpRamp(vec2 f, vec2 pix_per_texel)
+{
+	vec2 d = f - 0.5;
+	vec2 flat_half = 0.5 - 0.5 / pix_per_texel;
+	return (d - clamp(d, -flat_half, flat_half)) * pix_per_texel + 0.5;
+}
+
+float luma(vec4 c)
+{
+	return dot(c.rgb, vec3(0.299, 0.587, 0.114));
+}
+
+vec4 povUpscaled(vec2 uv, vec2 texels_per_pix)
+{
+	vec2 size = povSize();
+	vec2 texel = uv * size;
+	// Below one window pixel per texel every filter turns into plain sampling
+	vec2 pix_per_texel = max(1.0 / texels_per_pix, vec2(1.0));
+
+	if (povUpscale == 1) {
+		return povSample(floor(texel) + sharpRamp(fract(texel), pix_per_texel));
+	}
+
+	if (povUpscale == 2) {
+		vec2 p = texel - 0.5;
+		ivec2 i = ivec2(floor(p));
+		vec2 f = fract(p);
+
+		vec4 a = povFetch(i);
+		vec4 b = povFetch(i + ivec2(1, 0));
+		vec4 c = povFetch(i + ivec2(0, 1));
+		vec4 d = povFetch(i + ivec2(1, 1));
+
+		// Wall edges and distant columns stay crisp, floor and ceiling gradients stay smooth
+		float edge_x = max(abs(luma(a) - luma(b)), abs(luma(c) - luma(d)));
+		float edge_y = max(abs(luma(a) - luma(c)), abs(luma(b) - luma(d)));
+		vec2 edge = smoothstep(0.04, 0.16, vec2(edge_x, edge_y));
+		// f is measured from texel centers here, so sharpening is a one pixel step halfway
+		vec2 step_f = clamp((f - 0.5) * pix_per_texel + 0.5, 0.0, 1.0);
+		f = mix(f, step_f, edge);
+
+		return mix(mix(a, b, f.x), mix(c, d, f.x), f.y);
+	}
+
+	return povFetch(ivec2(floor(texel)));
+}
+
 void main()
 {
+	// Derivatives are taken before branching, they are undefined inside non-uniform control flow
+	vec2 pov_uv = vec2(TexCoord.x - 1.0, TexCoord.y);
+	vec2 texels_per_pix = fwidth(pov_uv * povSize());
+
 	// Display top view texture only on left half of the screen
 	if (TexCoord.x < 1.0) {
 		FragColor = texture(topViewTex, TexCoord);
 	} else {
-		FragColor = texture(povTex, TexCoord);
+		FragColor = povUpscaled(pov_uv, texels_per_pix);
 	}
-}
\ No newline at end of file
+}
@@ -0,0 +1,881 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "vec2.h"
+#include "screen.h"
+#include "texture_buffer.h"
+#include "game_map.h"
+#include "raycast.h"
+#include "raycast_packet.h"
+#include "thread_pool.h"
+#include "renderer.h"
+#include "camera_path.h"
+#include "line_of_sight.h"
+#include "range_scan.h"
+#include "vec_env.h"
+#include "timer.h"
+
+/*
+* rayc-bench: renders every combination of map, resolution, FOV, camera path
+* and raycast mode and writes per-stage timings as JSON, so builds can be compared.
+*
+* Empty-space skipping against map density, for example:
+*   rayc-bench -g 1024:0.001 -g 1024:0.01 -g 1024:0.05 -g 1024:0.2 -r dda,pyramid,distance
+*
+* There is no GL context, so the upload stage is the copy of both textures
+* into a staging buffer, the part of glTexSubImage2D that runs on the CPU.
+* Textures are 4 bytes per texel on the GPU, so rgb24 pixels are expanded
+* and reordered on the way, like the driver does for GL_RGB; bgra32 pixels
+* are copied as they are. Compare the formats with two build directories
+* configured with -DRAYC_PIXEL_FORMAT=RGB24 and BGRA32. Only the changed
+* rectangles of a texture are staged, "upload_fraction" is their share of all texels.
+*
+* POV layouts: "row" and "column" upload the buffer as it is (the viewer's
+* shader samples a column-major texture transposed), "column-cpu" transposes
+* it to row-major during the upload stage. For example, at 1080p:
+*   rayc-bench -s 1920x1080 -l row,column,column-cpu
+*
+* With -los N every map also answers batches of N random line of sight queries,
+* segments up to BENCH_LOS_RANGE tiles long from empty cells, reported under "line_of_sight":
+*   rayc-bench -s 128x128 -f 90 -p spin -los 1000000
+*
+* With -scan RxO every map also runs range scans in each raycast mode, R directions
+* around the circle from each of O origins in empty cells, reported under "range_scan":
+*   rayc-bench -s 128x128 -f 90 -p spin -r packet,distance -scan 1024x1000
+*
+* With -env NxCOLSxROWS[xCHANNELS] every map also steps N envs of vec_env.h with
+* random actions, observations of COLSxROWS (luma unless CHANNELS is 3), reported under "vec_env":
+*   rayc-bench -s 128x128 -f 90 -p spin -env 4096x32x24
+*/
+
+#define BENCH_MAX_ITEMS 32
+#define BENCH_LOS_RANGE 32.f
+#define BENCH_LOS_BATCHES 10
+#define BENCH_SCAN_RANGE 32.f
+#define BENCH_SCAN_BATCHES 5
+#define BENCH_ENV_STEPS 30
+#define BENCH_ENV_FOV 90.f
+
+typedef struct {
+    char name[64];
+    const char* file; // NULL for generated maps
+    int dim;
+    float density;
+} BenchMap;
+
+typedef struct {
+    int cols;
+    int rows;
+} BenchSize;
+
+typedef struct {
+    TextureLayout layout;
+    bool cpu_transpose; // Upload converts to row-major instead of leaving it to the GPU
+} BenchLayout;
+
+typedef struct {
+    BenchMap maps[BENCH_MAX_ITEMS];
+    int num_maps;
+
+    BenchSize sizes[BENCH_MAX_ITEMS];
+    int num_sizes;
+
+    float fovs[BENCH_MAX_ITEMS];
+    int num_fovs;
+
+    CameraPathKind paths[BENCH_MAX_ITEMS];
+    int num_paths;
+
+    RaycastMode modes[BENCH_MAX_ITEMS];
+    int num_modes;
+
+    BenchLayout layouts[BENCH_MAX_ITEMS];
+    int num_layouts;
+
+    int frames;
+    int warmup;
+    int los_queries; // Per batch, 0 skips the line of sight benchmark
+    int scan_rays;   // Per origin, 0 skips the range scan benchmark
+    int scan_origins;
+    int envs; // 0 skips the vec_env benchmark
+    int env_cols;
+    int env_rows;
+    int env_channels;
+} BenchConfig;
+
+// Line of sight batches on one map
+typedef struct {
+    double p50;
+    double min;
+    double visible_fraction;
+    double mean_dist;
+} BenchLos;
+
+// Range scans on one map
+typedef struct {
+    double p50;
+    double min;
+    double hit_fraction;
+    double mean_dist;
+} BenchScan;
+
+// Env steps on one map
+typedef struct {
+    double p50;
+    double min;
+    double collided_fraction;
+} BenchEnv;
+
+// Sums over the measured frames of one run
+typedef struct {
+    double clear;
+    double cast;
+    double fill;
+    double overlay;
+    double upload;
+    double upload_fraction; // Of all texels, summed over frames
+
+    long long rays;
+    long long steps;
+
+    double* frame_times;
+} BenchResult;
+
+static void printUsage(const char* exe)
+{
+    printf("Usage: %s [options]\n", exe);
+    printf("  -m FILE         add a map file (default maps/00.txt)\n");
+    printf("  -g DIM:DENSITY  add a generated map (default 64:0.2, 256:0.1, 1024:0.02)\n");
+    printf("  -s LIST         resolutions, e.g. 128x128,320x240 (default 128x128,320x240,640x480)\n");
+    printf("  -f LIST         fields of view in degrees (default 60,90,120)\n");
+    printf("  -p LIST         camera paths: spin, orbit, sway (default all)\n");
+    printf("  -n N            measured frames per run (default 120)\n");
+    printf("  -w N            warmup frames per run (default 10)\n");
+    printf("  -t N            render threads, 0 uses every core (default 0)\n");
+    printf("  -r LIST         raycast modes: dda, march, packet, pyramid, distance, adaptive (default packet)\n");
+    printf("  -l LIST         POV layouts: row, column, column-cpu (default row)\n");
+    printf("  -i ISA          packet width and pixel fills: scalar, sse2, avx2 (default best supported)\n");
+    printf("  -los N          line of sight queries per batch on every map, 0 skips them (default 0)\n");
+    printf("  -scan RxO       range scans, R rays around the circle from O origins, e.g. 1024x1000 (default none)\n");
+    printf("  -env NxCxR[xCH] step N envs with CxR observations, CH 1 (luma) or 3 (RGB), e.g. 4096x32x24 (default none)\n");
+    printf("  -o FILE         JSON report (default bench.json)\n");
+}
+
+static bool parseMode(const char* name, void* out)
+{
+    RaycastMode* mode = out;
+    for (int m = 0; m < RAYCAST_MODE_COUNT; ++m) {
+        if (strcmp(name, raycast_modeName(m)) == 0) {
+            *mode = m;
+            return true;
+        }
+    }
+    return false;
+}
+
+static const char* layoutName(BenchLayout l)
+{
+    return l.cpu_transpose ? "column-cpu" : textureLayout_name(l.layout);
+}
+
+static bool parseLayout(const char* name, void* out)
+{
+    BenchLayout* l = out;
+    l->cpu_transpose = strcmp(name, "column-cpu") == 0;
+    if (l->cpu_transpose) {
+        l->layout = TEXTURE_LAYOUT_COLUMN_MAJOR;
+        return true;
+    }
+    return textureLayout_parse(name, &l->layout);
+}
+
+static bool addGenerated(BenchConfig* cfg, const char* spec)
+{
+    if (cfg->num_maps == BENCH_MAX_ITEMS) {
+        return false;
+    }
+    BenchMap* m = &cfg->maps[cfg->num_maps];
+    if (sscanf(spec, "%d:%f", &m->dim, &m->density) != 2 || m->dim < 3) {
+        return false;
+    }
+    m->file = NULL;
+    snprintf(m->name, sizeof(m->name), "gen_%d_%.3f", m->dim, m->density);
+    ++cfg->num_maps;
+    return true;
+}
+
+static bool addFile(BenchConfig* cfg, const char* file)
+{
+    if (cfg->num_maps == BENCH_MAX_ITEMS) {
+        return false;
+    }
+    BenchMap* m = &cfg->maps[cfg->num_maps];
+    m->file = file;
+    snprintf(m->name, sizeof(m->name), "%s", file);
+    ++cfg->num_maps;
+    return true;
+}
+
+// Comma separated list, calls parse for every item
+static bool parseList(const char* list, void* items, int* count, size_t item_size, bool (*parse)(const char*, void*))
+{
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", list);
+
+    *count = 0;
+    for (char* tok = strtok(buf, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        if (*count == BENCH_MAX_ITEMS || !parse(tok, (char*)items + *count * item_size)) {
+            return false;
+        }
+        ++*count;
+    }
+    return *count > 0;
+}
+
+static bool parseSize(const char* s, void* out)
+{
+    BenchSize* size = out;
+    return sscanf(s, "%dx%d", &size->cols, &size->rows) == 2 && size->cols > 0 && size->rows > 0;
+}
+
+static bool parseFov(const char* s, void* out)
+{
+    float* fov = out;
+    *fov = atof(s);
+    return *fov > 0 && *fov < 360;
+}
+
+static bool parsePath(const char* s, void* out)
+{
+    return cameraPath_parse(s, out);
+}
+
+static int compareDouble(const void* a, const void* b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted values
+static double percentile(const double* sorted, int n, double p)
+{
+    int rank = (int)(p / 100.0 * n + 0.999999);
+    if (rank < 1) {
+        rank = 1;
+    }
+    if (rank > n) {
+        rank = n;
+    }
+    return sorted[rank - 1];
+}
+
+// What the driver does with n pixels before they reach the GPU
+static void stagePixels(unsigned char* dst, const Pixel* src, size_t n)
+{
+#ifdef RAYC_PIXEL_BGRA32
+    memcpy(dst, src, n * sizeof(Pixel));
+#else
+    for (size_t i = 0; i < n; ++i, dst += 4) {
+        dst[0] = src[i].b;
+        dst[1] = src[i].g;
+        dst[2] = src[i].r;
+        dst[3] = 255;
+    }
+#endif
+}
+
+// Stages the changed rectangles of tb into dst, which is laid out like the texture. Returns the pixels sent.
+static size_t stageTexture(unsigned char* dst, const TextureBuffer* tb)
+{
+    TextureRect rects[TEXTURE_BUFFER_MAX_RECTS];
+    int num_rects = textureBuffer_changedRects(tb, rects, TEXTURE_BUFFER_MAX_RECTS);
+    int len = textureBuffer_lineLength(tb);
+
+    size_t sent = 0;
+    for (int i = 0; i < num_rects; ++i) {
+        TextureRect r = rects[i];
+        for (int y = r.y; y < r.y + r.h; ++y) {
+            size_t offset = (size_t)y * len + r.x;
+            stagePixels(dst + offset * 4, tb->data + offset, r.w);
+        }
+        sent += (size_t)r.w * r.h;
+    }
+    return sent;
+}
+
+// staging holds 4 bytes per pixel of both textures, transposed is scratch for rgb24 "column-cpu"
+static void runBench(Renderer* r, GameMap* gm, CameraPathKind path, BenchLayout layout, int warmup, int frames,
+    unsigned char* staging, Pixel* transposed, BenchResult* res)
+{
+    Vec2 spawn = gameMap_findSpawn(gm);
+
+    for (int f = -warmup; f < frames; ++f) {
+        // Warmup frames replay the start of the path
+        int path_frame = f < 0 ? f + warmup : f;
+        Camera cam = cameraPath_eval(path, gm, spawn, path_frame, frames);
+
+        double start = timer_now();
+
+        renderer_drawFrame(r, cam.pos, camera_lookDir(&cam));
+
+        // Only the changed rectangles, like textureBuffer_loadTexData. The POV always changes completely.
+        double upload_start = timer_now();
+        size_t top_pixels = (size_t)r->top_view->width * r->top_view->height;
+        size_t pov_pixels = (size_t)r->pov->width * r->pov->height;
+        unsigned char* pov_staging = staging + top_pixels * 4;
+        size_t sent = stageTexture(staging, r->top_view);
+        if (layout.cpu_transpose) {
+#ifdef RAYC_PIXEL_BGRA32
+            textureBuffer_copyRowMajor(r->pov, (Pixel*)pov_staging);
+#else
+            textureBuffer_copyRowMajor(r->pov, transposed);
+            stagePixels(pov_staging, transposed, pov_pixels);
+#endif
+            sent += pov_pixels;
+        } else {
+            sent += stageTexture(pov_staging, r->pov);
+        }
+        double end = timer_now();
+
+        if (f < 0) {
+            continue;
+        }
+
+        res->clear += r->stats.clear;
+        res->cast += r->stats.cast;
+        res->fill += r->stats.fill;
+        res->overlay += r->stats.overlay;
+        res->upload += end - upload_start;
+        res->upload_fraction += (double)sent / (top_pixels + pov_pixels);
+        res->rays += r->stats.rays;
+        res->steps += r->stats.steps;
+        res->frame_times[f] = end - start;
+    }
+}
+
+// Fraction of non-empty tiles
+static double solidFraction(const GameMap* gm)
+{
+    long long solid = 0;
+    for (long long i = 0; i < (long long)gm->dim * gm->dim; ++i) {
+        solid += gm->map[i] != 0;
+    }
+    return (double)solid / ((double)gm->dim * gm->dim);
+}
+
+// xorshift32 like gameMap_initGenerated, in [0, 1)
+static float benchRandom(unsigned int* state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return (*state >> 8) * (1.f / 16777216.f);
+}
+
+// Random segments from empty cells, the same set for a map on every run
+static void makeLosQueries(const GameMap* gm, unsigned int seed, LosQuery* queries, int n)
+{
+    unsigned int state = seed ? seed : 1;
+    int retries = 0;
+    for (int i = 0; i < n; ++i) {
+        float u[4];
+        for (int k = 0; k < 4; ++k) {
+            u[k] = benchRandom(&state);
+        }
+
+        Vec2 from = { u[0] * gm->dim, u[1] * gm->dim };
+        int cx = (int)from.x;
+        int cy = (int)from.y;
+        // Retried with the next numbers, a dense map can take a few. A map without room keeps the solid start.
+        if (gameMap_isSolid(gm, cx, cy) && ++retries < 64) {
+            --i;
+            continue;
+        }
+        retries = 0;
+
+        float angle = u[2] * 6.2831853f;
+        float len = u[3] * BENCH_LOS_RANGE;
+        queries[i] = (LosQuery){ from, { from.x + cosf(angle) * len, from.y + sinf(angle) * len } };
+    }
+}
+
+static void runLos(const GameMap* gm, ThreadPool* pool, RayPacketIsa isa, const LosQuery* queries, LosResult* results,
+    int n, BenchLos* los)
+{
+    double times[BENCH_LOS_BATCHES];
+
+    // One batch to warm up
+    los_batch(gm, pool, isa, queries, results, n);
+    for (int b = 0; b < BENCH_LOS_BATCHES; ++b) {
+        double start = timer_now();
+        los_batch(gm, pool, isa, queries, results, n);
+        times[b] = timer_now() - start;
+    }
+    qsort(times, BENCH_LOS_BATCHES, sizeof(double), compareDouble);
+
+    long long visible = 0;
+    double dist = 0;
+    for (int i = 0; i < n; ++i) {
+        visible += results[i].visible;
+        dist += results[i].dist;
+    }
+
+    los->p50 = percentile(times, BENCH_LOS_BATCHES, 50);
+    los->min = times[0];
+    los->visible_fraction = (double)visible / n;
+    los->mean_dist = dist / n;
+}
+
+// Random points in empty cells, a map without room keeps the last one tried
+static void makeScanOrigins(const GameMap* gm, unsigned int seed, float* x, float* y, int n)
+{
+    unsigned int state = seed ? seed : 1;
+    for (int i = 0; i < n; ++i) {
+        for (int tries = 0; tries < 64; ++tries) {
+            x[i] = benchRandom(&state) * gm->dim;
+            y[i] = benchRandom(&state) * gm->dim;
+            if (!gameMap_isSolid(gm, (int)x[i], (int)y[i])) {
+                break;
+            }
+        }
+    }
+}
+
+// dir_x, dir_y hold cfg->scan_rays directions, dist cfg->scan_rays * cfg->scan_origins distances
+static void runScan(const GameMap* gm, ThreadPool* pool, RaycastMode mode, RayPacketIsa isa, const BenchConfig* cfg,
+    const float* origin_x, const float* origin_y, const float* dir_x, const float* dir_y, float* dist, BenchScan* scan)
+{
+    double times[BENCH_SCAN_BATCHES];
+
+    // One scan to warm up
+    rangeScan_scan(gm, pool, mode, isa, origin_x, origin_y, cfg->scan_origins, dir_x, dir_y, cfg->scan_rays, BENCH_SCAN_RANGE, dist);
+    for (int b = 0; b < BENCH_SCAN_BATCHES; ++b) {
+        double start = timer_now();
+        rangeScan_scan(gm, pool, mode, isa, origin_x, origin_y, cfg->scan_origins, dir_x, dir_y, cfg->scan_rays, BENCH_SCAN_RANGE, dist);
+        times[b] = timer_now() - start;
+    }
+    qsort(times, BENCH_SCAN_BATCHES, sizeof(double), compareDouble);
+
+    size_t n = (size_t)cfg->scan_rays * cfg->scan_origins;
+    long long hits = 0;
+    double total = 0;
+    for (size_t i = 0; i < n; ++i) {
+        hits += dist[i] < BENCH_SCAN_RANGE;
+        total += dist[i];
+    }
+
+    scan->p50 = percentile(times, BENCH_SCAN_BATCHES, 50);
+    scan->min = times[0];
+    scan->hit_fraction = (double)hits / n;
+    scan->mean_dist = total / n;
+}
+
+// Envs start at random empty cells facing random ways, then take random actions
+static void runEnv(const GameMap* gm, ThreadPool* pool, RayPacketIsa isa, const BenchConfig* cfg, unsigned int seed,
+    BenchEnv* res)
+{
+    VecEnv env;
+    vecEnv_init(&env, cfg->envs, gm, cfg->env_cols, cfg->env_rows, cfg->env_channels, BENCH_ENV_FOV, pool);
+    env.isa = isa;
+
+    float* x = malloc(cfg->envs * sizeof(float));
+    float* y = malloc(cfg->envs * sizeof(float));
+    if (x == NULL || y == NULL) {
+        perror("Fatal error: malloc failed");
+        exit(1);
+    }
+    makeScanOrigins(gm, seed, x, y, cfg->envs);
+
+    unsigned int state = seed;
+    for (int i = 0; i < cfg->envs; ++i) {
+        vecEnv_reset(&env, i, gm, (Vec2){ x[i], y[i] }, benchRandom(&state) * 6.2831853f);
+    }
+    vecEnv_observe(&env);
+
+    double times[BENCH_ENV_STEPS];
+    long long collided = 0;
+    for (int s = 0; s < BENCH_ENV_STEPS; ++s) {
+        // Like a policy choosing from W, A, S, D and turning
+        for (int i = 0; i < cfg->envs; ++i) {
+            env.act_forward[i] = (int)(benchRandom(&state) * 3) - 1.f;
+            env.act_strafe[i] = (int)(benchRandom(&state) * 3) - 1.f;
+            env.act_turn[i] = (benchRandom(&state) - 0.5f) * 0.2f;
+        }
+
+        double start = timer_now();
+        vecEnv_step(&env);
+        times[s] = timer_now() - start;
+
+        for (int i = 0; i < cfg->envs; ++i) {
+            collided += env.collided[i];
+        }
+    }
+    qsort(times, BENCH_ENV_STEPS, sizeof(double), compareDouble);
+
+    res->p50 = percentile(times, BENCH_ENV_STEPS, 50);
+    res->min = times[0];
+    res->collided_fraction = (double)collided / ((double)cfg->envs * BENCH_ENV_STEPS);
+
+    free(x);
+    free(y);
+    vecEnv_destroy(&env);
+}
+
+static void writeResult(FILE* out, bool first, const BenchMap* m, const GameMap* gm, double solid, BenchSize size,
+    float fov, CameraPathKind path, RaycastMode mode, BenchLayout layout, int frames, BenchResult* res)
+{
+    qsort(res->frame_times, frames, sizeof(double), compareDouble);
+
+    double total = 0;
+    for (int i = 0; i < frames; ++i) {
+        total += res->frame_times[i];
+    }
+
+    double ms = 1000.0 / frames;
+
+    fprintf(out, "%s\n    {\n", first ? "" : ",");
+    fprintf(out, "      \"map\": \"%s\",\n", m->name);
+    fprintf(out, "      \"map_dim\": %d,\n", gm->dim);
+    fprintf(out, "      \"solid_fraction\": %.5f,\n", solid);
+    fprintf(out, "      \"width\": %d,\n", size.cols);
+    fprintf(out, "      \"height\": %d,\n", size.rows);
+    fprintf(out, "      \"fov\": %.1f,\n", fov);
+    fprintf(out, "      \"path\": \"%s\",\n", cameraPath_name(path));
+    fprintf(out, "      \"mode\": \"%s\",\n", raycast_modeName(mode));
+    fprintf(out, "      \"layout\": \"%s\",\n", layoutName(layout));
+    fprintf(out, "      \"frames\": %d,\n", frames);
+    fprintf(out, "      \"stage_ms\": { \"clear\": %.4f, \"cast\": %.4f, \"fill\": %.4f, \"overlay\": %.4f, \"upload\": %.4f },\n",
+        res->clear * ms, res->cast * ms, res->fill * ms, res->overlay * ms, res->upload * ms);
+    fprintf(out, "      \"upload_fraction\": %.4f,\n", res->upload_fraction / frames);
+    fprintf(out, "      \"frame_ms\": { \"mean\": %.4f, \"p50\": %.4f, \"p99\": %.4f, \"min\": %.4f, \"max\": %.4f },\n",
+        total * ms, percentile(res->frame_times, frames, 50) * 1000.0, percentile(res->frame_times, frames, 99) * 1000.0,
+        res->frame_times[0] * 1000.0, res->frame_times[frames - 1] * 1000.0);
+    // Rays actually cast, fewer than columns when some are resolved without casting
+    fprintf(out, "      \"rays_per_frame\": %.1f,\n", (double)res->rays / frames);
+    // Throughput of the cast stage alone
+    fprintf(out, "      \"rays_per_sec\": %.0f,\n", res->cast > 0 ? res->rays / res->cast : 0.0);
+    fprintf(out, "      \"steps_per_sec\": %.0f,\n", res->cast > 0 ? res->steps / res->cast : 0.0);
+    fprintf(out, "      \"steps_per_ray\": %.3f\n", res->rays > 0 ? (double)res->steps / res->rays : 0.0);
+    fprintf(out, "    }");
+}
+
+int main(int argc, char** argv)
+{
+    BenchConfig cfg = { .frames = 120, .warmup = 10 };
+    const char* out_path = "bench.json";
+    const char* sizes = "128x128,320x240,640x480";
+    const char* fovs = "60,90,120";
+    const char* paths = "spin,orbit,sway";
+    const char* modes = "packet";
+    const char* layouts = "row";
+    int num_threads = 0;
+    RayPacketIsa isa = rayPacket_detectIsa();
+
+    for (int i = 1; i < argc; ++i) {
+        const char* opt = argv[i];
+        const char* val = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(opt, "-h") == 0) {
+            printUsage(argv[0]);
+            return 0;
+        }
+        if (val == NULL) {
+            printf("Missing value for %s\n", opt);
+            printUsage(argv[0]);
+            return 1;
+        }
+        ++i;
+
+        bool ok = true;
+        if (strcmp(opt, "-m") == 0) {
+            ok = addFile(&cfg, val);
+        } else if (strcmp(opt, "-g") == 0) {
+            ok = addGenerated(&cfg, val);
+        } else if (strcmp(opt, "-s") == 0) {
+            sizes = val;
+        } else if (strcmp(opt, "-f") == 0) {
+            fovs = val;
+        } else if (strcmp(opt, "-p") == 0) {
+            paths = val;
+        } else if (strcmp(opt, "-n") == 0) {
+            cfg.frames = atoi(val);
+            ok = cfg.frames > 0;
+        } else if (strcmp(opt, "-w") == 0) {
+            cfg.warmup = atoi(val);
+            ok = cfg.warmup >= 0;
+        } else if (strcmp(opt, "-t") == 0) {
+            num_threads = atoi(val);
+        } else if (strcmp(opt, "-r") == 0) {
+            modes = val;
+        } else if (strcmp(opt, "-l") == 0) {
+            layouts = val;
+        } else if (strcmp(opt, "-i") == 0) {
+            isa = rayPacket_parseIsa(val, isa);
+        } else if (strcmp(opt, "-los") == 0) {
+            cfg.los_queries = atoi(val);
+            ok = cfg.los_queries >= 0;
+        } else if (strcmp(opt, "-scan") == 0) {
+            cfg.scan_rays = 0;
+            cfg.scan_origins = 0;
+            ok = strcmp(val, "0") == 0 ||
+                (sscanf(val, "%dx%d", &cfg.scan_rays, &cfg.scan_origins) == 2 && cfg.scan_rays > 0 && cfg.scan_origins > 0);
+        } else if (strcmp(opt, "-env") == 0) {
+            cfg.env_channels = 1;
+            int n = sscanf(val, "%dx%dx%dx%d", &cfg.envs, &cfg.env_cols, &cfg.env_rows, &cfg.env_channels);
+            ok = (n == 3 || n == 4) && cfg.envs > 0 && cfg.env_cols > 0 && cfg.env_rows > 0 &&
+                (cfg.env_channels == 1 || cfg.env_channels == 3);
+        } else if (strcmp(opt, "-o") == 0) {
+            out_path = val;
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            printf("Invalid option: %s %s\n", opt, val);
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!parseList(sizes, cfg.sizes, &cfg.num_sizes, sizeof(BenchSize), parseSize) ||
+        !parseList(fovs, cfg.fovs, &cfg.num_fovs, sizeof(float), parseFov) ||
+        !parseList(paths, cfg.paths, &cfg.num_paths, sizeof(CameraPathKind), parsePath) ||
+        !parseList(modes, cfg.modes, &cfg.num_modes, sizeof(RaycastMode), parseMode) ||
+        !parseList(layouts, cfg.layouts, &cfg.num_layouts, sizeof(BenchLayout), parseLayout)) {
+        printf("Invalid resolution, FOV, path, mode or layout list\n");
+        return 1;
+    }
+
+    if (cfg.num_maps == 0) {
+        addFile(&cfg, "maps/00.txt");
+        addGenerated(&cfg, "64:0.2");
+        addGenerated(&cfg, "256:0.1");
+        addGenerated(&cfg, "1024:0.02");
+    }
+
+    ThreadPool pool;
+    if (threadPool_init(&pool, num_threads) != 0) {
+        return 1;
+    }
+
+    FILE* out = fopen(out_path, "w");
+    if (out == NULL) {
+        printf("Failed to open file: %s\n", out_path);
+        return 1;
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"packets\": \"%s\",\n", rayPacket_isaName(isa));
+    fprintf(out, "  \"threads\": %d,\n", pool.num_threads);
+#ifdef __OPTIMIZE__
+    fprintf(out, "  \"optimized\": true,\n");
+#else
+    fprintf(out, "  \"optimized\": false,\n");
+#endif
+    fprintf(out, "  \"pixel_format\": \"%s\",\n", PIXEL_FORMAT_NAME);
+    fprintf(out, "  \"upload\": \"staging_copy\",\n");
+    fprintf(out, "  \"results\": [");
+
+    double* frame_times = malloc(cfg.frames * sizeof(double));
+    if (frame_times == NULL) {
+        perror("Fatal error: malloc failed");
+        exit(1);
+    }
+
+    BenchLos los[BENCH_MAX_ITEMS];
+    LosQuery* los_queries = NULL;
+    LosResult* los_results = NULL;
+    if (cfg.los_queries > 0) {
+        los_queries = malloc(cfg.los_queries * sizeof(LosQuery));
+        los_results = malloc(cfg.los_queries * sizeof(LosResult));
+        if (los_queries == NULL || los_results == NULL) {
+            perror("Fatal error: malloc failed");
+            exit(1);
+        }
+    }
+
+    BenchScan scans[BENCH_MAX_ITEMS][BENCH_MAX_ITEMS]; // Per map and mode
+    float* scan_ox = NULL;
+    float* scan_oy = NULL;
+    float* scan_dx = NULL;
+    float* scan_dy = NULL;
+    float* scan_dist = NULL;
+    if (cfg.scan_rays > 0) {
+        scan_ox = malloc(cfg.scan_origins * sizeof(float));
+        scan_oy = malloc(cfg.scan_origins * sizeof(float));
+        scan_dx = malloc(cfg.scan_rays * sizeof(float));
+        scan_dy = malloc(cfg.scan_rays * sizeof(float));
+        scan_dist = malloc((size_t)cfg.scan_rays * cfg.scan_origins * sizeof(float));
+        if (scan_ox == NULL || scan_oy == NULL || scan_dx == NULL || scan_dy == NULL || scan_dist == NULL) {
+            perror("Fatal error: malloc failed");
+            exit(1);
+        }
+        rangeScan_circle(cfg.scan_rays, 0.f, scan_dx, scan_dy);
+    }
+
+    BenchEnv envs[BENCH_MAX_ITEMS];
+
+    bool first = true;
+
+    for (int mi = 0; mi < cfg.num_maps; ++mi) {
+        const BenchMap* m = &cfg.maps[mi];
+
+        GameMap gm;
+        int err = m->file ? gameMap_init(&gm, m->file)
+                          : gameMap_initGenerated(&gm, m->dim, m->density, 1234 + mi);
+        if (err != 0) {
+            return 1;
+        }
+        double solid = solidFraction(&gm);
+
+        for (int si = 0; si < cfg.num_sizes; ++si) {
+            BenchSize size = cfg.sizes[si];
+
+            TextureBuffer top_view_tb;
+            TextureBuffer pov_tb;
+            textureBuffer_init(&top_view_tb, size.cols, size.rows);
+            textureBuffer_init(&pov_tb, size.cols, size.rows);
+            top_view_tb.simd = (CpuSimd)isa;
+            pov_tb.simd = (CpuSimd)isa;
+
+            unsigned char* staging = malloc(2 * (size_t)size.cols * size.rows * 4);
+            Pixel* transposed = malloc((size_t)size.cols * size.rows * sizeof(Pixel));
+            if (staging == NULL || transposed == NULL) {
+                perror("Fatal error: malloc failed");
+                exit(1);
+            }
+
+            for (int fi = 0; fi < cfg.num_fovs; ++fi) {
+                Screen scr;
+                screen_init(&scr, size.cols, size.rows, cfg.fovs[fi]);
+
+                Renderer renderer;
+                renderer_init(&renderer, &scr, &gm, &top_view_tb, &pov_tb, &pool);
+                renderer.isa = isa;
+                // Every measured frame is cast and filled in full
+                renderer.frame_cache = false;
+
+                for (int pi = 0; pi < cfg.num_paths; ++pi) {
+                    for (int ri = 0; ri < cfg.num_modes; ++ri) {
+                        for (int li = 0; li < cfg.num_layouts; ++li) {
+                            BenchLayout layout = cfg.layouts[li];
+                            renderer.mode = cfg.modes[ri];
+                            textureBuffer_setLayout(&pov_tb, layout.layout);
+
+                            BenchResult res = { .frame_times = frame_times };
+                            runBench(&renderer, &gm, cfg.paths[pi], layout, cfg.warmup, cfg.frames, staging, transposed, &res);
+
+                            writeResult(out, first, m, &gm, solid, size, cfg.fovs[fi], cfg.paths[pi], cfg.modes[ri],
+                                layout, cfg.frames, &res);
+                            first = false;
+
+                            printf("%-24s %5dx%-5d fov %5.1f %-6s %-8s %-10s p50 %8.3f ms  clear %7.3f ms  fill %7.3f ms  upload %7.3f ms (%3.0f%%)  %8.2f Mrays/s  %7.1f steps/ray\n",
+                                m->name, size.cols, size.rows, cfg.fovs[fi], cameraPath_name(cfg.paths[pi]),
+                                raycast_modeName(cfg.modes[ri]), layoutName(layout),
+                                percentile(res.frame_times, cfg.frames, 50) * 1000.0,
+                                res.clear * 1000.0 / cfg.frames, res.fill * 1000.0 / cfg.frames, res.upload * 1000.0 / cfg.frames,
+                                res.upload_fraction * 100.0 / cfg.frames,
+                                res.cast > 0 ? res.rays / res.cast * 1e-6 : 0.0,
+                                res.rays > 0 ? (double)res.steps / res.rays : 0.0);
+                        }
+                    }
+                }
+
+                renderer_destroy(&renderer);
+                screen_destroy(&scr);
+            }
+
+            free(staging);
+            free(transposed);
+            textureBuffer_destroy(&top_view_tb);
+            textureBuffer_destroy(&pov_tb);
+        }
+
+        if (cfg.los_queries > 0) {
+            makeLosQueries(&gm, 4321 + mi, los_queries, cfg.los_queries);
+            runLos(&gm, &pool, isa, los_queries, los_results, cfg.los_queries, &los[mi]);
+
+            printf("%-24s line of sight %d queries  p50 %8.3f ms  %8.2f Mqueries/s  %5.1f%% visible\n",
+                m->name, cfg.los_queries, los[mi].p50 * 1000.0, cfg.los_queries / los[mi].p50 * 1e-6,
+                los[mi].visible_fraction * 100.0);
+        }
+
+        if (cfg.scan_rays > 0) {
+            makeScanOrigins(&gm, 5678 + mi, scan_ox, scan_oy, cfg.scan_origins);
+            for (int ri = 0; ri < cfg.num_modes; ++ri) {
+                BenchScan* scan = &scans[mi][ri];
+                runScan(&gm, &pool, cfg.modes[ri], isa, &cfg, scan_ox, scan_oy, scan_dx, scan_dy, scan_dist, scan);
+
+                printf("%-24s range scan %dx%d %-8s p50 %8.3f ms  %8.2f Mrays/s  %5.1f%% hit\n",
+                    m->name, cfg.scan_rays, cfg.scan_origins, raycast_modeName(cfg.modes[ri]), scan->p50 * 1000.0,
+                    (double)cfg.scan_rays * cfg.scan_origins / scan->p50 * 1e-6, scan->hit_fraction * 100.0);
+            }
+        }
+
+        if (cfg.envs > 0) {
+            runEnv(&gm, &pool, isa, &cfg, 9012 + mi, &envs[mi]);
+
+            printf("%-24s vec env %dx%dx%dx%d  step p50 %8.3f ms  %8.2f M env-steps/s  %5.1f%% collided\n",
+                m->name, cfg.envs, cfg.env_cols, cfg.env_rows, cfg.env_channels, envs[mi].p50 * 1000.0,
+                cfg.envs / envs[mi].p50 * 1e-6, envs[mi].collided_fraction * 100.0);
+        }
+
+        gameMap_destroy(&gm);
+    }
+
+    fprintf(out, "\n  ]");
+    if (cfg.los_queries > 0) {
+        fprintf(out, ",\n  \"line_of_sight\": [");
+        for (int mi = 0; mi < cfg.num_maps; ++mi) {
+            fprintf(out, "%s\n    { \"map\": \"%s\", \"queries\": %d, \"range\": %.1f, \"batch_ms\": { \"p50\": %.4f, \"min\": %.4f }, "
+                "\"queries_per_sec\": %.0f, \"visible_fraction\": %.4f, \"mean_dist\": %.3f }",
+                mi == 0 ? "" : ",", cfg.maps[mi].name, cfg.los_queries, BENCH_LOS_RANGE,
+                los[mi].p50 * 1000.0, los[mi].min * 1000.0, cfg.los_queries / los[mi].p50,
+                los[mi].visible_fraction, los[mi].mean_dist);
+        }
+        fprintf(out, "\n  ]");
+    }
+    if (cfg.scan_rays > 0) {
+        fprintf(out, ",\n  \"range_scan\": [");
+        for (int mi = 0; mi < cfg.num_maps; ++mi) {
+            for (int ri = 0; ri < cfg.num_modes; ++ri) {
+                const BenchScan* scan = &scans[mi][ri];
+                fprintf(out, "%s\n    { \"map\": \"%s\", \"mode\": \"%s\", \"rays\": %d, \"origins\": %d, \"range\": %.1f, "
+                    "\"scan_ms\": { \"p50\": %.4f, \"min\": %.4f }, \"rays_per_sec\": %.0f, \"hit_fraction\": %.4f, \"mean_dist\": %.3f }",
+                    mi + ri == 0 ? "" : ",", cfg.maps[mi].name, raycast_modeName(cfg.modes[ri]), cfg.scan_rays, cfg.scan_origins,
+                    BENCH_SCAN_RANGE, scan->p50 * 1000.0, scan->min * 1000.0,
+                    (double)cfg.scan_rays * cfg.scan_origins / scan->p50, scan->hit_fraction, scan->mean_dist);
+            }
+        }
+        fprintf(out, "\n  ]");
+    }
+    if (cfg.envs > 0) {
+        fprintf(out, ",\n  \"vec_env\": [");
+        for (int mi = 0; mi < cfg.num_maps; ++mi) {
+            fprintf(out, "%s\n    { \"map\": \"%s\", \"envs\": %d, \"obs\": [%d, %d, %d], \"step_ms\": { \"p50\": %.4f, \"min\": %.4f }, "
+                "\"env_steps_per_sec\": %.0f, \"collided_fraction\": %.4f }",
+                mi == 0 ? "" : ",", cfg.maps[mi].name, cfg.envs, cfg.env_rows, cfg.env_cols, cfg.env_channels,
+                envs[mi].p50 * 1000.0, envs[mi].min * 1000.0, cfg.envs / envs[mi].p50, envs[mi].collided_fraction);
+        }
+        fprintf(out, "\n  ]");
+    }
+    fprintf(out, "\n}\n");
+    fclose(out);
+
+    printf("Wrote %s\n", out_path);
+
+    free(frame_times);
+    free(los_queries);
+    free(los_results);
+    free(scan_ox);
+    free(scan_oy);
+    free(scan_dx);
+    free(scan_dy);
+    free(scan_dist);
+    threadPool_destroy(&pool);
+
+    return 0;
+}
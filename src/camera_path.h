@@ -0,0 +1,104 @@
+#ifndef _CAMERA_PATH_H_
+#define _CAMERA_PATH_H_
+
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "vec2.h"
+#include "screen.h"
+#include "game_map.h"
+
+/*
+* Deterministic camera paths for rendering without input.
+* Every frame is a pure function of the frame index, so two runs
+* of the same path give the same frames.
+*/
+
+typedef enum {
+    CAMERA_PATH_SPIN,  // Full turn on the spot
+    CAMERA_PATH_ORBIT, // Circle around the map center looking along the circle
+    CAMERA_PATH_SWAY,  // Look left and right while drifting back and forth
+    CAMERA_PATH_COUNT
+} CameraPathKind;
+
+typedef struct {
+    Vec2 pos;     // map space
+    double theta; // look angle in radians, same as the viewer's mouse angle
+} Camera;
+
+const char* cameraPath_name(CameraPathKind kind) {
+    switch (kind) {
+    case CAMERA_PATH_SPIN:  return "spin";
+    case CAMERA_PATH_ORBIT: return "orbit";
+    case CAMERA_PATH_SWAY:  return "sway";
+    default:                return "unknown";
+    }
+}
+
+// Returns false if name isn't a known path
+bool cameraPath_parse(const char* name, CameraPathKind* kind) {
+    for (int k = 0; k < CAMERA_PATH_COUNT; ++k) {
+        if (strcmp(name, cameraPath_name(k)) == 0) {
+            *kind = k;
+            return true;
+        }
+    }
+    return false;
+}
+
+Vec2 camera_lookDir(const Camera* cam) {
+    return (Vec2){ cos(cam->theta), sin(cam->theta) };
+}
+
+// Center of the empty tile closest to the middle of the map
+Vec2 gameMap_findSpawn(const GameMap* gm) {
+    float c = gm->dim / 2.f;
+    Vec2 best = { c, c };
+    float best_d = INFINITY;
+
+    for (int y = 0; y < gm->dim; ++y) {
+        for (int x = 0; x < gm->dim; ++x) {
+            if (gm->map[x + y * gm->dim] != 0) {
+                continue;
+            }
+            float dx = x + 0.5f - c;
+            float dy = y + 0.5f - c;
+            float d = dx * dx + dy * dy;
+            if (d < best_d) {
+                best_d = d;
+                best = (Vec2){ x + 0.5f, y + 0.5f };
+            }
+        }
+    }
+    return best;
+}
+
+Camera cameraPath_eval(CameraPathKind kind, const GameMap* gm, Vec2 spawn, int frame, int num_frames) {
+    double t = num_frames > 0 ? (double)frame / num_frames : 0.0;
+    double a = 2.0 * M_PI * t;
+
+    Camera cam = { .pos = spawn, .theta = 0.0 };
+
+    switch (kind) {
+    case CAMERA_PATH_SPIN:
+        cam.theta = a;
+        break;
+    case CAMERA_PATH_ORBIT: {
+        float c = gm->dim / 2.f;
+        float radius = gm->dim / 4.f;
+        cam.pos = (Vec2){ c + radius * cos(a), c + radius * sin(a) };
+        cam.theta = a + M_PI / 2.0;
+    } break;
+    case CAMERA_PATH_SWAY:
+        cam.theta = degToRad(45.0) * sin(a);
+        cam.pos = vec2_add(spawn, (Vec2){ 0.25f * sin(2.0 * a), 0.f });
+        break;
+    default:
+        break;
+    }
+
+    return cam;
+}
+
+#endif // _CAMERA_PATH_H_
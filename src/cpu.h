@@ -0,0 +1,72 @@
+#ifndef _CPU_H_
+#define _CPU_H_
+
+#include <stdbool.h>
+
+/*
+* x86 SIMD support shared by the ray packets and the pixel kernels.
+* Kernels are compiled with a per-function target attribute and picked
+* at runtime, so one binary runs on any x86 CPU.
+*/
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CPU_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(CPU_X86) && (defined(__GNUC__) || defined(__clang__))
+#define CPU_TARGET_SSE2 __attribute__((target("sse2")))
+#define CPU_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define CPU_TARGET_SSE2
+#define CPU_TARGET_AVX2
+#endif
+
+typedef enum {
+    CPU_SIMD_NONE,
+    CPU_SIMD_SSE2,
+    CPU_SIMD_AVX2,
+} CpuSimd;
+
+// Best instruction set the CPU (and OS, for the AVX state) supports
+CpuSimd cpu_detectSimd(void) {
+#if defined(CPU_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int max_leaf = info[0];
+
+    __cpuid(info, 1);
+    bool sse2 = (info[3] & (1 << 26)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+
+    bool avx2 = false;
+    if (max_leaf >= 7 && osxsave && avx) {
+        // The OS has to save the ymm registers on context switches
+        bool ymm_enabled = (_xgetbv(0) & 0x6) == 0x6;
+        __cpuidex(info, 7, 0);
+        avx2 = ymm_enabled && (info[1] & (1 << 5)) != 0;
+    }
+
+    if (avx2) {
+        return CPU_SIMD_AVX2;
+    }
+    if (sse2) {
+        return CPU_SIMD_SSE2;
+    }
+#elif defined(CPU_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return CPU_SIMD_AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return CPU_SIMD_SSE2;
+    }
+#endif
+    return CPU_SIMD_NONE;
+}
+
+#endif // _CPU_H_
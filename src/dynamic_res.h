@@ -0,0 +1,114 @@
+#ifndef _DYNAMIC_RES_H_
+#define _DYNAMIC_RES_H_
+
+#include <stdbool.h>
+#include <math.h>
+
+/*
+* Dynamic resolution: picks the POV render scale that keeps the CPU side of
+* a frame (clear, cast and fill) under a time budget. Cost is taken to grow
+* with the texel count, so with the scale on both axes it goes as scale^2.
+*
+* Shrinking reacts within a few frames, growing waits for a long run of cheap
+* frames and stops short of the budget, so a scene that sits near the budget
+* doesn't flip between two sizes. Under a spike resolution drops before
+* frames do.
+*/
+
+#define DYNAMIC_RES_STEP 0.0625f   // Scales are multiples of this, smaller changes aren't worth a resize
+#define DYNAMIC_RES_HEADROOM 0.85f // Fraction of the budget a new scale aims for
+#define DYNAMIC_RES_GROW_BELOW 0.6f // Grow only while cost stays under this fraction of the budget
+#define DYNAMIC_RES_MAX_GROWTH 1.25f // Per change, the cost model is least reliable upwards
+#define DYNAMIC_RES_SHRINK_FRAMES 3
+#define DYNAMIC_RES_GROW_FRAMES 30
+#define DYNAMIC_RES_SETTLE_FRAMES 4 // Ignored after a change, the first frames at a new size are not typical
+
+typedef struct {
+    double budget; // seconds of CPU render time per frame
+    float min_scale;
+    float max_scale;
+    float scale;
+
+    double cost; // Smoothed seconds per frame at the current scale, 0 until measured
+    int over;    // Consecutive frames over the budget
+    int under;   // Consecutive frames under the grow threshold
+    int settle;
+} DynamicRes;
+
+void dynamicRes_init(DynamicRes* dr, double budget, float min_scale, float max_scale, float scale) {
+    dr->budget = budget;
+    dr->min_scale = min_scale;
+    dr->max_scale = max_scale;
+    dr->scale = scale < min_scale ? min_scale : (scale > max_scale ? max_scale : scale);
+    dr->cost = 0;
+    dr->over = 0;
+    dr->under = 0;
+    dr->settle = DYNAMIC_RES_SETTLE_FRAMES;
+}
+
+// Scale whose predicted cost is the headroom part of the budget, on the step grid
+static float dynamicRes_fit(const DynamicRes* dr) {
+    float ideal = dr->scale * (float)sqrt(dr->budget * DYNAMIC_RES_HEADROOM / dr->cost);
+    if (ideal > dr->scale * DYNAMIC_RES_MAX_GROWTH) {
+        ideal = dr->scale * DYNAMIC_RES_MAX_GROWTH;
+    }
+
+    float scale = floorf(ideal / DYNAMIC_RES_STEP) * DYNAMIC_RES_STEP;
+    scale = scale < dr->min_scale ? dr->min_scale : scale;
+    scale = scale > dr->max_scale ? dr->max_scale : scale;
+    return scale;
+}
+
+/*
+* Feeds the CPU time of the frame just drawn.
+* Returns true when scale changed and the POV has to be resized before the next frame.
+*/
+bool dynamicRes_update(DynamicRes* dr, double seconds) {
+    if (dr->settle > 0) {
+        --dr->settle;
+        return false;
+    }
+
+    // Spikes count right away, the average only steers how far to go
+    dr->cost = dr->cost == 0 ? seconds : dr->cost + (seconds - dr->cost) * 0.25;
+
+    if (seconds > dr->budget) {
+        ++dr->over;
+        dr->under = 0;
+    } else if (dr->cost < dr->budget * DYNAMIC_RES_GROW_BELOW) {
+        ++dr->under;
+        dr->over = 0;
+    } else {
+        dr->over = 0;
+        dr->under = 0;
+    }
+
+    bool shrink = dr->over >= DYNAMIC_RES_SHRINK_FRAMES && dr->scale > dr->min_scale;
+    bool grow = dr->under >= DYNAMIC_RES_GROW_FRAMES && dr->scale < dr->max_scale;
+    if (!shrink && !grow) {
+        return false;
+    }
+
+    // A spike can be far above the average, size for the worse of the two
+    if (shrink && seconds > dr->cost) {
+        dr->cost = seconds;
+    }
+
+    float scale = dynamicRes_fit(dr);
+    if (shrink && scale >= dr->scale) {
+        scale = dr->scale - DYNAMIC_RES_STEP;
+        scale = scale < dr->min_scale ? dr->min_scale : scale;
+    }
+    dr->over = 0;
+    dr->under = 0;
+    if ((grow && scale <= dr->scale) || scale == dr->scale) {
+        return false;
+    }
+
+    dr->scale = scale;
+    dr->cost = 0;
+    dr->settle = DYNAMIC_RES_SETTLE_FRAMES;
+    return true;
+}
+
+#endif // _DYNAMIC_RES_H_
@@ -1,16 +1,776 @@
 #ifndef _GAME_MAP_H_
 #define _GAME_MAP_H_
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN 1
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "thread_pool.h"
+
+/*
+* Binary map format (.rmap), little-endian:
+*   GameMapFileHeader
+*   GameMapFileSection[num_sections]
+*   section data, each aligned to GAME_MAP_FILE_ALIGN
+* The tile section holds dim * dim int32 tiles in the same order as GameMap.map,
+* so a loaded map points straight into the file mapping.
+* Unknown sections are skipped, so readers of the same version can ignore
+* acceleration data they don't use.
+*/
+
+#define GAME_MAP_FILE_MAGIC   "RMAP"
+#define GAME_MAP_FILE_VERSION 1
+#define GAME_MAP_FILE_ENDIAN  0x01020304u
+#define GAME_MAP_FILE_ALIGN   64
+
+typedef enum {
+    GAME_MAP_SECTION_TILES = 1,     // int32[dim * dim]
+    GAME_MAP_SECTION_OCCUPANCY = 2, // uint64 words, see GameMap.occupancy
+    GAME_MAP_SECTION_DISTANCE = 3,  // uint8[dim * dim], see GameMap.distance
+    GAME_MAP_SECTION_PYRAMID = 4,   // uint64 words of levels 1 and up, see GameMap.levels
+} GameMapSectionKind;
+
+// Cells per side of the square block stored in one occupancy word
+#define GAME_MAP_OCC_BLOCK 8
+
+// Enough for 8^8 cells per side
+#define GAME_MAP_MAX_LEVELS 8
+
+// Distance of cells with no solid cell anywhere in the map
+#define GAME_MAP_DIST_MAX UINT8_MAX
+
+/*
+* One level of the empty-space pyramid, stored like the occupancy bitmap.
+* A cell of level k covers 8^k map cells and is set if any of them is solid,
+* which is the same as the level k-1 word of that block being non-zero.
+*/
+typedef struct {
+    uint64_t* words;
+    int dim;    // Cells of this level per side
+    int stride; // Words per row of blocks
+} GameMapLevel;
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t endian;       // GAME_MAP_FILE_ENDIAN as written by the host
+    uint32_t header_size;  // sizeof(GameMapFileHeader)
+    uint32_t dim;
+    uint32_t tile_bytes;   // Width of one tile, only 4 is supported
+    uint32_t num_sections;
+    uint32_t reserved;
+    uint64_t file_size;
+} GameMapFileHeader;
+
+typedef struct {
+    uint32_t kind;
+    uint32_t flags;
+    uint64_t offset; // From the start of the file
+    uint64_t size;   // In bytes
+} GameMapFileSection;
 
 typedef struct {
     int dim;
     int* map;
     bool initialized;
+
+    /*
+    * One bit per cell, set for non-empty tiles. Each word covers an
+    * 8x8 block of cells (bit = 8 * (y % 8) + x % 8), so a ray crossing
+    * a few neighbouring rows stays within the same cache lines.
+    */
+    uint64_t* occupancy;
+    int occ_stride; // Words per row of blocks
+    bool occupancy_owned;
+
+    // Level 0 aliases occupancy, the levels above share one allocation.
+    // The top level fits in a single word.
+    GameMapLevel levels[GAME_MAP_MAX_LEVELS];
+    int num_levels;
+    uint64_t* pyramid_words;
+
+    /*
+    * Chebyshev distance in cells to the nearest solid cell, 0 on solid cells.
+    * Every cell closer than that is empty, so a ray can leave the square of them
+    * in one step. NULL until built or loaded from the map file.
+    */
+    uint8_t* distance;
+    bool distance_owned;
+
+    // Bumped by every tile edit, so caches of the map can tell they are stale
+    unsigned int epoch;
+
+    // Set when map points into a mapped binary file instead of the heap
+    void* file_view;
+    size_t file_size;
 } GameMap;
 
-int gameMap_init(GameMap* gm, const char* map_filename) {
+// Cells are never negative here, unsigned keeps the divisions down to shifts and masks
+static inline size_t gameMap_occWord(const GameMap* gm, int x, int y) {
+    return (size_t)((unsigned)y / GAME_MAP_OCC_BLOCK) * gm->occ_stride + (unsigned)x / GAME_MAP_OCC_BLOCK;
+}
+
+static inline int gameMap_occBit(int x, int y) {
+    return (int)(((unsigned)y % GAME_MAP_OCC_BLOCK) * GAME_MAP_OCC_BLOCK + (unsigned)x % GAME_MAP_OCC_BLOCK);
+}
+
+// Cell must be in bounds
+static inline bool gameMap_isSolid(const GameMap* gm, int x, int y) {
+    return (gm->occupancy[gameMap_occWord(gm, x, y)] >> gameMap_occBit(x, y)) & 1;
+}
+
+static inline size_t gameMap_occWords(int dim) {
+    int stride = (dim + GAME_MAP_OCC_BLOCK - 1) / GAME_MAP_OCC_BLOCK;
+    return (size_t)stride * stride;
+}
+
+// (Re)computes the bitmap from the tiles, allocating it unless it lives in the map file
+int gameMap_buildOccupancy(GameMap* gm) {
+    gm->occ_stride = (gm->dim + GAME_MAP_OCC_BLOCK - 1) / GAME_MAP_OCC_BLOCK;
+
+    size_t words = gameMap_occWords(gm->dim);
+    if (gm->occupancy == NULL) {
+        gm->occupancy = malloc(words * sizeof(uint64_t));
+        if (gm->occupancy == NULL) {
+            printf("malloc failed\n");
+            return -1;
+        }
+        gm->occupancy_owned = true;
+    }
+    memset(gm->occupancy, 0, words * sizeof(uint64_t));
+
+    for (int y = 0; y < gm->dim; ++y) {
+        for (int x = 0; x < gm->dim; ++x) {
+            if (gm->map[x + y * gm->dim] != 0) {
+                gm->occupancy[gameMap_occWord(gm, x, y)] |= 1ull << gameMap_occBit(x, y);
+            }
+        }
+    }
+    return 0;
+}
+
+static inline uint64_t* gameMap_levelWord(const GameMapLevel* lv, int x, int y) {
+    return &lv->words[(size_t)((unsigned)y / GAME_MAP_OCC_BLOCK) * lv->stride + (unsigned)x / GAME_MAP_OCC_BLOCK];
+}
+
+/*
+* True if the whole aligned block of 8^level cells around (x, y) is empty.
+* level must be in [1, num_levels].
+*/
+static inline bool gameMap_blockEmpty(const GameMap* gm, int level, int x, int y) {
+    int shift = 3 * (level - 1);
+    return *gameMap_levelWord(&gm->levels[level - 1], (unsigned)x >> shift, (unsigned)y >> shift) == 0;
+}
+
+/*
+* Sizes the levels above the occupancy bitmap, adding levels until one word
+* covers the whole map, and points them at consecutive runs of words.
+* Returns the number of words they take, which is what words must hold.
+*/
+static size_t gameMap_placePyramid(GameMap* gm, uint64_t* words) {
+    gm->levels[0] = (GameMapLevel){ gm->occupancy, gm->dim, gm->occ_stride };
+    gm->num_levels = 1;
+
+    size_t total = 0;
+    while (gm->levels[gm->num_levels - 1].stride > 1 && gm->num_levels < GAME_MAP_MAX_LEVELS) {
+        const GameMapLevel* below = &gm->levels[gm->num_levels - 1];
+        GameMapLevel* lv = &gm->levels[gm->num_levels++];
+
+        lv->dim = below->stride;
+        lv->stride = (lv->dim + GAME_MAP_OCC_BLOCK - 1) / GAME_MAP_OCC_BLOCK;
+        lv->words = words != NULL ? words + total : NULL;
+        total += gameMap_occWords(lv->dim);
+    }
+    return total;
+}
+
+// Words of the levels above the bitmap, the size of GAME_MAP_SECTION_PYRAMID
+size_t gameMap_pyramidWords(const GameMap* gm) {
+    size_t total = 0;
+    for (int k = 1; k < gm->num_levels; ++k) {
+        total += gameMap_occWords(gm->levels[k].dim);
+    }
+    return total;
+}
+
+// Levels above the occupancy bitmap, rebuilt from it
+int gameMap_buildPyramid(GameMap* gm) {
+    free(gm->pyramid_words);
+    gm->pyramid_words = NULL;
+
+    size_t total = gameMap_placePyramid(gm, NULL);
+    if (total == 0) {
+        return 0;
+    }
+
+    gm->pyramid_words = calloc(total, sizeof(uint64_t));
+    if (gm->pyramid_words == NULL) {
+        printf("calloc failed\n");
+        return -1;
+    }
+    gameMap_placePyramid(gm, gm->pyramid_words);
+
+    for (int k = 1; k < gm->num_levels; ++k) {
+        const GameMapLevel* below = &gm->levels[k - 1];
+        GameMapLevel* lv = &gm->levels[k];
+
+        for (int y = 0; y < lv->dim; ++y) {
+            for (int x = 0; x < lv->dim; ++x) {
+                if (below->words[(size_t)y * below->stride + x] != 0) {
+                    *gameMap_levelWord(lv, x, y) |= 1ull << gameMap_occBit(x, y);
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+typedef struct {
+    GameMap* gm;
+    int* scratch; // 3 * dim ints per worker
+} GameMapDistanceJob;
+
+// Pass 1 on a strip of columns: vertical distance to the nearest solid cell in the column
+static void gameMap_distanceColumns(void* ctx, int begin, int end, int worker) {
+    GameMapDistanceJob* job = ctx;
+    const int* tiles = job->gm->map;
+    uint8_t* d = job->gm->distance;
+    int dim = job->gm->dim;
+    (void)worker;
+
+    for (int x = begin; x < end; ++x) {
+        d[x] = tiles[x] != 0 ? 0 : GAME_MAP_DIST_MAX;
+    }
+    for (int y = 1; y < dim; ++y) {
+        size_t row = (size_t)y * dim;
+        for (int x = begin; x < end; ++x) {
+            int up = d[row - dim + x] + 1;
+            d[row + x] = tiles[row + x] != 0 ? 0 : (up < GAME_MAP_DIST_MAX ? up : GAME_MAP_DIST_MAX);
+        }
+    }
+    for (int y = dim - 2; y >= 0; --y) {
+        size_t row = (size_t)y * dim;
+        for (int x = begin; x < end; ++x) {
+            int down = d[row + dim + x] + 1;
+            d[row + x] = d[row + x] < down ? d[row + x] : down;
+        }
+    }
+}
+
+static inline int gameMap_chebyshevF(const int* g, int x, int i) {
+    int dx = abs(x - i);
+    return dx > g[i] ? dx : g[i];
+}
+
+// Column of the lower envelope where u starts to beat i
+static inline int gameMap_chebyshevSep(const int* g, int i, int u) {
+    int mid = (i + u) / 2;
+    if (g[i] <= g[u]) {
+        return i + g[u] > mid ? i + g[u] : mid;
+    }
+    return u - g[i] < mid ? u - g[i] : mid;
+}
+
+// Pass 2 on a range of rows: lower envelope of the column distances under the max norm
+static void gameMap_distanceRows(void* ctx, int begin, int end, int worker) {
+    GameMapDistanceJob* job = ctx;
+    uint8_t* d = job->gm->distance;
+    int dim = job->gm->dim;
+
+    int* g = job->scratch + (size_t)worker * 3 * dim;
+    int* s = g + dim;
+    int* t = s + dim;
+
+    for (int y = begin; y < end; ++y) {
+        uint8_t* row = d + (size_t)y * dim;
+        for (int x = 0; x < dim; ++x) {
+            g[x] = row[x];
+        }
+
+        int q = 0;
+        s[0] = 0;
+        t[0] = 0;
+        for (int u = 1; u < dim; ++u) {
+            while (q >= 0 && gameMap_chebyshevF(g, t[q], s[q]) > gameMap_chebyshevF(g, t[q], u)) {
+                --q;
+            }
+            if (q < 0) {
+                q = 0;
+                s[0] = u;
+            } else {
+                int w = 1 + gameMap_chebyshevSep(g, s[q], u);
+                if (w < dim) {
+                    ++q;
+                    s[q] = u;
+                    t[q] = w;
+                }
+            }
+        }
+        for (int u = dim - 1; u >= 0; --u) {
+            int f = gameMap_chebyshevF(g, u, s[q]);
+            row[u] = f < GAME_MAP_DIST_MAX ? f : GAME_MAP_DIST_MAX;
+            if (u == t[q]) {
+                --q;
+            }
+        }
+    }
+}
+
+/*
+* Exact Chebyshev distance transform (Meijster et al.), in two separable passes
+* over columns and then rows, each split across the pool. pool may be NULL.
+* Reuses the field's memory, so a section mapped from the file is rebuilt in place.
+*/
+int gameMap_buildDistance(GameMap* gm, ThreadPool* pool) {
+    if (gm->distance == NULL) {
+        gm->distance = malloc((size_t)gm->dim * gm->dim * sizeof(uint8_t));
+        if (gm->distance == NULL) {
+            printf("malloc failed\n");
+            return -1;
+        }
+        gm->distance_owned = true;
+    }
+
+    int num_workers = pool != NULL ? pool->num_threads : 1;
+    GameMapDistanceJob job = { gm, malloc((size_t)num_workers * 3 * gm->dim * sizeof(int)) };
+    if (job.scratch == NULL) {
+        printf("malloc failed\n");
+        return -1;
+    }
+
+    // Strips of columns keep pass 1 walking memory row by row
+    threadPool_parallelFor(pool, gm->dim, 64, gameMap_distanceColumns, &job);
+    threadPool_parallelFor(pool, gm->dim, 0, gameMap_distanceRows, &job);
+
+    free(job.scratch);
+    return 0;
+}
+
+/*
+* Calls visit on every in-bounds cell of ring r around (x, y), i.e. at
+* Chebyshev distance r from it. Returns true if any visit returned true.
+*/
+static bool gameMap_visitRing(GameMap* gm, int x, int y, int r, bool (*visit)(GameMap*, size_t, int)) {
+    int dim = gm->dim;
+    int x0 = x - r < 0 ? 0 : x - r;
+    int x1 = x + r >= dim ? dim - 1 : x + r;
+    bool any = false;
+
+    for (int cy = y - r; cy <= y + r; ++cy) {
+        if (cy < 0 || cy >= dim) {
+            continue;
+        }
+        size_t row = (size_t)cy * dim;
+        if (cy == y - r || cy == y + r) {
+            for (int cx = x0; cx <= x1; ++cx) {
+                any |= visit(gm, row + cx, r);
+            }
+        } else {
+            if (x - r >= 0) {
+                any |= visit(gm, row + x - r, r);
+            }
+            if (x + r < dim) {
+                any |= visit(gm, row + x + r, r);
+            }
+        }
+    }
+    return any;
+}
+
+static bool gameMap_lowerDistance(GameMap* gm, size_t i, int r) {
+    if (gm->distance[i] > r) {
+        gm->distance[i] = (uint8_t)r;
+        return true;
+    }
+    return false;
+}
+
+static bool gameMap_distanceIs(GameMap* gm, size_t i, int r) {
+    return gm->distance[i] == r;
+}
+
+/*
+* Repairs the distance field around (x, y) after that cell changed.
+* Distances are 1-Lipschitz, so once a whole ring around the cell is
+* unaffected every ring outside it is too.
+*/
+static void gameMap_updateDistance(GameMap* gm, int x, int y, bool solid) {
+    uint8_t* d = gm->distance;
+    int dim = gm->dim;
+
+    if (solid) {
+        // Cells can only get closer to a wall, ring r is at most r away from it now
+        d[(size_t)y * dim + x] = 0;
+        int r = 1;
+        while (r < dim && gameMap_visitRing(gm, x, y, r, gameMap_lowerDistance)) {
+            ++r;
+        }
+        return;
+    }
+
+    // Cells that had (x, y) as a nearest wall are exactly r away from it
+    int radius = 0;
+    while (radius + 1 < dim && gameMap_visitRing(gm, x, y, radius + 1, gameMap_distanceIs)) {
+        ++radius;
+    }
+
+    // Reset the affected square and propagate inwards from its unchanged border ring
+    int x0 = x - radius - 1 < 0 ? 0 : x - radius - 1;
+    int x1 = x + radius + 1 >= dim ? dim - 1 : x + radius + 1;
+    int y0 = y - radius - 1 < 0 ? 0 : y - radius - 1;
+    int y1 = y + radius + 1 >= dim ? dim - 1 : y + radius + 1;
+
+    for (int cy = y0; cy <= y1; ++cy) {
+        for (int cx = x0; cx <= x1; ++cx) {
+            if (abs(cx - x) <= radius && abs(cy - y) <= radius) {
+                d[(size_t)cy * dim + cx] = gm->map[(size_t)cy * dim + cx] != 0 ? 0 : GAME_MAP_DIST_MAX;
+            }
+        }
+    }
+
+    // Two chamfer passes with unit weights on all 8 neighbours are exact for the max norm
+    for (int cy = y0; cy <= y1; ++cy) {
+        for (int cx = x0; cx <= x1; ++cx) {
+            int best = d[(size_t)cy * dim + cx];
+            for (int ny = cy - 1; ny <= cy; ++ny) {
+                for (int nx = cx - 1; nx <= cx + 1; ++nx) {
+                    if ((ny == cy && nx >= cx) || nx < x0 || nx > x1 || ny < y0) {
+                        continue;
+                    }
+                    int v = d[(size_t)ny * dim + nx] + 1;
+                    best = v < best ? v : best;
+                }
+            }
+            d[(size_t)cy * dim + cx] = (uint8_t)best;
+        }
+    }
+    for (int cy = y1; cy >= y0; --cy) {
+        for (int cx = x1; cx >= x0; --cx) {
+            int best = d[(size_t)cy * dim + cx];
+            for (int ny = cy; ny <= cy + 1; ++ny) {
+                for (int nx = cx - 1; nx <= cx + 1; ++nx) {
+                    if ((ny == cy && nx <= cx) || nx < x0 || nx > x1 || ny > y1) {
+                        continue;
+                    }
+                    int v = d[(size_t)ny * dim + nx] + 1;
+                    best = v < best ? v : best;
+                }
+            }
+            d[(size_t)cy * dim + cx] = (uint8_t)best;
+        }
+    }
+}
+
+// The only way tiles should change after load, keeps the bitmap, pyramid and distance field in sync
+void gameMap_setTile(GameMap* gm, int x, int y, int tile) {
+    gm->map[x + y * gm->dim] = tile;
+
+    uint64_t bit = 1ull << gameMap_occBit(x, y);
+    uint64_t* word = &gm->occupancy[gameMap_occWord(gm, x, y)];
+    *word = tile != 0 ? *word | bit : *word & ~bit;
+
+    if (gm->distance != NULL && (tile != 0) != (gm->distance[x + y * gm->dim] == 0)) {
+        gameMap_updateDistance(gm, x, y, tile != 0);
+    }
+
+    // Propagate up while the block's emptiness changes the level above
+    for (int k = 1; k < gm->num_levels; ++k) {
+        bool solid = *word != 0;
+        x /= GAME_MAP_OCC_BLOCK;
+        y /= GAME_MAP_OCC_BLOCK;
+
+        bit = 1ull << gameMap_occBit(x, y);
+        word = gameMap_levelWord(&gm->levels[k], x, y);
+        if (((*word & bit) != 0) == solid) {
+            break;
+        }
+        *word = solid ? *word | bit : *word & ~bit;
+    }
+
+    ++gm->epoch;
+}
+
+static bool gameMap_isBinaryFile(const char* map_filename) {
+    FILE* file = fopen(map_filename, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    char magic[4] = { 0 };
+    size_t n = fread(magic, 1, sizeof(magic), file);
+    fclose(file);
+    return n == sizeof(magic) && memcmp(magic, GAME_MAP_FILE_MAGIC, sizeof(magic)) == 0;
+}
+
+// Section of the given kind in a mapped binary map, NULL if the map has none
+const void* gameMap_fileSection(const GameMap* gm, uint32_t kind, uint64_t* size) {
+    if (gm->file_view == NULL) {
+        return NULL;
+    }
+    const GameMapFileHeader* hdr = gm->file_view;
+    const GameMapFileSection* sections = (const GameMapFileSection*)((const char*)gm->file_view + hdr->header_size);
+
+    for (uint32_t i = 0; i < hdr->num_sections; ++i) {
+        if (sections[i].kind == kind) {
+            if (size != NULL) {
+                *size = sections[i].size;
+            }
+            return (const char*)gm->file_view + sections[i].offset;
+        }
+    }
+    return NULL;
+}
+
+static void gameMap_unmapFile(void* view, size_t size) {
+#ifdef _WIN32
+    UnmapViewOfFile(view);
+#else
+    munmap(view, size);
+#endif
+}
+
+void gameMap_destroy(GameMap* gm) {
+    free(gm->pyramid_words);
+    if (gm->occupancy_owned) {
+        free(gm->occupancy);
+    }
+    if (gm->distance_owned) {
+        free(gm->distance);
+    }
+    if (gm->file_view != NULL) {
+        gameMap_unmapFile(gm->file_view, gm->file_size);
+    } else {
+        free(gm->map);
+    }
+    memset(gm, 0, sizeof(GameMap));
+}
+
+/*
+* Maps the file copy-on-write: tiles are never copied or parsed,
+* edits stay private to the process.
+* Only the header and section table are checked, so with the occupancy
+* and pyramid sections rayc-mapc writes it takes the same time for every
+* map size. Files without them get a warning and the sections are built
+* on load, a pass over every tile.
+*/
+int gameMap_initBinary(GameMap* gm, const char* map_filename) {
+    memset(gm, 0, sizeof(GameMap));
+
+    void* view = NULL;
+    size_t size = 0;
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(map_filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        printf("Failed to open file: %s\n", map_filename);
+        return -1;
+    }
+    LARGE_INTEGER file_size;
+    GetFileSizeEx(file, &file_size);
+    size = (size_t)file_size.QuadPart;
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    if (mapping != NULL) {
+        view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+        CloseHandle(mapping);
+    }
+    CloseHandle(file);
+#else
+    int fd = open(map_filename, O_RDONLY);
+    if (fd < 0) {
+        printf("Failed to open file: %s\n", map_filename);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+        size = (size_t)st.st_size;
+        view = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (view == MAP_FAILED) {
+            view = NULL;
+        }
+    }
+    close(fd);
+#endif
+
+    if (view == NULL) {
+        printf("Failed to map file: %s\n", map_filename);
+        return -1;
+    }
+
+    const GameMapFileHeader* hdr = view;
+    const char* err = NULL;
+
+    if (size < sizeof(GameMapFileHeader) || memcmp(hdr->magic, GAME_MAP_FILE_MAGIC, 4) != 0) {
+        err = "not a binary map";
+    } else if (hdr->version != GAME_MAP_FILE_VERSION) {
+        err = "unsupported version";
+    } else if (hdr->endian != GAME_MAP_FILE_ENDIAN) {
+        err = "written on a host of different endianness";
+    } else if (hdr->header_size < sizeof(GameMapFileHeader) || hdr->file_size != size ||
+               hdr->header_size + (uint64_t)hdr->num_sections * sizeof(GameMapFileSection) > size) {
+        err = "truncated file";
+    } else if (hdr->tile_bytes != sizeof(int)) {
+        err = "unsupported tile width";
+    } else if (hdr->dim == 0 || hdr->dim > 65535) {
+        err = "bad dimensions";
+    }
+
+    if (err == NULL) {
+        const GameMapFileSection* sections = (const GameMapFileSection*)((const char*)view + hdr->header_size);
+        for (uint32_t i = 0; i < hdr->num_sections; ++i) {
+            if (sections[i].offset % GAME_MAP_FILE_ALIGN != 0 ||
+                sections[i].offset > size || sections[i].size > size - sections[i].offset) {
+                err = "bad section table";
+                break;
+            }
+        }
+    }
+
+    if (err != NULL) {
+        printf("Failed to load %s: %s\n", map_filename, err);
+        gameMap_unmapFile(view, size);
+        return -1;
+    }
+
+    gm->file_view = view;
+    gm->file_size = size;
+    gm->dim = (int)hdr->dim;
+
+    uint64_t tiles_size = 0;
+    int* tiles = (int*)gameMap_fileSection(gm, GAME_MAP_SECTION_TILES, &tiles_size);
+    if (tiles == NULL || tiles_size != (uint64_t)gm->dim * gm->dim * sizeof(int)) {
+        printf("Failed to load %s: missing tile section\n", map_filename);
+        gameMap_unmapFile(view, size);
+        memset(gm, 0, sizeof(GameMap));
+        return -1;
+    }
+    gm->map = tiles;
+
+    // Prebuilt bitmap and pyramid are used in place when the file has them
+    uint64_t occ_size = 0;
+    uint64_t* occ = (uint64_t*)gameMap_fileSection(gm, GAME_MAP_SECTION_OCCUPANCY, &occ_size);
+    bool occ_valid = occ != NULL && occ_size == gameMap_occWords(gm->dim) * sizeof(uint64_t);
+    if (occ_valid) {
+        gm->occupancy = occ;
+        gm->occ_stride = (gm->dim + GAME_MAP_OCC_BLOCK - 1) / GAME_MAP_OCC_BLOCK;
+    } else {
+        printf("Warning: %s has no occupancy section, building it from the tiles\n", map_filename);
+        if (gameMap_buildOccupancy(gm) != 0) {
+            gameMap_destroy(gm);
+            return -1;
+        }
+    }
+
+    // A pyramid is only valid over the bitmap it was written with
+    uint64_t pyr_size = 0;
+    uint64_t* pyr = (uint64_t*)gameMap_fileSection(gm, GAME_MAP_SECTION_PYRAMID, &pyr_size);
+    size_t pyr_words = gameMap_placePyramid(gm, pyr);
+    if (pyr_words != 0 && (!occ_valid || pyr == NULL || pyr_size != pyr_words * sizeof(uint64_t))) {
+        printf("Warning: %s has no pyramid section, building it from the bitmap\n", map_filename);
+        if (gameMap_buildPyramid(gm) != 0) {
+            gameMap_destroy(gm);
+            return -1;
+        }
+    }
+
+    // The distance field is optional, maps without it build it on first use
+    uint64_t dist_size = 0;
+    uint8_t* dist = (uint8_t*)gameMap_fileSection(gm, GAME_MAP_SECTION_DISTANCE, &dist_size);
+    if (dist != NULL && dist_size == (uint64_t)gm->dim * gm->dim * sizeof(uint8_t)) {
+        gm->distance = dist;
+    }
+
+    gm->initialized = true;
+    return 0;
+}
+
+/*
+* Writes gm as a binary map with its tile section plus any extra sections.
+* extra may be NULL when num_extra is 0, their offsets are filled in here.
+*/
+int gameMap_writeBinary(const GameMap* gm, const char* map_filename,
+    const GameMapFileSection* extra, const void* const* extra_data, int num_extra)
+{
+    FILE* file = fopen(map_filename, "wb");
+    if (file == NULL) {
+        printf("Failed to open file: %s\n", map_filename);
+        return -1;
+    }
+
+    int num_sections = 1 + num_extra;
+
+    GameMapFileSection* sections = calloc(num_sections, sizeof(GameMapFileSection));
+    const void** data = calloc(num_sections, sizeof(void*));
+    if (sections == NULL || data == NULL) {
+        perror("Fatal error: calloc failed");
+        exit(1);
+    }
+
+    sections[0].kind = GAME_MAP_SECTION_TILES;
+    sections[0].size = (uint64_t)gm->dim * gm->dim * sizeof(int);
+    data[0] = gm->map;
+    for (int i = 0; i < num_extra; ++i) {
+        sections[1 + i] = extra[i];
+        data[1 + i] = extra_data[i];
+    }
+
+    uint64_t offset = sizeof(GameMapFileHeader) + num_sections * sizeof(GameMapFileSection);
+    for (int i = 0; i < num_sections; ++i) {
+        offset = (offset + GAME_MAP_FILE_ALIGN - 1) / GAME_MAP_FILE_ALIGN * GAME_MAP_FILE_ALIGN;
+        sections[i].offset = offset;
+        offset += sections[i].size;
+    }
+
+    GameMapFileHeader hdr = {
+        .version = GAME_MAP_FILE_VERSION,
+        .endian = GAME_MAP_FILE_ENDIAN,
+        .header_size = sizeof(GameMapFileHeader),
+        .dim = (uint32_t)gm->dim,
+        .tile_bytes = sizeof(int),
+        .num_sections = (uint32_t)num_sections,
+        .file_size = offset,
+    };
+    memcpy(hdr.magic, GAME_MAP_FILE_MAGIC, 4);
+
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, file) == 1 &&
+              fwrite(sections, sizeof(GameMapFileSection), num_sections, file) == (size_t)num_sections;
+
+    uint64_t pos = sizeof(GameMapFileHeader) + num_sections * sizeof(GameMapFileSection);
+    static const char zeros[GAME_MAP_FILE_ALIGN];
+    for (int i = 0; i < num_sections && ok; ++i) {
+        ok = fwrite(zeros, 1, sections[i].offset - pos, file) == sections[i].offset - pos &&
+             fwrite(data[i], 1, sections[i].size, file) == sections[i].size;
+        pos = sections[i].offset + sections[i].size;
+    }
+
+    fclose(file);
+    free(sections);
+    free(data);
+
+    if (!ok) {
+        printf("Failed to write file: %s\n", map_filename);
+        return -1;
+    }
+    return 0;
+}
+
+// Text format: dimension followed by dim * dim tile numbers
+int gameMap_initText(GameMap* gm, const char* map_filename) {
+    memset(gm, 0, sizeof(GameMap));
+
     FILE* file = fopen(map_filename, "r");
     if (file == NULL) {
         printf("Failed to open file\n");
@@ -43,15 +803,58 @@ int gameMap_init(GameMap* gm, const char* map_filename) {
 
     fclose(file);
 
+    if (gameMap_buildOccupancy(gm) != 0 || gameMap_buildPyramid(gm) != 0) {
+        return -1;
+    }
+
+    gm->initialized = true;
+    return 0;
+}
+
+// Loads either format, binary maps are recognized by their magic
+int gameMap_init(GameMap* gm, const char* map_filename) {
+    if (gameMap_isBinaryFile(map_filename)) {
+        return gameMap_initBinary(gm, map_filename);
+    }
+    return gameMap_initText(gm, map_filename);
+}
+
+/*
+* Square map with a solid border and interior walls placed at random
+* with the given density. Uses its own xorshift generator so the same
+* seed gives the same map on every platform.
+*/
+int gameMap_initGenerated(GameMap* gm, int dim, float density, unsigned int seed) {
+    memset(gm, 0, sizeof(GameMap));
+
+    gm->dim = dim;
+    gm->map = (int*)malloc(gm->dim * gm->dim * sizeof(int));
+    if (!gm->map) {
+        printf("malloc failed\n");
+        return -1;
+    }
+
+    unsigned int state = seed ? seed : 1;
+
     for (int row = 0; row < gm->dim; row++) {
         for (int col = 0; col < gm->dim; col++) {
-            printf("%d ", gm->map[col + row * gm->dim]);
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+
+            bool border = row == 0 || col == 0 || row == gm->dim - 1 || col == gm->dim - 1;
+            bool wall = (state >> 8) * (1.f / 16777216.f) < density;
+
+            gm->map[col + row * gm->dim] = border || wall ? 1 : 0;
         }
-        printf("\n");
+    }
+
+    if (gameMap_buildOccupancy(gm) != 0 || gameMap_buildPyramid(gm) != 0) {
+        return -1;
     }
 
     gm->initialized = true;
     return 0;
 }
 
-#endif // _GAME_MAP_H_
\ No newline at end of file
+#endif // _GAME_MAP_H_
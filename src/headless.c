@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "vec2.h"
+#include "screen.h"
+#include "texture_buffer.h"
+#include "game_map.h"
+#include "raycast.h"
+#include "raycast_packet.h"
+#include "thread_pool.h"
+#include "renderer.h"
+#include "camera_path.h"
+#include "obs_ring.h"
+
+/*
+* rayc-headless: renders a camera path into memory without a window or GL context.
+* Prints a hash per frame and one for the whole run, so two builds
+* can be compared by diffing the output.
+*/
+
+// Frame slots and queued actions of the -ring observation ring
+#define HEADLESS_RING_SLOTS   8
+#define HEADLESS_RING_ACTIONS 64
+
+static void printUsage(const char* exe)
+{
+    printf("Usage: %s [options]\n", exe);
+    printf("  -m FILE       map file (default maps/00.txt)\n");
+    printf("  -n N          number of frames (default 60)\n");
+    printf("  -s COLSxROWS  top view and POV size in texels (default 128x128)\n");
+    printf("  -f DEG        field of view (default 120)\n");
+    printf("  -p PATH       camera path: spin, orbit, sway (default spin)\n");
+    printf("  -t N          render threads, 0 uses every core (default 0)\n");
+    printf("  -r MODE       raycast mode: dda, march, packet, pyramid, distance, adaptive (default packet)\n");
+    printf("  -i ISA        packet width and pixel fills: scalar, sse2, avx2 (default best supported)\n");
+    printf("  -l LAYOUT     POV buffer layout: row, column (default row)\n");
+    printf("  -o DIR        write every frame as DIR/pov_NNNN.ppm and DIR/top_NNNN.ppm\n");
+    printf("  -ring NAME    publish every frame's POV and depth to shared memory NAME, waiting while it is full\n");
+    printf("  -c            draw every frame from scratch, without the renderer's frame cache\n");
+    printf("  -y            snap the yaw to column steps, so the frame cache reuses columns on turns\n");
+    printf("  -q            only print the final hash\n");
+}
+
+static bool parseMode(const char* name, RaycastMode* mode)
+{
+    for (int m = 0; m < RAYCAST_MODE_COUNT; ++m) {
+        if (strcmp(name, raycast_modeName(m)) == 0) {
+            *mode = m;
+            return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char** argv)
+{
+    const char* map_path = "maps/00.txt";
+    const char* out_dir = NULL;
+    const char* ring_name = NULL;
+    int num_frames = 60;
+    int cols = 128;
+    int rows = 128;
+    float fov = 120;
+    int num_threads = 0;
+    bool quiet = false;
+    bool frame_cache = true;
+    bool snap_yaw = false;
+    CameraPathKind path = CAMERA_PATH_SPIN;
+    RaycastMode mode = RAYCAST_MODE_PACKET;
+    TextureLayout layout = TEXTURE_LAYOUT_ROW_MAJOR;
+    RayPacketIsa isa = rayPacket_detectIsa();
+
+    for (int i = 1; i < argc; ++i) {
+        const char* opt = argv[i];
+        const char* val = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(opt, "-q") == 0) {
+            quiet = true;
+            continue;
+        }
+        if (strcmp(opt, "-c") == 0) {
+            frame_cache = false;
+            continue;
+        }
+        if (strcmp(opt, "-y") == 0) {
+            snap_yaw = true;
+            continue;
+        }
+        if (strcmp(opt, "-h") == 0) {
+            printUsage(argv[0]);
+            return 0;
+        }
+        if (val == NULL) {
+            printf("Missing value for %s\n", opt);
+            printUsage(argv[0]);
+            return 1;
+        }
+        ++i;
+
+        bool ok = true;
+        if (strcmp(opt, "-m") == 0) {
+            map_path = val;
+        } else if (strcmp(opt, "-n") == 0) {
+            num_frames = atoi(val);
+            ok = num_frames > 0;
+        } else if (strcmp(opt, "-s") == 0) {
+            ok = sscanf(val, "%dx%d", &cols, &rows) == 2 && cols > 0 && rows > 0;
+        } else if (strcmp(opt, "-f") == 0) {
+            fov = atof(val);
+            ok = fov > 0 && fov < 360;
+        } else if (strcmp(opt, "-p") == 0) {
+            ok = cameraPath_parse(val, &path);
+        } else if (strcmp(opt, "-t") == 0) {
+            num_threads = atoi(val);
+        } else if (strcmp(opt, "-r") == 0) {
+            ok = parseMode(val, &mode);
+        } else if (strcmp(opt, "-i") == 0) {
+            isa = rayPacket_parseIsa(val, isa);
+        } else if (strcmp(opt, "-l") == 0) {
+            ok = textureLayout_parse(val, &layout);
+        } else if (strcmp(opt, "-o") == 0) {
+            out_dir = val;
+        } else if (strcmp(opt, "-ring") == 0) {
+            ring_name = val;
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            printf("Invalid option: %s %s\n", opt, val);
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    GameMap gm;
+    if (gameMap_init(&gm, map_path) != 0) {
+        return 1;
+    }
+
+    ThreadPool pool;
+    if (threadPool_init(&pool, num_threads) != 0) {
+        return 1;
+    }
+
+    Screen scr;
+    screen_init(&scr, cols, rows, fov);
+
+    TextureBuffer top_view_tb;
+    TextureBuffer pov_tb;
+    textureBuffer_init(&top_view_tb, scr.TOP_VIEW_COLS, scr.TOP_VIEW_ROWS);
+    textureBuffer_init(&pov_tb, scr.POV_COLS, scr.POV_ROWS);
+    textureBuffer_setLayout(&pov_tb, layout);
+    top_view_tb.simd = (CpuSimd)isa;
+    pov_tb.simd = (CpuSimd)isa;
+
+    Renderer renderer;
+    renderer_init(&renderer, &scr, &gm, &top_view_tb, &pov_tb, &pool);
+    renderer.mode = mode;
+    renderer.isa = isa;
+    renderer.frame_cache = frame_cache;
+    renderer.snap_yaw = snap_yaw;
+
+    if (!quiet) {
+        printf("map %s, %dx%d, fov %.1f, path %s, mode %s, packets %s, layout %s, pixels %s, threads %d\n",
+            map_path, cols, rows, fov, cameraPath_name(path), raycast_modeName(mode),
+            rayPacket_isaName(isa), textureLayout_name(layout), PIXEL_FORMAT_NAME, pool.num_threads);
+    }
+
+    ObsRing ring;
+    if (ring_name != NULL) {
+        if (obsRing_create(&ring, ring_name, HEADLESS_RING_SLOTS, scr.POV_COLS, scr.POV_ROWS, 3, HEADLESS_RING_ACTIONS) != 0) {
+            return 1;
+        }
+        if (!quiet) {
+            printf("ring %s, %d slots\n", ring.name, HEADLESS_RING_SLOTS);
+        }
+    }
+
+    Vec2 spawn = gameMap_findSpawn(&gm);
+
+    // Hash of all frame hashes, one number to compare whole runs
+    unsigned long long run_hash = 14695981039346656037ULL;
+
+    for (int f = 0; f < num_frames; ++f) {
+        Camera cam = cameraPath_eval(path, &gm, spawn, f, num_frames);
+        if (snap_yaw) {
+            cam.theta = renderer_snapYaw(&renderer, cam.theta);
+        }
+
+        renderer_drawFrame(&renderer, cam.pos, camera_lookDir(&cam));
+
+        if (ring_name != NULL) {
+            // Every frame gets through, a slow reader slows the run down
+            ObsRingFrame* slot;
+            while ((slot = obsRing_beginWrite(&ring)) == NULL) {
+                obsRing_pause();
+            }
+            obsRing_writePov(&ring, slot, &renderer, cam.pos, camera_lookDir(&cam));
+            obsRing_endWrite(&ring);
+        }
+
+        unsigned long long pov_hash = textureBuffer_hash(&pov_tb);
+        unsigned long long top_hash = textureBuffer_hash(&top_view_tb);
+
+        run_hash = (run_hash ^ pov_hash) * 1099511628211ULL;
+        run_hash = (run_hash ^ top_hash) * 1099511628211ULL;
+
+        if (!quiet) {
+            printf("frame %4d pov %016llx top %016llx\n", f, pov_hash, top_hash);
+        }
+
+        if (out_dir != NULL) {
+            char filename[1024];
+            snprintf(filename, sizeof(filename), "%s/pov_%04d.ppm", out_dir, f);
+            if (textureBuffer_writePPM(&pov_tb, filename) != 0) {
+                return 1;
+            }
+            snprintf(filename, sizeof(filename), "%s/top_%04d.ppm", out_dir, f);
+            if (textureBuffer_writePPM(&top_view_tb, filename) != 0) {
+                return 1;
+            }
+        }
+    }
+
+    printf("hash %016llx\n", run_hash);
+
+    if (ring_name != NULL) {
+        obsRing_close(&ring);
+    }
+
+    renderer_destroy(&renderer);
+    screen_destroy(&scr);
+    threadPool_destroy(&pool);
+
+    textureBuffer_destroy(&top_view_tb);
+    textureBuffer_destroy(&pov_tb);
+    gameMap_destroy(&gm);
+
+    return 0;
+}
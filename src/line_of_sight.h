@@ -0,0 +1,264 @@
+#ifndef _LINE_OF_SIGHT_H_
+#define _LINE_OF_SIGHT_H_
+
+#include <stdbool.h>
+#include <math.h>
+
+#include "vec2.h"
+#include "game_map.h"
+#include "raycast.h"
+#include "raycast_packet.h"
+#include "thread_pool.h"
+
+/*
+* Batched line of sight over GameMap, for game logic that isn't rendering.
+* A query is blocked when the segment from -> to enters a solid cell before or at to,
+* so a to inside a wall is blocked by that wall, and a from inside one by its own cell.
+* Outside of the map counts as open, a segment that starts outside is walked from where
+* it enters the map. Points are in map space.
+*
+* Queries are split across the thread pool and set up 4 at a time with SSE2
+* (AVX2 CPUs run the same code), each answer is the one raycast_dda gives
+* for the segment on its own.
+*/
+
+typedef struct {
+    Vec2 from;
+    Vec2 to;
+} LosQuery;
+
+typedef struct {
+    bool visible;
+    float dist; // From from to the first solid cell on the segment, the segment's length if visible
+} LosResult;
+
+typedef struct {
+    const GameMap* gm;
+    RayPacketIsa isa;
+    const LosQuery* queries;
+    LosResult* results;
+} LosJob;
+
+static inline LosResult los_result(const RayHit* h, float dx, float dy) {
+    // The segment is the ray's direction, so it ends at ray parameter 1
+    float len = sqrtf(dx * dx + dy * dy);
+    return (LosResult){ .visible = !h->hit, .dist = h->hit ? h->dist * len : len };
+}
+
+/*
+* Queries whose from is outside of the map, the walks only start inside it.
+* The segment is clipped to the map's square and walked from where it enters,
+* distances still count from from.
+*/
+static LosResult los_fromOutside(const GameMap* gm, Vec2 from, Vec2 to) {
+    float dx = to.x - from.x;
+    float dy = to.y - from.y;
+    float len = sqrtf(dx * dx + dy * dy);
+    float dim = (float)gm->dim;
+
+    // Liang-Barsky against [0, dim] on both axes
+    float p[4] = { -dx, dx, -dy, dy };
+    float q[4] = { from.x, dim - from.x, from.y, dim - from.y };
+    float t0 = 0.f;
+    float t1 = 1.f;
+    for (int k = 0; k < 4; ++k) {
+        if (p[k] == 0.f) {
+            if (q[k] < 0.f) {
+                return (LosResult){ .visible = true, .dist = len };
+            }
+            continue;
+        }
+        float t = q[k] / p[k];
+        if (p[k] < 0.f) {
+            t0 = t > t0 ? t : t0;
+        } else {
+            t1 = t < t1 ? t : t1;
+        }
+    }
+    if (t0 > t1) {
+        return (LosResult){ .visible = true, .dist = len };
+    }
+
+    // The far edges belong to the cells outside, the entry point is kept in the last cell
+    float edge = nextafterf(dim, 0.f);
+    Vec2 entry = { from.x + dx * t0, from.y + dy * t0 };
+    entry.x = entry.x < 0.f ? 0.f : (entry.x > edge ? edge : entry.x);
+    entry.y = entry.y < 0.f ? 0.f : (entry.y > edge ? edge : entry.y);
+
+    Vec2 rest = { to.x - entry.x, to.y - entry.y };
+    RayHit h = raycast_dda(gm, entry, rest, 1.f);
+    if (!h.hit) {
+        return (LosResult){ .visible = true, .dist = len };
+    }
+    return (LosResult){ .visible = false, .dist = t0 * len + h.dist * vec2_magnitude(rest) };
+}
+
+static inline bool los_outside(const GameMap* gm, Vec2 p) {
+    return !gameMap_inBounds(gm, (int)floorf(p.x), (int)floorf(p.y));
+}
+
+#ifdef CPU_X86
+
+// Queries set up at a time
+#define LOS_CHUNK 64
+
+// Per query state of the walk, set up like raycast_dda does before its loop
+typedef struct {
+    float ox[LOS_CHUNK], oy[LOS_CHUNK], dx[LOS_CHUNK], dy[LOS_CHUNK], len[LOS_CHUNK];
+    float delta_x[LOS_CHUNK], delta_y[LOS_CHUNK], side_x[LOS_CHUNK], side_y[LOS_CHUNK];
+    int cx[LOS_CHUNK], cy[LOS_CHUNK];
+} LosChunk;
+
+/*
+* Sets up n queries, a multiple of 4, with the float operations raycast_dda uses.
+* The divisions, floors and square roots are most of a short query's cost,
+* the walks are left scalar since their lengths vary too much for packets.
+*/
+CPU_TARGET_SSE2
+static void los_setupSse2(LosChunk* c, const LosQuery* queries, int n) {
+    __m128 zero = _mm_setzero_ps();
+    __m128 one = _mm_set1_ps(1.f);
+    __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+    for (int k = 0; k < n; k += 4) {
+        // One query per register, from.x from.y to.x to.y, transposed to one field per register
+        __m128 a = _mm_loadu_ps(&queries[k].from.x);
+        __m128 b = _mm_loadu_ps(&queries[k + 1].from.x);
+        __m128 e = _mm_loadu_ps(&queries[k + 2].from.x);
+        __m128 f = _mm_loadu_ps(&queries[k + 3].from.x);
+        __m128 ab_x = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)); // from.x, to.x, from.x, to.x
+        __m128 ab_y = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        __m128 ef_x = _mm_shuffle_ps(e, f, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 ef_y = _mm_shuffle_ps(e, f, _MM_SHUFFLE(3, 1, 3, 1));
+        __m128 ox = _mm_shuffle_ps(ab_x, ef_x, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 tx = _mm_shuffle_ps(ab_x, ef_x, _MM_SHUFFLE(3, 1, 3, 1));
+        __m128 oy = _mm_shuffle_ps(ab_y, ef_y, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 ty = _mm_shuffle_ps(ab_y, ef_y, _MM_SHUFFLE(3, 1, 3, 1));
+
+        __m128 dx = _mm_sub_ps(tx, ox);
+        __m128 dy = _mm_sub_ps(ty, oy);
+        __m128i cx = rayPacket_floorSse2(ox);
+        __m128i cy = rayPacket_floorSse2(oy);
+
+        __m128 delta_x = _mm_and_ps(_mm_div_ps(one, dx), abs_mask);
+        __m128 delta_y = _mm_and_ps(_mm_div_ps(one, dy), abs_mask);
+        __m128 neg_x = _mm_cmplt_ps(dx, zero);
+        __m128 neg_y = _mm_cmplt_ps(dy, zero);
+
+        _mm_storeu_ps(&c->ox[k], ox);
+        _mm_storeu_ps(&c->oy[k], oy);
+        _mm_storeu_ps(&c->dx[k], dx);
+        _mm_storeu_ps(&c->dy[k], dy);
+        _mm_storeu_ps(&c->len[k], _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy))));
+        _mm_storeu_ps(&c->delta_x[k], delta_x);
+        _mm_storeu_ps(&c->delta_y[k], delta_y);
+        _mm_storeu_ps(&c->side_x[k], rayPacket_sideDistSse2(ox, neg_x, cx, delta_x));
+        _mm_storeu_ps(&c->side_y[k], rayPacket_sideDistSse2(oy, neg_y, cy, delta_y));
+        _mm_storeu_si128((__m128i*)&c->cx[k], cx);
+        _mm_storeu_si128((__m128i*)&c->cy[k], cy);
+    }
+}
+
+// The loop of raycast_dda from a set up query that starts inside the map, max_dist is 1
+static inline LosResult los_walk(const GameMap* gm, const LosChunk* c, int k) {
+    int cx = c->cx[k];
+    int cy = c->cy[k];
+    Vec2 origin = { c->ox[k], c->oy[k] };
+    Vec2 dir = { c->dx[k], c->dy[k] };
+    RayHit h = { .hit = false };
+
+    if (gameMap_isSolid(gm, cx, cy)) {
+        raycast_resolveHit(&h, origin, dir, cx, cy, RAY_FACE_NONE);
+        return (LosResult){ .visible = false, .dist = h.dist * c->len[k] };
+    }
+
+    float delta_x = c->delta_x[k];
+    float delta_y = c->delta_y[k];
+    float side_x = c->side_x[k];
+    float side_y = c->side_y[k];
+    int step_x = dir.x < 0.f ? -1 : 1;
+    int step_y = dir.y < 0.f ? -1 : 1;
+
+    for (;;) {
+        RayFace face;
+        float t;
+
+        if (side_x < side_y) {
+            t = side_x;
+            cx += step_x;
+            side_x = raycast_sideDist(origin.x, dir.x, cx, delta_x);
+            face = step_x > 0 ? RAY_FACE_X_MIN : RAY_FACE_X_MAX;
+        } else {
+            t = side_y;
+            cy += step_y;
+            side_y = raycast_sideDist(origin.y, dir.y, cy, delta_y);
+            face = step_y > 0 ? RAY_FACE_Y_MIN : RAY_FACE_Y_MAX;
+        }
+
+        if (t > 1.f || !gameMap_inBounds(gm, cx, cy)) {
+            return (LosResult){ .visible = true, .dist = c->len[k] };
+        }
+        if (gameMap_isSolid(gm, cx, cy)) {
+            raycast_resolveHit(&h, origin, dir, cx, cy, face);
+            return (LosResult){ .visible = false, .dist = h.dist * c->len[k] };
+        }
+    }
+}
+
+#endif // CPU_X86
+
+static void los_run(void* ctx, int begin, int end, int worker) {
+    const LosJob* job = ctx;
+    int i = begin;
+    (void)worker;
+
+#ifdef CPU_X86
+    if (job->isa != RAY_PACKET_SCALAR) {
+        LosChunk c;
+        while (end - i >= 4) {
+            int n = (end - i < LOS_CHUNK ? end - i : LOS_CHUNK) & ~3;
+            los_setupSse2(&c, job->queries + i, n);
+            for (int k = 0; k < n; ++k) {
+                const LosQuery* q = &job->queries[i + k];
+                job->results[i + k] = gameMap_inBounds(job->gm, c.cx[k], c.cy[k])
+                    ? los_walk(job->gm, &c, k)
+                    : los_fromOutside(job->gm, q->from, q->to);
+            }
+            i += n;
+        }
+    }
+#endif
+
+    for (; i < end; ++i) {
+        const LosQuery* q = &job->queries[i];
+        if (los_outside(job->gm, q->from)) {
+            job->results[i] = los_fromOutside(job->gm, q->from, q->to);
+            continue;
+        }
+        Vec2 dir = { q->to.x - q->from.x, q->to.y - q->from.y };
+        RayHit h = raycast_dda(job->gm, q->from, dir, 1.f);
+        job->results[i] = los_result(&h, dir.x, dir.y);
+    }
+}
+
+// Answers queries[0..n) into results, on the pool's threads (NULL runs on the caller's)
+void los_batch(const GameMap* gm, ThreadPool* pool, RayPacketIsa isa, const LosQuery* queries, LosResult* results, int n) {
+    LosJob job = {
+        .gm = gm,
+        .isa = isa,
+        .queries = queries,
+        .results = results,
+    };
+    threadPool_parallelFor(pool, n, 0, los_run, &job);
+}
+
+// Single query, same answer as a batch of one
+LosResult los_query(const GameMap* gm, Vec2 from, Vec2 to) {
+    LosQuery q = { from, to };
+    LosResult res;
+    LosJob job = { .gm = gm, .isa = RAY_PACKET_SCALAR, .queries = &q, .results = &res };
+    los_run(&job, 0, 1, 0);
+    return res;
+}
+
+#endif // _LINE_OF_SIGHT_H_
@@ -10,124 +10,66 @@
 #include "GLFW/glfw3.h"
 
 #include "vec2.h"
+#include "screen.h"
 #include "texture_buffer.h"
+#include "texture_buffer_gl.h"
 #include "game_map.h"
+#include "raycast.h"
+#include "raycast_packet.h"
+#include "thread_pool.h"
+#include "renderer.h"
+#include "dynamic_res.h"
+#include "timer.h"
+#include "obs_ring.h"
 
 
-#define TOP_VIEW_PIX_W 4
-#define TOP_VIEW_PIX_H 4
+Screen scr;
 
 
-#define M_PI   3.14159265358979323846264338327950288
-
-#define degToRad(angleInDegrees) ((angleInDegrees) * M_PI / 180.0)
-#define radToDeg(angleInRadians) ((angleInRadians) * 180.0 / M_PI)
-
-
-/*
-* tv - top view (TV), left
-* pov - first person view (POV), right
-* map - integer coordinates in map
-*/
-
-#define map_to_tv_x(x) ((x) / gm.dim * scr.TOP_VIEW_COLS)
-#define map_to_tv_y(y) ((y) / gm.dim * scr.TOP_VIEW_ROWS)
-
-#define tv_to_map_x(x) ((x) / (float)scr.TOP_VIEW_COLS * gm.dim)
-#define tv_to_map_y(y) ((y) / (float)scr.TOP_VIEW_ROWS * gm.dim)
-
-
-typedef struct {
-    int POV_PIX_W;
-    int POV_PIX_H;
-
-    int TOP_VIEW_ROWS;
-    int TOP_VIEW_COLS;
-
-    int POV_ROWS;
-    int POV_COLS;
+GLFWwindow* window = NULL;
+static TextureBuffer top_view_tb; // top view (left side of the screen)
+static TextureBuffer pov_tb; // first-person view (right side of the screen)
 
-    int SCR_WIDTH;
-    int SCR_HEIGHT;
+static GameMap gm;
 
-    float PLAYER_POV;
+static ThreadPool pool;
+static Renderer renderer;
 
-    // Step angle diff between two rays in radians
-    float RAY_ANGLE_STEP; // theta
-    
-} Screen;
+static TextureUpscale pov_upscale = TEXTURE_UPSCALE_SHARP_BILINEAR;
+static unsigned int shaderProgram;
 
-static float RAY_STEP_COS;
-static float RAY_STEP_SIN;
+// RAYC_FRAME_BUDGET_MS turns it on, the render scale then is its upper limit
+static DynamicRes dyn_res;
+static bool dyn_res_enabled = false;
 
-static void screen_set_pov_cols(Screen* scr, int pov_cols) {
-    scr->POV_COLS = pov_cols;
-    scr->RAY_ANGLE_STEP = degToRad( scr->PLAYER_POV / scr->POV_COLS );
+// RAYC_OBS_RING=NAME publishes frames to shared memory and takes actions from it
+static ObsRing obs_ring;
+static bool obs_ring_enabled = false;
+static unsigned long long obs_ring_dropped = 0;
 
-    RAY_STEP_COS = cos(scr->RAY_ANGLE_STEP);
-    RAY_STEP_SIN = sin(scr->RAY_ANGLE_STEP);
+// Tells the shader which part of the POV texture holds the image
+static void povExtent_upload()
+{
+    glUseProgram(shaderProgram);
+    glUniform2i(glGetUniformLocation(shaderProgram, "povExtent"), pov_tb.width, pov_tb.height);
 }
 
-static void screen_reset(Screen* scr, int width, int height)
+/*
+* Sizes the POV for the current render scale. The texture is allocated for the largest
+* scale dynamic resolution may pick, so its changes don't reallocate anything.
+*/
+static void pov_resize(bool realloc)
 {
-    // At least 4, if a texel should be bigger, then round to more
-    // Mutpily by 2 to avoid having texture of uneven dimensions (probably bad for OpenGL?)
-    static int screen_round_to = max(max(TOP_VIEW_PIX_W * 2, TOP_VIEW_PIX_H * 2), 4);
-
-    // Window dimensions must be aligned to multiple of 4 
-    // because OpenGL doesn't correctly display textures with dimensions unaligned to 4
-    if (width != scr->SCR_WIDTH && width % screen_round_to != 0) {
-        if (width > scr->SCR_WIDTH) {
-            width += screen_round_to - width % screen_round_to;
-        } else {
-            width -= width % screen_round_to;
-        }
-    }
-
-    if (height != scr->SCR_HEIGHT && height % screen_round_to != 0) {
-        if (height > scr->SCR_HEIGHT) {
-            height += screen_round_to - height % screen_round_to;
-        } else {
-            height -= height % screen_round_to;
-        }
-    }
-
-    scr->SCR_WIDTH = width * 2;
-    scr->SCR_HEIGHT = height;
-
-    scr->TOP_VIEW_COLS = width / TOP_VIEW_PIX_W;
-    scr->TOP_VIEW_ROWS = height / TOP_VIEW_PIX_H;
-
-    float new_pov_cols = width / TOP_VIEW_PIX_W;
-    screen_set_pov_cols(scr, new_pov_cols);
-    //scr->POV_COLS = width / TOP_VIEW_PIX_W;
-    scr->POV_ROWS = height / TOP_VIEW_PIX_H;
-
-    printf("Screen WIDTH: %d\n", scr->SCR_WIDTH);
-    printf("Screen HEIGHT: %d\n", scr->SCR_HEIGHT);
-    printf("\n\n");
-
-
-    /*textureBuffer_reset(&top_view_tb, scr->TOP_VIEW_COLS, scr->TOP_VIEW_ROWS);
-    textureBuffer_reset(&pov_tb, scr->POV_COLS, scr->POV_ROWS);*/
+    float scale = scr.RENDER_SCALE;
+    if (realloc) {
+        screen_setRenderScale(&scr, dyn_res_enabled ? dyn_res.max_scale : scale);
+        textureBuffer_glReset(&pov_tb, scr.POV_COLS, scr.POV_ROWS);
+        screen_setRenderScale(&scr, scale);
+    }
+    textureBuffer_glResize(&pov_tb, scr.POV_COLS, scr.POV_ROWS);
+    povExtent_upload();
 }
 
-Screen scr = {
-    .TOP_VIEW_ROWS = 128,
-    .TOP_VIEW_COLS = 128,
-    .PLAYER_POV = 120,
-};
-
-
-GLFWwindow* window = NULL;
-static TextureBuffer top_view_tb; // top view (left side of the screen)
-static TextureBuffer pov_tb; // first-person view (right side of the screen)
-
-static GameMap gm;
-
-static Pixel TOP_CLEAR_COLOR;
-static Pixel POV_CLEAR_COLOR;
-
 void glfw_error_callback(int error, const char* description) 
 {
     printf("GLFW Error: %s\n", description);
@@ -204,8 +146,8 @@ void glfw_framebuffer_size_callback(GLFWwindow* window, int width, int height)
     glViewport(0, 0, width, height);
 
     screen_reset(&scr, width, height);
-    textureBuffer_reset(&top_view_tb, scr.TOP_VIEW_COLS, scr.TOP_VIEW_ROWS);
-    textureBuffer_reset(&pov_tb, scr.POV_COLS, scr.POV_ROWS);
+    textureBuffer_glReset(&top_view_tb, scr.TOP_VIEW_COLS, scr.TOP_VIEW_ROWS);
+    pov_resize(true);
 }
 
 
@@ -219,6 +161,7 @@ static double MOUSE_DELTA_X = 0;
 static double MOUSE_DELTA_Y = 0;
 
 static double theta = 0;
+static bool snap_yaw = false;
 
 static bool must_update_player_look_dir = false;
 
@@ -286,82 +229,17 @@ char* readShaderSource(const char* filepath) {
     return buffer;
 }
 
-#define TILE_SIZE 1
-
-#define TILE_STEPS 10
-
-static int NUM_STEPS;
-
-//static const int STEP = TILE_SIZE / TILE_STEPS;
-//
-//static const float dist_to_near_plane = 0.2; // equals to half plane width means 45 degree FOV
-//static const float near_plane_width = 0.4;
-
-
-static float plane_width;
-static float plane_dist = 4;
-
-//static const int supersampling = 32;
-
-static const float stop_dist = 0.1;
-
 static const float mov_speed = 3;
 
-// Step angle diff between two rays in radians
-static float RAY_ANGLE_STEP;
-
 // Coordinates of player in map
 static Vec2 player = {2, 3};
 
 static Vec2 player_look_dir = {0, 1};
 
-static Pixel BLACK = { 0,  0,  0 };
-static Pixel RED   = { 255, 0, 0 };
-static Pixel GREEN = { 0, 255, 0 };
-static Pixel BLUE  = { 0, 0, 255 };
-
-static Pixel YELLOW = { 255, 255, 0 };
-static Pixel MAGENTA = { 255, 0, 255 };
-static Pixel CYAN = { 0, 255, 255 };
-
-static Pixel PLAYER_COLOR;
-static Pixel NEAREST_PLANE_COLOR;
-
-
-#define draw_TV(x, y, pix) do {\
-    textureBuffer_setPixel(&top_view_tb, (x), (scr.TOP_VIEW_ROWS-y), (pix)); \
-} while(0)
-
-#define draw_POV(x, y, pix) do {\
-    textureBuffer_setPixel(&pov_tb, (x), (y), (pix)); \
-} while(0)
-
 
 void globals_Init()
 {
-    PLAYER_COLOR = RED;
-    NEAREST_PLANE_COLOR = MAGENTA;
-
-
-    plane_width = plane_dist * tan(degToRad(scr.PLAYER_POV / 2.0)) * 2.0;
-
-
-    //POV_COLS = plane_width * supersampling;
-    screen_set_pov_cols(&scr, 128);
-    scr.POV_ROWS = scr.POV_COLS;
-
-    int half_screen_w = scr.TOP_VIEW_COLS * TOP_VIEW_PIX_W;
-
-    scr.POV_PIX_W = half_screen_w / scr.POV_COLS;
-    scr.POV_PIX_H = scr.POV_PIX_W;
-
-    scr.SCR_WIDTH = scr.TOP_VIEW_COLS * TOP_VIEW_PIX_W * 2;
-    scr.SCR_HEIGHT = scr.TOP_VIEW_ROWS * TOP_VIEW_PIX_H;
-
-    NUM_STEPS = TILE_STEPS * gm.dim;
-
-    TOP_CLEAR_COLOR = BLACK;
-    POV_CLEAR_COLOR = BLACK;
+    screen_init(&scr, 128, 128, 120);
 }
 
 
@@ -370,36 +248,40 @@ void processInput(GLFWwindow* window, double delta_time) {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
         glfwSetWindowShouldClose(window, true);
     }
-}
-
-
-
-
-void drawNearestPlane(Vec2 player_pos_pixel_space, Vec2 player_look_dir)
-{
-    Vec2 plane_dir = vec2_perpendicular(player_look_dir);
-    Vec2 plane_center = vec2_muli(player_look_dir, plane_dist);
-
-    for (float i = -plane_width / 2; i < plane_width / 2 + 1; i += 1) {
-        // Vec2 vpl = vpy + player_look_dir * (plane_dist) + plane_dir * i;
-
-        Vec2 plane_dir_advanced = vec2_mulf(plane_dir, i);
 
-        Vec2 plane_next = vec2_add(plane_center, plane_dir_advanced);
-
-        Vec2 vpl = vec2_add(player_pos_pixel_space, plane_next);
-
-        draw_TV(vpl.x, vpl.y, NEAREST_PLANE_COLOR);
-    }
-}
-
-void drawPlayer(Vec2 player_pos_pixel_space)
-{
-    for (int i = -1; i < 2; ++i) {
-        for (int j = -1; j < 2; ++j) {
-            draw_TV(player_pos_pixel_space.x + i, player_pos_pixel_space.y + j, PLAYER_COLOR);
+    // Cycle through the raycast modes
+    static bool mode_key_was_down = false;
+    bool mode_key_down = glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS;
+    if (mode_key_down && !mode_key_was_down) {
+        renderer.mode = (renderer.mode + 1) % RAYCAST_MODE_COUNT;
+        printf("Raycast mode: %s\n", raycast_modeName(renderer.mode));
+    }
+    mode_key_was_down = mode_key_down;
+
+    // U cycles the POV upscale filter
+    static bool upscale_key_was_down = false;
+    bool upscale_key_down = glfwGetKey(window, GLFW_KEY_U) == GLFW_PRESS;
+    if (upscale_key_down && !upscale_key_was_down) {
+        pov_upscale = (pov_upscale + 1) % TEXTURE_UPSCALE_COUNT;
+        glUseProgram(shaderProgram);
+        glUniform1i(glGetUniformLocation(shaderProgram, "povUpscale"), pov_upscale);
+        printf("POV upscale: %s\n", textureUpscale_name(pov_upscale));
+    }
+    upscale_key_was_down = upscale_key_down;
+
+    // [ and ] step the render scale, the window keeps its size. With dynamic resolution they step its limit.
+    static bool scale_key_was_down = false;
+    int scale_step = (glfwGetKey(window, GLFW_KEY_RIGHT_BRACKET) == GLFW_PRESS)
+                   - (glfwGetKey(window, GLFW_KEY_LEFT_BRACKET) == GLFW_PRESS);
+    if (scale_step != 0 && !scale_key_was_down) {
+        screen_setRenderScale(&scr, scr.RENDER_SCALE + scale_step * 0.125f);
+        if (dyn_res_enabled) {
+            dynamicRes_init(&dyn_res, dyn_res.budget, dyn_res.min_scale, scr.RENDER_SCALE, scr.RENDER_SCALE);
         }
+        pov_resize(true);
+        printf("Render scale: %.3f, POV %dx%d\n", scr.RENDER_SCALE, scr.POV_COLS, scr.POV_ROWS);
     }
+    scale_key_was_down = scale_step != 0;
 }
 
 
@@ -425,15 +307,25 @@ void gameLogic(double delta_time) {
         delta_x += mov_speed * delta_time;
     }
 
-    Vec2 player_pos_pixel_space = { map_to_tv_x(player.x), map_to_tv_x(player.y)};
+    // One queued action per frame, on top of the keys and the mouse
+    ObsRingAction action = { 0 };
+    if (obs_ring_enabled && obsRing_popAction(&obs_ring, &action)) {
+        delta_y -= action.forward;
+        delta_x += action.strafe;
+    }
 
     /*player_look_dir.x = MOUSE_X_TEX_SPACE - player_pos_pixel_space.x;
     player_look_dir.y = MOUSE_Y_TEX_SPACE - player_pos_pixel_space.y;*/
-    if (must_update_player_look_dir) {
-        theta += MOUSE_DELTA_X * delta_time;
+    if (must_update_player_look_dir || action.turn != 0) {
+        if (must_update_player_look_dir) {
+            theta += MOUSE_DELTA_X * delta_time;
+        }
+        theta += action.turn;
 
-        player_look_dir.x = cos(theta);
-        player_look_dir.y = sin(theta);
+        // Only with RAYC_SNAP_YAW=1, turning moves the view by whole columns so the frame cache reuses their rays
+        double yaw = snap_yaw ? renderer_snapYaw(&renderer, theta) : theta;
+        player_look_dir.x = cos(yaw);
+        player_look_dir.y = sin(yaw);
 
         player_look_dir = vec2_normalized(player_look_dir);
 
@@ -451,240 +343,49 @@ void gameLogic(double delta_time) {
 
     /*player.x += ;
     player.y += delta_y;*/
-    
-    Pixel ldcol   = YELLOW;
-    
-    Pixel raycol  = GREEN;
-    Pixel wallcol = RED;
-
-    Pixel ceilcol = GREEN;
-    Pixel floorcol = YELLOW;
-
-    
-    // Draw near clipping plane
-    
-
-    //int num_rays = plane_width * supersampling;
-    int num_rays = scr.POV_COLS;
-    
-    //float i_step = 1 / (float)supersampling;
-    //int ray_len = 50;
-    float ray_step = 0.1;
-    int num_ray_steps = scr.TOP_VIEW_ROWS / ray_step;
-
-    int player_view_dist = scr.TOP_VIEW_ROWS;
-    float stop_dist = 5;
-
-    bool player_stop = false;
-
-
-    // Rotate fully to the left of pov 
-    float half_pov = scr.PLAYER_POV / 2.f;
-    float cos_start = cos(degToRad(-half_pov));
-    float sin_start = sin(degToRad(-half_pov));
-
-    float ray_x = player_look_dir.x * cos_start - player_look_dir.y * sin_start;
-    float ray_y = player_look_dir.x * sin_start + player_look_dir.y * cos_start;
-
-    Vec2 rayd = { ray_x, ray_y };
 
-    Vec2 ray_origin = player_pos_pixel_space;
+    Vec2 player_pos_pixel_space = renderer_mapToTopView(&renderer, player);
 
-    //for (float i = -plane_width/2; i < plane_width/2+1; i += i_step) {
-    for (int i = 0; i < num_rays; ++i) {
-        // Vec2 vpl = vpy + player_look_dir * (plane_dist) + plane_dir * i;
+    renderer_drawFrame(&renderer, player, player_look_dir);
+    bool unchanged = renderer.stats.unchanged;
 
-        /*Vec2 plane_center = vec2_mulf(player_look_dir, plane_dist);
-
-        float half_pw = plane_width / 2.f;
-        float adv = -half_pw + i / (float)num_rays * plane_width;
-
-        Vec2 plane_dir_advanced = vec2_mulf(plane_dir, adv);
-
-        Vec2 plane_next = vec2_add(plane_center, plane_dir_advanced);
-
-        Vec2 ray_origin = vec2_add(player_pos_pixel_space, plane_next);*/
-
-        //Draw(vpl.x, vpl.y, nearest_plane_col);
-
-        
-
-        
-        if (i > 0) {
-            // Rotate ray to next step
-            ray_x = rayd.x * RAY_STEP_COS - rayd.y * RAY_STEP_SIN;
-            ray_y = rayd.x * RAY_STEP_SIN + rayd.y * RAY_STEP_COS;
-
-            rayd.x = ray_x;
-            rayd.y = ray_y;
-
-            // TODO: is already normalized?
-            rayd = vec2_normalized(rayd);
-        }
-
-        
-        
-        
-        // Draw floor and ceiling
-        {
-            int half_r = scr.POV_ROWS / 2;
-
-            // Floor
-            for (int y = 0; y < half_r + 1; ++y) {
-                draw_POV(i, y, pixel_mulf(floorcol, 1));
-            }
-            // Ceilling
-            for (int y = half_r + 1; y < scr.POV_ROWS; ++y) {
-                draw_POV(i, y, pixel_mulf(ceilcol, 1));
-            }
-        }
-
-        bool hit = false;
-        int j = 0;
-        for (; j < num_ray_steps && !hit; ++j) {
-
-            //Vec2 rayp = vpy + rayd * j * ray_step;
-            Vec2 ray_dir_advanced = vec2_mulf(rayd, j*ray_step);
-            //Vec2 rayp = vec2_add(player_pos_pixel_space, ray_dir_advanced);
-            Vec2 rayp = vec2_add(ray_origin, ray_dir_advanced);
-
-            
-
-            draw_TV(rayp.x, rayp.y, raycol);
-
-
-            Vec2 tilep = { tv_to_map_x(rayp.x), tv_to_map_y(rayp.y) };
-
-
-            int tile_x = tilep.x;
-            int tile_y = tilep.y;
-
-            // Don't go out of map bounds
-            if (tile_x < 0.f    || tile_y < 0.f     ||
-                tile_x > gm.dim || tile_y > gm.dim) {
-                break;
-            }
-
-            assert(tile_x >= 0 && tile_x <= gm.dim);
-            assert(tile_y >= 0 && tile_y <= gm.dim);
-                
-            int tile = gm.map[tile_x + gm.dim * tile_y];
-            hit = tile != 0;
-            if (hit) {
-                draw_TV(rayp.x, rayp.y, wallcol);
-
-                //int pov_y = POV_ROWS / 2;
-                
-
-                //Vec2 player_to_wall = vec2_sub(rayp, player_pos_pixel_space);
-                Vec2  player_to_wall = vec2_sub(rayp, ray_origin);
-                float dist_to_wall   = vec2_magnitude(player_to_wall);
-                //if (dist_to_wall < stop_dist) { // stop
-                //    player_stop = true;
-                //}
-
-                
-
-                float ratio = dist_to_wall / player_view_dist;
-                //float pw = 2.5;
-                //float factor = pow(pw, 1+ratio) - pw;
-                float factor = ratio;
-
-                //float pw = 2.5;
-                //float ratio = pow(pw, dist_to_wall) / player_view_dist;
-                ////float factor = pow(pw, 1 + ratio) - pw;
-                //float factor = ratio;
-
-                //int height = POV_ROWS * (1 - factor);
-                int height = scr.POV_ROWS - scr.POV_ROWS * (dist_to_wall / player_view_dist);
-                int half_h = height / 2;
-
-                int half_r = scr.POV_ROWS / 2;
-
-                float brightness = height / (float)scr.POV_ROWS;
-                // Draw wall
-                for (int y = half_r - half_h; y < half_r + half_h + 1; ++y) {
-                    draw_POV(i, y, pixel_mulf(wallcol, brightness));
-                }
-            }
-        }
+    // The window doesn't wait for the reader, frames it has no room for are dropped.
+    // Frames the cache skipped send the last drawn one again, pov_tb may already be the next upload slot.
+    if (obs_ring_enabled && !obsRing_publishFrame(&obs_ring, &renderer, player, player_look_dir)) {
+        ++obs_ring_dropped;
     }
 
 
     // Cast a ray in the direction the player is moving to detect collision with wall
 #if 1
-    Vec2 player_move_dir = vec2_normalized(player_delta_pos);
+    float stop_dist = 5;
+
+    bool player_stop = false;
 
-    Pixel collision_ray_col = CYAN;
-    int collision_ray_len = stop_dist * 10;
+    Vec2 player_move_dir = vec2_normalized(player_delta_pos);
 
     Vec2 rayd_coll = player_move_dir;
 
-   
-
     //printf("Moving in dir (%f, %f)   %f\n", rayd_coll.x, rayd_coll.y, vec2_magnitude(rayd_coll));
 
-    bool hit = false;
-    for (int j = 0; j < collision_ray_len && !hit; ++j) {
+    RayHit coll = raycast(&gm, renderer.mode, player, vec2_mul(rayd_coll, renderer_topViewToMapScale(&renderer)), stop_dist);
 
-        Vec2 ray_dir_advanced = vec2_mulf(rayd_coll, j * ray_step);
-        Vec2 rayp = vec2_add(player_pos_pixel_space, ray_dir_advanced);
-
-        if (rayp.x < 0.f || rayp.y < 0.f) {
-            break;
-        }
-
-        draw_TV(rayp.x, rayp.y, collision_ray_col);
-
-
-        Vec2 tilep = { tv_to_map_x(rayp.x), tv_to_map_y(rayp.y) };
-        assert(tilep.x < 11 && tilep.y < 11);
-        assert(tilep.x > -1 && tilep.y > -1);
-
-        int tile_x = tilep.x;
-        int tile_y = tilep.y;
-
-        int tile = gm.map[tile_x + gm.dim * tile_y];
-        hit = tile != 0;
-        if (hit) {
-            //drawTopView(rayp.x, rayp.y, wallcol);
-
-            //int pov_y = POV_ROWS / 2;
-
-
-            Vec2 player_to_wall = vec2_sub(rayp, player_pos_pixel_space);
-            float dist_to_wall = vec2_magnitude(player_to_wall);
-            if (dist_to_wall < stop_dist) { // stop
-                player_stop = true;
-            }
-        }
+    // Already in the top view when the frame didn't change
+    if (!unchanged) {
+        renderer_drawRay(&renderer, player_pos_pixel_space, rayd_coll, coll.dist, CYAN);
     }
 
-#endif
+    if (coll.hit && coll.dist < stop_dist) { // stop
+        player_stop = true;
+    }
 
     if (player_stop) { // hit
         player = vec2_sub(player, vec2_mulf(player_delta_pos, 1.1));
     }
-
-
-    // Draw player
-    drawPlayer(player_pos_pixel_space);
-
-    drawNearestPlane(player_pos_pixel_space, player_look_dir);
-
-    // Draw player look dir
-    for (int i = 0; i < 10; ++i) {
-        float ldx = player_pos_pixel_space.x + player_look_dir.x * i;
-        float ldy = player_pos_pixel_space.y + player_look_dir.y * i;
-
-        draw_TV(ldx, ldy, ldcol);
-    }
-
-
+#endif
 }
 
 static unsigned int VAO, VBO, EBO;
-static unsigned int shaderProgram;
 
 int opengl_init()
 {
@@ -862,46 +563,18 @@ int opengl_init()
     // load and create a texture 
     // -------------------------
 
-    {
-        top_view_tb.gl_tex_unit = 0;
-        glActiveTexture(GL_TEXTURE0);
-
-        glGenTextures(1, &top_view_tb.gl_tex_id);
-        glBindTexture(GL_TEXTURE_2D, top_view_tb.gl_tex_id);
-        // set the texture wrapping parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	// set texture wrapping to GL_REPEAT (default wrapping method)
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        // set texture filtering parameters
-        /*glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);*/
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    textureBuffer_glInit(&top_view_tb, 0);
+    textureBuffer_glInit(&pov_tb, 1);
+    // Sharp bilinear samples between texels, the other filters fetch them directly
+    textureBuffer_glSetFilter(&pov_tb, GL_LINEAR);
 
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, top_view_tb.width, top_view_tb.height, 0, GL_RGB, GL_UNSIGNED_BYTE, top_view_tb.data);
-
-        top_view_tb.gl_tex_init = true;
-    }
-    {
-        pov_tb.gl_tex_unit = 1;
-        glActiveTexture(GL_TEXTURE0 + 1);
-
-        glGenTextures(1, &pov_tb.gl_tex_id);
-        glBindTexture(GL_TEXTURE_2D, pov_tb.gl_tex_id);
-        // set the texture wrapping parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	// set texture wrapping to GL_REPEAT (default wrapping method)
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        /*glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_NEVER);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_NEVER);*/
-        // set texture filtering parameters
-        /*glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);*/
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, pov_tb.width, pov_tb.height, 0, GL_RGB, GL_UNSIGNED_BYTE, pov_tb.data);
-
-        pov_tb.gl_tex_init = true;
+    // RAYC_PBO=0 uploads from client memory instead of the persistently mapped ring
+    const char* pbo_env = getenv("RAYC_PBO");
+    bool stream = false;
+    if (pbo_env == NULL || atoi(pbo_env) != 0) {
+        stream = textureBuffer_glStreamInit(&top_view_tb) && textureBuffer_glStreamInit(&pov_tb);
     }
+    printf("Texture upload: %s\n", stream ? "persistent PBO ring" : "client memory");
 
 
     // tell opengl for each sampler to which texture unit it belongs to (only has to be done once)
@@ -909,6 +582,9 @@ int opengl_init()
     glUseProgram(shaderProgram); // don't forget to activate/use the shader before setting uniforms!
     glUniform1i(glGetUniformLocation(shaderProgram, "topViewTex"), 0); // Texture unit 0
     glUniform1i(glGetUniformLocation(shaderProgram, "povTex"), 1); // Texture unit 1
+    glUniform1i(glGetUniformLocation(shaderProgram, "povTransposed"), pov_tb.layout == TEXTURE_LAYOUT_COLUMN_MAJOR);
+    glUniform1i(glGetUniformLocation(shaderProgram, "povUpscale"), pov_upscale);
+    povExtent_upload();
 
     // uncomment this call to draw in wireframe polygons.
     //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
@@ -931,14 +607,6 @@ void game_loop(double delta_time)
     // ------
     /*glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);*/
-    {
-        top_view_tb.updated_this_frame = false;
-        textureBuffer_clear(&top_view_tb, TOP_CLEAR_COLOR);
-    }
-    {
-        pov_tb.updated_this_frame = false;
-        textureBuffer_clear(&pov_tb, POV_CLEAR_COLOR);
-    }
 
     processInput(window, delta_time);
     gameLogic(delta_time);
@@ -951,6 +619,16 @@ void game_loop(double delta_time)
         textureBuffer_loadTexData(&pov_tb);
     }
 
+    // The CPU part of the frame that scales with the POV size. Resizing clears the POV,
+    // so it waits until this frame is uploaded and the next one is drawn at the new size.
+    if (dyn_res_enabled && !renderer.stats.unchanged) {
+        RenderStats* st = &renderer.stats;
+        if (dynamicRes_update(&dyn_res, st->clear + st->cast + st->fill)) {
+            screen_setRenderScale(&scr, dyn_res.scale);
+            pov_resize(false);
+        }
+    }
+
     // draw
     glUseProgram(shaderProgram);
     glBindVertexArray(VAO); // seeing as we only have a single VAO there's no need to bind it every time, but we'll do so to keep things a bit more organized
@@ -962,9 +640,77 @@ int main(void)
 {
     globals_Init();
 
+    // RAYC_THREADS=1 renders on the main thread only, unset or 0 uses every core
+    const char* threads_env = getenv("RAYC_THREADS");
+    if (threadPool_init(&pool, threads_env ? atoi(threads_env) : 0) != 0) {
+        return -1;
+    }
+    printf("Render threads: %d\n", pool.num_threads);
+
+    // RAYC_SIMD=scalar|sse2|avx2 forces the packet width and pixel fill kernels, it can't go above what the CPU supports
+    RayPacketIsa packet_isa = rayPacket_detectIsa();
+    const char* simd_env = getenv("RAYC_SIMD");
+    if (simd_env) {
+        packet_isa = rayPacket_parseIsa(simd_env, packet_isa);
+    }
+    printf("Ray packets: %s\n", rayPacket_isaName(packet_isa));
+
+    // RAYC_RENDER_SIZE=320x240 sets the POV size at render scale 1, the window doesn't change it.
+    // RAYC_RENDER_SCALE=0.5 casts the POV at half that resolution per axis,
+    // RAYC_UPSCALE=nearest|sharp|edge picks how the shader stretches it over the window
+    const char* size_env = getenv("RAYC_RENDER_SIZE");
+    int base_cols, base_rows;
+    if (size_env && sscanf(size_env, "%dx%d", &base_cols, &base_rows) == 2 && base_cols > 0 && base_rows > 0) {
+        screen_setRenderBase(&scr, base_cols, base_rows);
+    }
+    const char* scale_env = getenv("RAYC_RENDER_SCALE");
+    if (scale_env) {
+        screen_setRenderScale(&scr, atof(scale_env));
+    }
+    const char* upscale_env = getenv("RAYC_UPSCALE");
+    if (upscale_env) {
+        textureUpscale_parse(upscale_env, &pov_upscale);
+    }
+    printf("Render size: %dx%d, scale: %.3f, upscale: %s\n", scr.RENDER_BASE_COLS, scr.RENDER_BASE_ROWS,
+        scr.RENDER_SCALE, textureUpscale_name(pov_upscale));
+
+    // RAYC_FRAME_BUDGET_MS=4 lowers the render scale whenever clear, cast and fill take longer
+    const char* budget_env = getenv("RAYC_FRAME_BUDGET_MS");
+    if (budget_env && atof(budget_env) > 0) {
+        dyn_res_enabled = true;
+        dynamicRes_init(&dyn_res, atof(budget_env) * 1e-3, SCREEN_RENDER_SCALE_MIN, scr.RENDER_SCALE, scr.RENDER_SCALE);
+        printf("Frame budget: %.2f ms\n", dyn_res.budget * 1e3);
+    }
+
 
     textureBuffer_init(&top_view_tb, scr.TOP_VIEW_COLS, scr.TOP_VIEW_ROWS);
     textureBuffer_init(&pov_tb, scr.POV_COLS, scr.POV_ROWS);
+    top_view_tb.simd = (CpuSimd)packet_isa;
+    pov_tb.simd = (CpuSimd)packet_isa;
+
+    // RAYC_POV_LAYOUT=row|column picks the memory layout of the POV buffer, the shader undoes the transpose
+    const char* layout_env = getenv("RAYC_POV_LAYOUT");
+    TextureLayout pov_layout = TEXTURE_LAYOUT_ROW_MAJOR;
+    if (layout_env && textureLayout_parse(layout_env, &pov_layout)) {
+        textureBuffer_setLayout(&pov_tb, pov_layout);
+    }
+    printf("POV layout: %s, pixels: %s\n", textureLayout_name(pov_tb.layout), PIXEL_FORMAT_NAME);
+
+    renderer_init(&renderer, &scr, &gm, &top_view_tb, &pov_tb, &pool);
+    renderer.isa = packet_isa;
+
+    // RAYC_FRAME_CACHE=0 draws every frame in full, even when the camera and map didn't change
+    const char* cache_env = getenv("RAYC_FRAME_CACHE");
+    renderer.frame_cache = cache_env == NULL || atoi(cache_env) != 0;
+    printf("Frame cache: %s\n", renderer.frame_cache ? "on" : "off");
+
+    // RAYC_SNAP_YAW=1 trades smooth mouse look for more cast reuse, off by default since it changes the controls
+    const char* snap_env = getenv("RAYC_SNAP_YAW");
+    snap_yaw = renderer.frame_cache && snap_env != NULL && atoi(snap_env) != 0;
+    renderer.snap_yaw = snap_yaw;
+    if (snap_yaw) {
+        printf("Yaw snapped to column steps\n");
+    }
 
     if (opengl_init() != 0) {
         return -1;
@@ -975,6 +721,16 @@ int main(void)
         return -1;
     }
 
+    // Frames keep the POV size at startup, later sizes are resampled to it
+    const char* ring_env = getenv("RAYC_OBS_RING");
+    if (ring_env && *ring_env) {
+        if (obsRing_create(&obs_ring, ring_env, 8, scr.POV_COLS, scr.POV_ROWS, 3, 64) != 0) {
+            return -1;
+        }
+        obs_ring_enabled = true;
+        printf("Observation ring: %s, %dx%d\n", obs_ring.name, scr.POV_COLS, scr.POV_ROWS);
+    }
+
     
 
     
@@ -985,7 +741,7 @@ int main(void)
     {
         static double delta_time;
 
-        clock_t start = clock();
+        double start = timer_now();
 
         game_loop(delta_time);
         // glBindVertexArray(0); // no need to unbind it every time 
@@ -995,9 +751,9 @@ int main(void)
         glfwSwapBuffers(window);
         glfwPollEvents();
 
-        clock_t end = clock();
+        double end = timer_now();
 
-        delta_time = ((double) (end - start)) / CLOCKS_PER_SEC;
+        delta_time = end - start;
         //printf("Delta time: %f\n", delta_time);
     }
 
@@ -1005,6 +761,15 @@ int main(void)
     // ------------------------------------------------------------------------
     opengl_cleanup();
 
+    if (obs_ring_enabled) {
+        printf("Observation ring: %llu frames dropped\n", obs_ring_dropped);
+        obsRing_close(&obs_ring);
+    }
+
+    renderer_destroy(&renderer);
+    screen_destroy(&scr);
+    threadPool_destroy(&pool);
+
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
     glfwTerminate();
@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "game_map.h"
+
+/*
+* rayc-mapc: converts maps between the text format and the binary .rmap format.
+* Input format is detected from the file, output is binary unless -t is given.
+* Binary output includes the occupancy bitmap and the empty-space pyramid,
+* and the distance field with -d.
+*/
+
+static void printUsage(const char* exe)
+{
+    printf("Usage: %s [options] INPUT OUTPUT\n", exe);
+    printf("       %s [options] -g DIM:DENSITY OUTPUT\n", exe);
+    printf("  -g DIM:DENSITY  generate a random map instead of reading INPUT\n");
+    printf("  -seed N         seed of the generated map (default 1)\n");
+    printf("  -t              write the text format\n");
+    printf("  -d              also store the distance field in binary output\n");
+}
+
+static int writeText(const GameMap* gm, const char* map_filename)
+{
+    FILE* file = fopen(map_filename, "w");
+    if (file == NULL) {
+        printf("Failed to open file: %s\n", map_filename);
+        return -1;
+    }
+
+    fprintf(file, "%d\n", gm->dim);
+    for (int row = 0; row < gm->dim; row++) {
+        for (int col = 0; col < gm->dim; col++) {
+            fprintf(file, col + 1 < gm->dim ? "%d " : "%d", gm->map[col + row * gm->dim]);
+        }
+        fprintf(file, "\n");
+    }
+
+    fclose(file);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    const char* gen = NULL;
+    unsigned int seed = 1;
+    bool text = false;
+    bool distance = false;
+    const char* paths[2];
+    int num_paths = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-h") == 0) {
+            printUsage(argv[0]);
+            return 0;
+        } else if (strcmp(argv[i], "-t") == 0) {
+            text = true;
+        } else if (strcmp(argv[i], "-d") == 0) {
+            distance = true;
+        } else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+            gen = argv[++i];
+        } else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc) {
+            seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else if (argv[i][0] != '-' && num_paths < 2) {
+            paths[num_paths++] = argv[i];
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (num_paths != (gen ? 1 : 2)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    const char* out_path = paths[num_paths - 1];
+
+    GameMap gm;
+    if (gen) {
+        int dim;
+        float density;
+        if (sscanf(gen, "%d:%f", &dim, &density) != 2 || dim < 3) {
+            printf("Invalid map spec: %s\n", gen);
+            return 1;
+        }
+        if (gameMap_initGenerated(&gm, dim, density, seed) != 0) {
+            return 1;
+        }
+    } else if (gameMap_init(&gm, paths[0]) != 0) {
+        return 1;
+    }
+
+    if (distance && !text) {
+        ThreadPool pool;
+        if (threadPool_init(&pool, 0) != 0 || gameMap_buildDistance(&gm, &pool) != 0) {
+            gameMap_destroy(&gm);
+            return 1;
+        }
+        threadPool_destroy(&pool);
+    }
+
+    // Acceleration data stored next to the tiles, so loading doesn't rebuild it
+    GameMapFileSection extra[3] = {
+        { .kind = GAME_MAP_SECTION_OCCUPANCY, .size = gameMap_occWords(gm.dim) * sizeof(uint64_t) },
+    };
+    const void* extra_data[3] = { gm.occupancy };
+    int num_extra = 1;
+
+    // Maps within one block have no levels above the bitmap
+    size_t pyramid_words = gameMap_pyramidWords(&gm);
+    if (pyramid_words != 0) {
+        extra[num_extra] = (GameMapFileSection){ .kind = GAME_MAP_SECTION_PYRAMID, .size = pyramid_words * sizeof(uint64_t) };
+        extra_data[num_extra++] = gm.levels[1].words;
+    }
+    if (gm.distance != NULL) {
+        extra[num_extra] = (GameMapFileSection){ .kind = GAME_MAP_SECTION_DISTANCE, .size = (uint64_t)gm.dim * gm.dim * sizeof(uint8_t) };
+        extra_data[num_extra++] = gm.distance;
+    }
+
+    int err = text ? writeText(&gm, out_path)
+                   : gameMap_writeBinary(&gm, out_path, extra, extra_data, num_extra);
+
+    if (err == 0) {
+        printf("Wrote %s: %dx%d %s\n", out_path, gm.dim, gm.dim, text ? "text" : "binary");
+    }
+
+    gameMap_destroy(&gm);
+    return err == 0 ? 0 : 1;
+}
@@ -0,0 +1,480 @@
+#ifndef _OBS_RING_H_
+#define _OBS_RING_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN 1
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <time.h>
+#endif
+
+#include "vec2.h"
+#include "texture_buffer.h"
+#include "renderer.h"
+
+/*
+* Observation ring: rendered frames published into shared memory, so another local process
+* (a trainer, a recorder) reads them in place instead of capturing the window.
+* Actions go back the other way through a second ring in the same mapping.
+*
+* Both rings are single producer, single consumer. Each side only writes its own counter,
+* counters only grow, and a slot is index % num_slots. The frame ring's producer is the
+* renderer, the action ring's producer is the consumer of frames.
+*
+* Layout, native endianness, every part aligned to OBS_RING_ALIGN:
+*   ObsRingHeader
+*   num_slots frame slots of slot_size bytes at slots_offset:
+*     ObsRingFrame
+*     pixels: rows x cols x channels bytes, top row first, RGB or luma
+*     depth:  cols floats, distance in tiles along each column's ray, misses report the view range
+*   num_actions ObsRingAction at actions_offset
+*
+* The creator fills the header in before it stores magic, so readers that see
+* OBS_RING_MAGIC also see the rest of the header.
+*/
+
+#define OBS_RING_MAGIC   0x00474e4952594152ull // "RAYRING\0"
+#define OBS_RING_VERSION 1
+#define OBS_RING_ALIGN   64
+
+#ifdef _MSC_VER
+#define obsRing_loadAcquire(p)     ((uint64_t)InterlockedCompareExchange64((volatile LONG64*)(p), 0, 0))
+#define obsRing_storeRelease(p, v) InterlockedExchange64((volatile LONG64*)(p), (LONG64)(v))
+#else
+#define obsRing_loadAcquire(p)     __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define obsRing_storeRelease(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#endif
+
+// Counters sit on their own cache lines, the two sides don't invalidate each other's writes
+typedef struct {
+    uint64_t value;
+    uint8_t pad[OBS_RING_ALIGN - sizeof(uint64_t)];
+} ObsRingCounter;
+
+typedef struct {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t num_slots;
+    uint32_t num_actions;
+    uint32_t cols;
+    uint32_t rows;
+    uint32_t channels;
+    uint64_t slot_size;
+    uint64_t slots_offset;
+    uint64_t actions_offset;
+    uint64_t total_size; // 64 bytes up to here
+
+    ObsRingCounter obs_head; // Frames published, written by the renderer
+    ObsRingCounter obs_tail; // Frames released, written by the reader
+    ObsRingCounter act_head; // Actions pushed, written by the reader
+    ObsRingCounter act_tail; // Actions taken, written by the renderer
+} ObsRingHeader;
+
+typedef struct {
+    uint64_t seq;     // Index of the frame since the ring was created, actions refer to it
+    Vec2 pos;         // Camera in map space
+    Vec2 look_dir;
+    uint32_t src_cols; // Size of the POV the frame was resampled from
+    uint32_t src_rows;
+    uint8_t pad[OBS_RING_ALIGN - 32];
+} ObsRingFrame;
+
+// One step of input, like a key press held for one frame
+typedef struct {
+    uint64_t frame;  // seq of the frame it answers, for the reader's bookkeeping
+    float forward;   // Tiles, negative walks backwards
+    float strafe;    // Tiles, positive to the right
+    float turn;      // Radians added to the heading
+    uint8_t pad[12];
+} ObsRingAction;
+
+typedef struct {
+    ObsRingHeader* hdr;
+    unsigned char* base;
+    size_t size;
+    bool owner; // Created the ring, closing it removes the name
+
+    char name[256];
+
+    // Source column of each frame column, for the last POV width resampled
+    int* src_x;
+    int src_x_cols;
+
+    // Copy of the last frame drawn, see obsRing_publishFrame
+    ObsRingFrame* last;
+
+#ifdef _WIN32
+    HANDLE mapping;
+#endif
+} ObsRing;
+
+static inline uint64_t obsRing_align(uint64_t n) {
+    return (n + OBS_RING_ALIGN - 1) & ~(uint64_t)(OBS_RING_ALIGN - 1);
+}
+
+static inline uint64_t obsRing_pixelBytes(const ObsRingHeader* h) {
+    return obsRing_align((uint64_t)h->cols * h->rows * h->channels);
+}
+
+static bool obsRing_mapName(char* out, size_t size, const char* name) {
+#ifdef _WIN32
+    return snprintf(out, size, "%s", name) < (int)size;
+#else
+    // POSIX names start with exactly one slash
+    return snprintf(out, size, "%s%s", name[0] == '/' ? "" : "/", name) < (int)size;
+#endif
+}
+
+static void obsRing_unmap(ObsRing* ring) {
+    if (ring->base == NULL) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(ring->base);
+    CloseHandle(ring->mapping);
+#else
+    munmap(ring->base, ring->size);
+#endif
+    ring->base = NULL;
+    ring->hdr = NULL;
+}
+
+/*
+* Creates the shared memory name and maps it, replacing a ring a crashed process left behind.
+* cols x rows x channels is the frame size, channels 3 for RGB or 1 for luma.
+*/
+int obsRing_create(ObsRing* ring, const char* name, int num_slots, int cols, int rows, int channels, int num_actions) {
+    memset(ring, 0, sizeof(ObsRing));
+
+    if (num_slots <= 0 || num_actions <= 0 || cols <= 0 || rows <= 0 || (channels != 1 && channels != 3)) {
+        printf("Invalid observation ring size: %d slots of %dx%dx%d, %d actions\n", num_slots, cols, rows, channels, num_actions);
+        return -1;
+    }
+    if (!obsRing_mapName(ring->name, sizeof(ring->name), name)) {
+        printf("Observation ring name too long: %s\n", name);
+        return -1;
+    }
+
+    ObsRingHeader h = {
+        .version = OBS_RING_VERSION,
+        .num_slots = num_slots,
+        .num_actions = num_actions,
+        .cols = cols,
+        .rows = rows,
+        .channels = channels,
+    };
+    h.slot_size = sizeof(ObsRingFrame) + obsRing_pixelBytes(&h) + obsRing_align((uint64_t)cols * sizeof(float));
+    h.slots_offset = obsRing_align(sizeof(ObsRingHeader));
+    h.actions_offset = h.slots_offset + h.slot_size * num_slots;
+    h.total_size = obsRing_align(h.actions_offset + (uint64_t)num_actions * sizeof(ObsRingAction));
+
+    void* view = NULL;
+#ifdef _WIN32
+    ring->mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+        (DWORD)(h.total_size >> 32), (DWORD)h.total_size, ring->name);
+    // Windows removes a name with its last handle, so an existing one belongs to a live process
+    if (ring->mapping != NULL && GetLastError() == ERROR_ALREADY_EXISTS) {
+        CloseHandle(ring->mapping);
+        ring->mapping = NULL;
+    }
+    if (ring->mapping != NULL) {
+        view = MapViewOfFile(ring->mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+        if (view == NULL) {
+            CloseHandle(ring->mapping);
+        }
+    }
+#else
+    shm_unlink(ring->name);
+    int fd = shm_open(ring->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd >= 0) {
+        if (ftruncate(fd, (off_t)h.total_size) == 0) {
+            view = mmap(NULL, h.total_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (view == MAP_FAILED) {
+                view = NULL;
+            }
+        }
+        close(fd);
+        if (view == NULL) {
+            shm_unlink(ring->name);
+        }
+    }
+#endif
+    if (view == NULL) {
+        printf("Failed to create observation ring: %s\n", ring->name);
+        return -1;
+    }
+
+    ring->base = view;
+    ring->hdr = view;
+    ring->size = h.total_size;
+    ring->owner = true;
+
+    // Fresh mappings are zeroed, the counters already start at 0
+    memcpy(ring->hdr, &h, sizeof(ObsRingHeader));
+    obsRing_storeRelease(&ring->hdr->magic, OBS_RING_MAGIC);
+    return 0;
+}
+
+// Maps a ring another process created, -1 until its creator has finished setting it up
+int obsRing_open(ObsRing* ring, const char* name) {
+    memset(ring, 0, sizeof(ObsRing));
+
+    if (!obsRing_mapName(ring->name, sizeof(ring->name), name)) {
+        printf("Observation ring name too long: %s\n", name);
+        return -1;
+    }
+
+    void* view = NULL;
+    size_t size = 0;
+#ifdef _WIN32
+    ring->mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, ring->name);
+    if (ring->mapping != NULL) {
+        view = MapViewOfFile(ring->mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+        MEMORY_BASIC_INFORMATION info;
+        if (view != NULL && VirtualQuery(view, &info, sizeof(info)) != 0) {
+            size = info.RegionSize;
+        } else if (view == NULL) {
+            CloseHandle(ring->mapping);
+        }
+    }
+#else
+    int fd = shm_open(ring->name, O_RDWR, 0);
+    if (fd >= 0) {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(ObsRingHeader)) {
+            size = st.st_size;
+            view = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (view == MAP_FAILED) {
+                view = NULL;
+            }
+        }
+        close(fd);
+    }
+#endif
+    if (view == NULL) {
+        return -1;
+    }
+
+    ring->base = view;
+    ring->hdr = view;
+    ring->size = size;
+
+    const ObsRingHeader* h = ring->hdr;
+    if (obsRing_loadAcquire(&ring->hdr->magic) != OBS_RING_MAGIC) {
+        obsRing_unmap(ring);
+        return -1;
+    }
+    if (h->version != OBS_RING_VERSION || h->total_size > size) {
+        printf("Unsupported observation ring: %s, version %u, %llu bytes\n",
+            ring->name, h->version, (unsigned long long)h->total_size);
+        obsRing_unmap(ring);
+        return -1;
+    }
+    return 0;
+}
+
+// Unmaps the ring, the creator also removes its name. Readers keep their mapping until they close.
+void obsRing_close(ObsRing* ring) {
+    obsRing_unmap(ring);
+#ifndef _WIN32
+    if (ring->owner) {
+        shm_unlink(ring->name);
+    }
+#endif
+    free(ring->src_x);
+    free(ring->last);
+    ring->src_x = NULL;
+    ring->src_x_cols = 0;
+    ring->last = NULL;
+}
+
+// Short sleep for sides that poll a full or empty ring
+void obsRing_pause(void) {
+#ifdef _WIN32
+    Sleep(1);
+#else
+    struct timespec ts = { 0, 100000 };
+    nanosleep(&ts, NULL);
+#endif
+}
+
+static inline ObsRingFrame* obsRing_slot(const ObsRing* ring, uint64_t index) {
+    const ObsRingHeader* h = ring->hdr;
+    return (ObsRingFrame*)(ring->base + h->slots_offset + (index % h->num_slots) * h->slot_size);
+}
+
+// Takes the ring like obsRing_depth, though pixels always start right after the frame header
+unsigned char* obsRing_pixels(const ObsRing* ring, const ObsRingFrame* f) {
+    (void)ring;
+    return (unsigned char*)f + sizeof(ObsRingFrame);
+}
+
+float* obsRing_depth(const ObsRing* ring, const ObsRingFrame* f) {
+    return (float*)(obsRing_pixels(ring, f) + obsRing_pixelBytes(ring->hdr));
+}
+
+// Next free slot for the renderer to fill, NULL while the reader holds every slot
+ObsRingFrame* obsRing_beginWrite(ObsRing* ring) {
+    ObsRingHeader* h = ring->hdr;
+    uint64_t head = h->obs_head.value;
+    if (head - obsRing_loadAcquire(&h->obs_tail.value) >= h->num_slots) {
+        return NULL;
+    }
+    ObsRingFrame* f = obsRing_slot(ring, head);
+    f->seq = head;
+    return f;
+}
+
+// Publishes the slot beginWrite returned
+void obsRing_endWrite(ObsRing* ring) {
+    ObsRingHeader* h = ring->hdr;
+    obsRing_storeRelease(&h->obs_head.value, h->obs_head.value + 1);
+}
+
+// Oldest unread frame, NULL when there is none. It stays valid until endRead.
+const ObsRingFrame* obsRing_beginRead(ObsRing* ring) {
+    ObsRingHeader* h = ring->hdr;
+    uint64_t tail = h->obs_tail.value;
+    if (obsRing_loadAcquire(&h->obs_head.value) == tail) {
+        return NULL;
+    }
+    return obsRing_slot(ring, tail);
+}
+
+// Hands the slot beginRead returned back to the renderer
+void obsRing_endRead(ObsRing* ring) {
+    ObsRingHeader* h = ring->hdr;
+    obsRing_storeRelease(&h->obs_tail.value, h->obs_tail.value + 1);
+}
+
+// Queues an action for the renderer, false when the action ring is full
+bool obsRing_pushAction(ObsRing* ring, const ObsRingAction* a) {
+    ObsRingHeader* h = ring->hdr;
+    uint64_t head = h->act_head.value;
+    if (head - obsRing_loadAcquire(&h->act_tail.value) >= h->num_actions) {
+        return false;
+    }
+    ObsRingAction* actions = (ObsRingAction*)(ring->base + h->actions_offset);
+    actions[head % h->num_actions] = *a;
+    obsRing_storeRelease(&h->act_head.value, head + 1);
+    return true;
+}
+
+// Takes the oldest queued action, false when there is none
+bool obsRing_popAction(ObsRing* ring, ObsRingAction* a) {
+    ObsRingHeader* h = ring->hdr;
+    uint64_t tail = h->act_tail.value;
+    if (obsRing_loadAcquire(&h->act_head.value) == tail) {
+        return false;
+    }
+    const ObsRingAction* actions = (const ObsRingAction*)(ring->base + h->actions_offset);
+    *a = actions[tail % h->num_actions];
+    obsRing_storeRelease(&h->act_tail.value, tail + 1);
+    return true;
+}
+
+/*
+* Fills a slot from the renderer's last frame: its POV and per-column hits.
+* The POV is nearest-resampled to the ring's size, so the window can resize
+* or change render scale without the reader noticing. Any layout and pixel format.
+*/
+void obsRing_writePov(ObsRing* ring, ObsRingFrame* f, const Renderer* r, Vec2 player, Vec2 look_dir) {
+    const ObsRingHeader* h = ring->hdr;
+    const TextureBuffer* pov = r->pov;
+    int cols = h->cols;
+    int rows = h->rows;
+    int src_cols = r->scr->POV_COLS;
+    int src_rows = r->scr->POV_ROWS;
+
+    if (ring->src_x_cols != src_cols) {
+        if (ring->src_x == NULL) {
+            ring->src_x = malloc(cols * sizeof(int));
+            if (ring->src_x == NULL) {
+                perror("Fatal error: malloc failed");
+                exit(1);
+            }
+        }
+        for (int x = 0; x < cols; ++x) {
+            ring->src_x[x] = (int)((int64_t)x * src_cols / cols);
+        }
+        ring->src_x_cols = src_cols;
+    }
+    const int* src_x = ring->src_x;
+
+    f->pos = player;
+    f->look_dir = look_dir;
+    f->src_cols = src_cols;
+    f->src_rows = src_rows;
+
+    unsigned char* out = obsRing_pixels(ring, f);
+    for (int y = 0; y < rows; ++y) {
+        // Tensor rows run top down, POV row 0 is the bottom
+        int sy = src_rows - 1 - (int)((int64_t)y * src_rows / rows);
+
+        if (h->channels == 3) {
+            for (int x = 0; x < cols; ++x, out += 3) {
+                Pixel p = pov->data[textureBuffer_index(pov, src_x[x], sy)];
+                out[0] = p.r;
+                out[1] = p.g;
+                out[2] = p.b;
+            }
+        } else {
+            for (int x = 0; x < cols; ++x) {
+                *out++ = pixel_luma(pov->data[textureBuffer_index(pov, src_x[x], sy)]);
+            }
+        }
+    }
+
+    // Ray parameters are in top view pixels along top view directions
+    Vec2 tv_to_map = renderer_topViewToMapScale(r);
+    float* depth = obsRing_depth(ring, f);
+    for (int x = 0; x < cols; ++x) {
+        int c = src_x[x];
+        Vec2 d = vec2_mul(r->column_dirs[c], tv_to_map);
+        depth[x] = r->column_hits[c].dist * vec2_magnitude(d);
+    }
+}
+
+/*
+* Publishes the renderer's current frame for a producer that shares the POV with GL uploads.
+* A frame the frame cache skipped drew nothing, and with the PBO upload ring the POV buffer
+* may already point at the next upload slot. So every drawn frame is resampled into a copy
+* on this side, and skipped frames send that copy again. Call it after every renderer_drawFrame,
+* from the first one on. False when the reader holds every slot.
+*/
+bool obsRing_publishFrame(ObsRing* ring, const Renderer* r, Vec2 player, Vec2 look_dir) {
+    if (ring->last == NULL) {
+        ring->last = malloc(ring->hdr->slot_size);
+        if (ring->last == NULL) {
+            perror("Fatal error: malloc failed");
+            exit(1);
+        }
+        obsRing_writePov(ring, ring->last, r, player, look_dir);
+    } else if (!r->stats.unchanged) {
+        obsRing_writePov(ring, ring->last, r, player, look_dir);
+    }
+
+    ObsRingFrame* f = obsRing_beginWrite(ring);
+    if (f == NULL) {
+        return false;
+    }
+    uint64_t seq = f->seq;
+    memcpy(f, ring->last, ring->hdr->slot_size);
+    f->seq = seq;
+    obsRing_endWrite(ring);
+    return true;
+}
+
+#endif // _OBS_RING_H_
@@ -0,0 +1,121 @@
+#ifndef _RANGE_SCAN_H_
+#define _RANGE_SCAN_H_
+
+#include <stdbool.h>
+#include <math.h>
+
+#include "game_map.h"
+#include "raycast.h"
+#include "raycast_packet.h"
+#include "thread_pool.h"
+
+/*
+* Range scans: the distance to the nearest wall along a set of directions,
+* from many origins at once, like a LiDAR sweep. The directions are shared by
+* every origin and given as unit vectors, so ray parameters are distances in tiles.
+*
+* Rays are cast with any RaycastMode. Packet modes cast each origin's rays
+* in packets like the columns of a frame, neighbouring directions are coherent.
+* Every mode but march gives the distances raycast_dda gives:
+* max_range for a miss, 0 from inside a wall.
+* Nothing is allocated, callers own every buffer.
+*/
+
+// Rays cast per rayPacket_cast call
+#define RANGE_SCAN_CHUNK 64
+
+// n unit directions evenly around the circle, counter-clockwise from start (radians)
+void rangeScan_circle(int n, float start, float* dir_x, float* dir_y) {
+    for (int i = 0; i < n; ++i) {
+        float a = start + 6.2831853f * i / n;
+        dir_x[i] = cosf(a);
+        dir_y[i] = sinf(a);
+    }
+}
+
+// Unit directions for any set of angles (radians)
+void rangeScan_directions(const float* angles, int n, float* dir_x, float* dir_y) {
+    for (int i = 0; i < n; ++i) {
+        dir_x[i] = cosf(angles[i]);
+        dir_y[i] = sinf(angles[i]);
+    }
+}
+
+typedef struct {
+    const GameMap* gm;
+    RaycastMode mode;
+    RayPacketIsa isa;
+    const float* origin_x;
+    const float* origin_y;
+    const float* dir_x;
+    const float* dir_y;
+    int num_dirs;
+    float max_range;
+    float* dist;
+} RangeScanJob;
+
+static void rangeScan_run(void* ctx, int begin, int end, int worker) {
+    const RangeScanJob* job = ctx;
+    (void)worker;
+
+    float ox[RANGE_SCAN_CHUNK], oy[RANGE_SCAN_CHUNK];
+    RayHit hits[RANGE_SCAN_CHUNK];
+
+    bool packets = job->mode == RAYCAST_MODE_PACKET || job->mode == RAYCAST_MODE_ADAPTIVE;
+
+    for (int o = begin; o < end; ++o) {
+        float* dist = job->dist + (size_t)o * job->num_dirs;
+
+        if (!packets) {
+            Vec2 origin = { job->origin_x[o], job->origin_y[o] };
+            for (int d = 0; d < job->num_dirs; ++d) {
+                Vec2 dir = { job->dir_x[d], job->dir_y[d] };
+                dist[d] = raycast(job->gm, job->mode, origin, dir, job->max_range).dist;
+            }
+            continue;
+        }
+
+        for (int k = 0; k < RANGE_SCAN_CHUNK; ++k) {
+            ox[k] = job->origin_x[o];
+            oy[k] = job->origin_y[o];
+        }
+
+        for (int d = 0; d < job->num_dirs; d += RANGE_SCAN_CHUNK) {
+            int n = job->num_dirs - d < RANGE_SCAN_CHUNK ? job->num_dirs - d : RANGE_SCAN_CHUNK;
+
+            rayPacket_cast(job->gm, job->isa, n, ox, oy, job->dir_x + d, job->dir_y + d, job->max_range, hits);
+
+            for (int k = 0; k < n; ++k) {
+                dist[d + k] = hits[k].dist;
+            }
+        }
+    }
+}
+
+/*
+* Scans num_dirs directions from each of num_origins origins.
+* dist is num_origins x num_dirs, one origin's distances after the other.
+* Origins are split across the pool's threads (NULL runs on the caller's).
+* isa is the packet width of the packet modes, adaptive casts plain packets.
+*/
+void rangeScan_scan(const GameMap* gm, ThreadPool* pool, RaycastMode mode, RayPacketIsa isa,
+                    const float* origin_x, const float* origin_y, int num_origins,
+                    const float* dir_x, const float* dir_y, int num_dirs,
+                    float max_range, float* dist)
+{
+    RangeScanJob job = {
+        .gm = gm,
+        .mode = mode,
+        .isa = isa,
+        .origin_x = origin_x,
+        .origin_y = origin_y,
+        .dir_x = dir_x,
+        .dir_y = dir_y,
+        .num_dirs = num_dirs,
+        .max_range = max_range,
+        .dist = dist,
+    };
+    threadPool_parallelFor(pool, num_origins, 0, rangeScan_run, &job);
+}
+
+#endif // _RANGE_SCAN_H_
@@ -0,0 +1,526 @@
+#ifndef _RAYCAST_H_
+#define _RAYCAST_H_
+
+#include <stdbool.h>
+#include <math.h>
+
+#include "vec2.h"
+#include "game_map.h"
+
+/*
+* Ray casting against GameMap.
+* Positions are in map space (one unit per tile).
+* Distances are ray parameters, i.e. multiples of |dir|,
+* so passing a unit direction gives euclidean distance.
+*/
+
+// Sample spacing of the reference marcher, in ray parameter units
+#define RAYCAST_MARCH_STEP 0.1f
+
+typedef enum {
+    RAYCAST_MODE_DDA,    // Grid-exact traversal, cost is O(cells crossed)
+    RAYCAST_MODE_MARCH,  // Fixed-step reference marcher
+    RAYCAST_MODE_PACKET, // DDA on SIMD packets of rays, see raycast_packet.h
+    RAYCAST_MODE_PYRAMID, // DDA that jumps over empty blocks of the map's pyramid
+    RAYCAST_MODE_DISTANCE, // DDA that jumps by the clearance in the map's distance field
+    RAYCAST_MODE_ADAPTIVE, // Packet DDA on some columns, the rest resolved on shared faces, see renderer.h
+    RAYCAST_MODE_COUNT
+} RaycastMode;
+
+// Side of the hit cell the ray entered through
+typedef enum {
+    RAY_FACE_NONE, // Ray started inside a wall
+    RAY_FACE_X_MIN,
+    RAY_FACE_X_MAX,
+    RAY_FACE_Y_MIN,
+    RAY_FACE_Y_MAX,
+} RayFace;
+
+typedef struct {
+    bool hit;
+
+    int cell_x;
+    int cell_y;
+    int tile;
+
+    RayFace face;
+
+    float dist;  // Ray parameter of the hit point, max_dist on miss
+    float tex_u; // Position along the hit face in [0, 1)
+
+    int steps;   // Cells or blocks visited (DDA, pyramid, distance) or samples taken (march)
+} RayHit;
+
+const char* raycast_modeName(RaycastMode mode) {
+    switch (mode) {
+    case RAYCAST_MODE_DDA:    return "dda";
+    case RAYCAST_MODE_MARCH:  return "march";
+    case RAYCAST_MODE_PACKET: return "packet";
+    case RAYCAST_MODE_PYRAMID: return "pyramid";
+    case RAYCAST_MODE_DISTANCE: return "distance";
+    case RAYCAST_MODE_ADAPTIVE: return "adaptive";
+    default:                  return "unknown";
+    }
+}
+
+static inline bool gameMap_inBounds(const GameMap* gm, int x, int y) {
+    return x >= 0 && y >= 0 && x < gm->dim && y < gm->dim;
+}
+
+static inline int gameMap_tile(const GameMap* gm, int x, int y) {
+    return gm->map[x + gm->dim * y];
+}
+
+static inline float raycast_fract(float v, int cell) {
+    float u = v - (float)cell;
+    // Hit point may round into the neighbouring cell
+    if (u < 0.f) {
+        u = 0.f;
+    }
+    if (u >= 1.f) {
+        u = nextafterf(1.f, 0.f);
+    }
+    return u;
+}
+
+/*
+* Closed-form hit on the entry face of cell (cx, cy).
+* Kept separate from the traversal so that everything computing
+* a hit from a known cell and face gets bit-identical results.
+*/
+void raycast_resolveHit(RayHit* h, Vec2 origin, Vec2 dir, int cx, int cy, RayFace face) {
+    h->hit = true;
+    h->cell_x = cx;
+    h->cell_y = cy;
+    h->face = face;
+
+    switch (face) {
+    case RAY_FACE_X_MIN:
+    case RAY_FACE_X_MAX: {
+        float bx = (float)(face == RAY_FACE_X_MIN ? cx : cx + 1);
+        h->dist = (bx - origin.x) / dir.x;
+        h->tex_u = raycast_fract(origin.y + h->dist * dir.y, cy);
+    } break;
+    case RAY_FACE_Y_MIN:
+    case RAY_FACE_Y_MAX: {
+        float by = (float)(face == RAY_FACE_Y_MIN ? cy : cy + 1);
+        h->dist = (by - origin.y) / dir.y;
+        h->tex_u = raycast_fract(origin.x + h->dist * dir.x, cx);
+    } break;
+    default:
+        h->dist = 0.f;
+        h->tex_u = 0.f;
+        break;
+    }
+}
+
+/*
+* Ray parameter where the ray leaves cell c across the next boundary on one axis.
+* Walks compute it from the cell at every step instead of adding up deltas, so
+* rounding never builds up and every walk, raycast_leaveBox included, sees the
+* same values at a corner and takes the same side through it.
+*/
+static inline float raycast_sideDist(float origin, float dir, int c, float delta) {
+    return (dir < 0.f ? origin - c : c + 1 - origin) * delta;
+}
+
+/*
+* Amanatides-Woo grid traversal: visits every cell the ray crosses
+* exactly once, in order, and stops at the first non-empty tile.
+*/
+RayHit raycast_dda(const GameMap* gm, Vec2 origin, Vec2 dir, float max_dist) {
+    RayHit h = { .hit = false, .face = RAY_FACE_NONE, .dist = max_dist };
+
+    int cx = (int)floorf(origin.x);
+    int cy = (int)floorf(origin.y);
+
+    if (!gameMap_inBounds(gm, cx, cy)) {
+        return h;
+    }
+
+    h.steps = 1;
+    if (gameMap_isSolid(gm, cx, cy)) {
+        raycast_resolveHit(&h, origin, dir, cx, cy, RAY_FACE_NONE);
+        h.tile = gameMap_tile(gm, cx, cy);
+        return h;
+    }
+
+    // Division by zero gives inf, so an axis-aligned ray never steps on the other axis
+    float delta_x = fabsf(1.f / dir.x);
+    float delta_y = fabsf(1.f / dir.y);
+
+    int step_x = dir.x < 0.f ? -1 : 1;
+    int step_y = dir.y < 0.f ? -1 : 1;
+
+    float side_x = raycast_sideDist(origin.x, dir.x, cx, delta_x);
+    float side_y = raycast_sideDist(origin.y, dir.y, cy, delta_y);
+
+    for (;;) {
+        RayFace face;
+        float t;
+
+        if (side_x < side_y) {
+            t = side_x;
+            cx += step_x;
+            side_x = raycast_sideDist(origin.x, dir.x, cx, delta_x);
+            face = step_x > 0 ? RAY_FACE_X_MIN : RAY_FACE_X_MAX;
+        } else {
+            t = side_y;
+            cy += step_y;
+            side_y = raycast_sideDist(origin.y, dir.y, cy, delta_y);
+            face = step_y > 0 ? RAY_FACE_Y_MIN : RAY_FACE_Y_MAX;
+        }
+
+        if (t > max_dist || !gameMap_inBounds(gm, cx, cy)) {
+            return h;
+        }
+
+        ++h.steps;
+
+        // Only the bitmap is touched while crossing empty cells
+        if (gameMap_isSolid(gm, cx, cy)) {
+            raycast_resolveHit(&h, origin, dir, cx, cy, face);
+            h.tile = gameMap_tile(gm, cx, cy);
+            return h;
+        }
+    }
+}
+
+/*
+* Moves (cx, cy) from inside the empty box [bx, bx + w) x [by, by + h)
+* to the first cell the ray reaches past it. Returns the ray parameter there.
+* The box must not extend below 0.
+*/
+static inline float raycast_leaveBox(Vec2 origin, Vec2 dir, float inv_x, float inv_y,
+    int bx, int by, int w, int h, int* cx, int* cy, RayFace* face)
+{
+    // Ray parameters where it leaves the box on each axis
+    float tx = ((dir.x > 0.f ? bx + w : bx) - origin.x) * inv_x;
+    float ty = ((dir.y > 0.f ? by + h : by) - origin.y) * inv_y;
+    if (dir.x == 0.f) {
+        tx = INFINITY;
+    }
+    if (dir.y == 0.f) {
+        ty = INFINITY;
+    }
+
+    // Same tie break as the DDA step. Written as selects, which side the ray
+    // leaves through is as hard to predict as the direction of a DDA step.
+    bool exit_x = tx < ty;
+    float t = exit_x ? tx : ty;
+
+    // Estimate of the cell the ray leaves from, clamped into the box, which is
+    // never below 0, so truncation is as good as floor
+    float ex = origin.x + t * dir.x;
+    float ey = origin.y + t * dir.y;
+    int px = dir.x > 0.f ? (int)ceilf(ex) - 1 : (int)ex;
+    int py = dir.y < 0.f ? (int)ceilf(ey) - 1 : (int)ey;
+    px = px < bx ? bx : (px >= bx + w ? bx + w - 1 : px);
+    py = py < by ? by : (py >= by + h ? by + h - 1 : py);
+
+    // Settled with the DDA's own comparisons, the rounded exit point can be a cell off
+    // next to a corner. Along the side it leaves through, the DDA stops at the first
+    // cell whose side distance on the other axis reaches t, steps y on ties.
+    int sx = dir.x < 0.f ? -1 : 1;
+    int sy = dir.y < 0.f ? -1 : 1;
+    float dx = fabsf(inv_x);
+    float dy = fabsf(inv_y);
+    if (exit_x) {
+        while (py - sy >= by && py - sy < by + h && raycast_sideDist(origin.y, dir.y, py - sy, dy) > t) {
+            py -= sy;
+        }
+        while (py + sy >= by && py + sy < by + h && raycast_sideDist(origin.y, dir.y, py, dy) <= t) {
+            py += sy;
+        }
+    } else {
+        while (px - sx >= bx && px - sx < bx + w && raycast_sideDist(origin.x, dir.x, px - sx, dx) >= t) {
+            px -= sx;
+        }
+        while (px + sx >= bx && px + sx < bx + w && raycast_sideDist(origin.x, dir.x, px, dx) < t) {
+            px += sx;
+        }
+    }
+
+    int nx = dir.x < 0.f ? bx - 1 : bx + w;
+    int ny = dir.y < 0.f ? by - 1 : by + h;
+
+    *cx = exit_x ? nx : px;
+    *cy = exit_x ? py : ny;
+    *face = exit_x ? (dir.x < 0.f ? RAY_FACE_X_MAX : RAY_FACE_X_MIN)
+                   : (dir.y < 0.f ? RAY_FACE_Y_MAX : RAY_FACE_Y_MIN);
+    return t;
+}
+
+/*
+* raycast_dda with empty-space skipping: while the aligned block of 8^k cells
+* around the current cell is empty at some level k of the map's pyramid,
+* the ray leaves the whole block in one step, and only walks cell by cell
+* next to geometry.
+* Hits are resolved from the hit cell and face like the DDA, so distances
+* agree with it whenever both reach the same cell. Cell corners are crossed
+* with the DDA's tie break, so both visit the same diagonal neighbour.
+*/
+RayHit raycast_pyramid(const GameMap* gm, Vec2 origin, Vec2 dir, float max_dist) {
+    // A map within a single 8x8 block has nothing to skip
+    if (gm->num_levels <= 1) {
+        return raycast_dda(gm, origin, dir, max_dist);
+    }
+
+    RayHit h = { .hit = false, .face = RAY_FACE_NONE, .dist = max_dist };
+
+    int cx = (int)floorf(origin.x);
+    int cy = (int)floorf(origin.y);
+
+    if (!gameMap_inBounds(gm, cx, cy)) {
+        return h;
+    }
+
+    h.steps = 1;
+    if (gameMap_isSolid(gm, cx, cy)) {
+        raycast_resolveHit(&h, origin, dir, cx, cy, RAY_FACE_NONE);
+        h.tile = gameMap_tile(gm, cx, cy);
+        return h;
+    }
+
+    float inv_x = 1.f / dir.x;
+    float inv_y = 1.f / dir.y;
+
+    float delta_x = fabsf(inv_x);
+    float delta_y = fabsf(inv_y);
+
+    int step_x = dir.x < 0.f ? -1 : 1;
+    int step_y = dir.y < 0.f ? -1 : 1;
+
+    float side_x = raycast_sideDist(origin.x, dir.x, cx, delta_x);
+    float side_y = raycast_sideDist(origin.y, dir.y, cy, delta_y);
+
+    for (;;) {
+        RayFace face;
+        float t;
+
+        // Biggest empty block around the current cell
+        int level = 0;
+        while (level < gm->num_levels && gameMap_blockEmpty(gm, level + 1, cx, cy)) {
+            ++level;
+        }
+
+        if (level == 0) {
+            // Plain DDA until the ray leaves this block of cells, the pyramid can't help inside it
+            int bx = cx / GAME_MAP_OCC_BLOCK;
+            int by = cy / GAME_MAP_OCC_BLOCK;
+
+            for (;;) {
+                if (side_x < side_y) {
+                    t = side_x;
+                    cx += step_x;
+                    side_x = raycast_sideDist(origin.x, dir.x, cx, delta_x);
+                    face = step_x > 0 ? RAY_FACE_X_MIN : RAY_FACE_X_MAX;
+                } else {
+                    t = side_y;
+                    cy += step_y;
+                    side_y = raycast_sideDist(origin.y, dir.y, cy, delta_y);
+                    face = step_y > 0 ? RAY_FACE_Y_MIN : RAY_FACE_Y_MAX;
+                }
+
+                if (t > max_dist || !gameMap_inBounds(gm, cx, cy)) {
+                    return h;
+                }
+
+                ++h.steps;
+
+                if (gameMap_isSolid(gm, cx, cy)) {
+                    raycast_resolveHit(&h, origin, dir, cx, cy, face);
+                    h.tile = gameMap_tile(gm, cx, cy);
+                    return h;
+                }
+
+                if (cx / GAME_MAP_OCC_BLOCK != bx || cy / GAME_MAP_OCC_BLOCK != by) {
+                    break;
+                }
+            }
+            continue;
+        }
+
+        int size = 1 << (3 * level);
+        t = raycast_leaveBox(origin, dir, inv_x, inv_y, cx & ~(size - 1), cy & ~(size - 1), size, size, &cx, &cy, &face);
+
+        if (t > max_dist || !gameMap_inBounds(gm, cx, cy)) {
+            return h;
+        }
+
+        ++h.steps;
+
+        if (gameMap_isSolid(gm, cx, cy)) {
+            raycast_resolveHit(&h, origin, dir, cx, cy, face);
+            h.tile = gameMap_tile(gm, cx, cy);
+            return h;
+        }
+
+        // Continue the DDA from the new cell
+        side_x = raycast_sideDist(origin.x, dir.x, cx, delta_x);
+        side_y = raycast_sideDist(origin.y, dir.y, cy, delta_y);
+    }
+}
+
+/*
+* Sphere tracing on the map's distance field: every cell closer than the clearance d
+* of the current cell is empty, so the ray leaves that square of (2d - 1)^2 cells in
+* one step. Next to walls, where d is 1, it walks the bitmap like raycast_pyramid.
+* Hits are resolved like the DDA. Maps without a distance field use raycast_dda.
+*/
+RayHit raycast_distance(const GameMap* gm, Vec2 origin, Vec2 dir, float max_dist) {
+    if (gm->distance == NULL) {
+        return raycast_dda(gm, origin, dir, max_dist);
+    }
+
+    RayHit h = { .hit = false, .face = RAY_FACE_NONE, .dist = max_dist };
+
+    int dim = gm->dim;
+    int cx = (int)floorf(origin.x);
+    int cy = (int)floorf(origin.y);
+
+    if (!gameMap_inBounds(gm, cx, cy)) {
+        return h;
+    }
+
+    h.steps = 1;
+    if (gameMap_isSolid(gm, cx, cy)) {
+        raycast_resolveHit(&h, origin, dir, cx, cy, RAY_FACE_NONE);
+        h.tile = gameMap_tile(gm, cx, cy);
+        return h;
+    }
+
+    float inv_x = 1.f / dir.x;
+    float inv_y = 1.f / dir.y;
+
+    float delta_x = fabsf(inv_x);
+    float delta_y = fabsf(inv_y);
+
+    int step_x = dir.x < 0.f ? -1 : 1;
+    int step_y = dir.y < 0.f ? -1 : 1;
+
+    float side_x = raycast_sideDist(origin.x, dir.x, cx, delta_x);
+    float side_y = raycast_sideDist(origin.y, dir.y, cy, delta_y);
+
+    for (;;) {
+        RayFace face;
+        float t;
+
+        int r = gm->distance[(size_t)cy * dim + cx] - 1;
+
+        if (r == 0) {
+            // Next to a wall: plain DDA on the bitmap, which stays in cache, until the ray leaves this block
+            unsigned bx = (unsigned)cx / GAME_MAP_OCC_BLOCK;
+            unsigned by = (unsigned)cy / GAME_MAP_OCC_BLOCK;
+
+            for (;;) {
+                if (side_x < side_y) {
+                    t = side_x;
+                    cx += step_x;
+                    side_x = raycast_sideDist(origin.x, dir.x, cx, delta_x);
+                    face = step_x > 0 ? RAY_FACE_X_MIN : RAY_FACE_X_MAX;
+                } else {
+                    t = side_y;
+                    cy += step_y;
+                    side_y = raycast_sideDist(origin.y, dir.y, cy, delta_y);
+                    face = step_y > 0 ? RAY_FACE_Y_MIN : RAY_FACE_Y_MAX;
+                }
+
+                if (t > max_dist || !gameMap_inBounds(gm, cx, cy)) {
+                    return h;
+                }
+
+                ++h.steps;
+
+                if (gameMap_isSolid(gm, cx, cy)) {
+                    raycast_resolveHit(&h, origin, dir, cx, cy, face);
+                    h.tile = gameMap_tile(gm, cx, cy);
+                    return h;
+                }
+
+                if ((unsigned)cx / GAME_MAP_OCC_BLOCK != bx || (unsigned)cy / GAME_MAP_OCC_BLOCK != by) {
+                    break;
+                }
+            }
+            continue;
+        }
+
+        // Square of empty cells around the current one, clipped to the map
+        int x0 = cx - r < 0 ? 0 : cx - r;
+        int y0 = cy - r < 0 ? 0 : cy - r;
+        int x1 = cx + r >= dim ? dim - 1 : cx + r;
+        int y1 = cy + r >= dim ? dim - 1 : cy + r;
+
+        t = raycast_leaveBox(origin, dir, inv_x, inv_y, x0, y0, x1 - x0 + 1, y1 - y0 + 1, &cx, &cy, &face);
+
+        if (t > max_dist || !gameMap_inBounds(gm, cx, cy)) {
+            return h;
+        }
+
+        ++h.steps;
+
+        // Same cell the next iteration reads, so the field is the cheaper test here
+        if (gm->distance[(size_t)cy * dim + cx] == 0) {
+            raycast_resolveHit(&h, origin, dir, cx, cy, face);
+            h.tile = gameMap_tile(gm, cx, cy);
+            return h;
+        }
+
+        // Continue the DDA from the new cell
+        side_x = raycast_sideDist(origin.x, dir.x, cx, delta_x);
+        side_y = raycast_sideDist(origin.y, dir.y, cy, delta_y);
+    }
+}
+
+/*
+* Samples the ray every RAYCAST_MARCH_STEP.
+* Kept as a reference for the DDA: it can tunnel through tile corners
+* and its distance is only accurate to one step.
+*/
+RayHit raycast_march(const GameMap* gm, Vec2 origin, Vec2 dir, float max_dist) {
+    RayHit h = { .hit = false, .face = RAY_FACE_NONE, .dist = max_dist };
+
+    int num_steps = max_dist / RAYCAST_MARCH_STEP;
+
+    for (int j = 0; j < num_steps; ++j) {
+        float t = j * RAYCAST_MARCH_STEP;
+        Vec2 rayp = vec2_add(origin, vec2_mulf(dir, t));
+
+        int cx = (int)floorf(rayp.x);
+        int cy = (int)floorf(rayp.y);
+
+        // Don't go out of map bounds
+        if (!gameMap_inBounds(gm, cx, cy)) {
+            break;
+        }
+
+        ++h.steps;
+
+        if (gameMap_isSolid(gm, cx, cy)) {
+            h.hit = true;
+            h.cell_x = cx;
+            h.cell_y = cy;
+            h.tile = gameMap_tile(gm, cx, cy);
+            h.dist = t;
+            h.tex_u = raycast_fract(fabsf(dir.x) > fabsf(dir.y) ? rayp.y : rayp.x,
+                                    fabsf(dir.x) > fabsf(dir.y) ? cy : cx);
+            break;
+        }
+    }
+
+    return h;
+}
+
+RayHit raycast(const GameMap* gm, RaycastMode mode, Vec2 origin, Vec2 dir, float max_dist) {
+    switch (mode) {
+    case RAYCAST_MODE_MARCH: return raycast_march(gm, origin, dir, max_dist);
+    case RAYCAST_MODE_PYRAMID: return raycast_pyramid(gm, origin, dir, max_dist);
+    case RAYCAST_MODE_DISTANCE: return raycast_distance(gm, origin, dir, max_dist);
+    case RAYCAST_MODE_DDA:
+    case RAYCAST_MODE_PACKET: // A packet of one is the plain DDA
+    case RAYCAST_MODE_ADAPTIVE: // So is one column
+    default:                 return raycast_dda(gm, origin, dir, max_dist);
+    }
+}
+
+#endif // _RAYCAST_H_
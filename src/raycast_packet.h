@@ -0,0 +1,477 @@
+#ifndef _RAYCAST_PACKET_H_
+#define _RAYCAST_PACKET_H_
+
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "game_map.h"
+#include "raycast.h"
+#include "cpu.h"
+
+/*
+* Packet traversal: runs raycast_dda on 4 (SSE2) or 8 (AVX2) rays at once.
+* Every lane performs the same float operations in the same order as
+* the scalar DDA, and hits are resolved with raycast_resolveHit,
+* so results are bit-identical to casting the rays one by one.
+*/
+
+#define RAY_PACKET_MAX_WIDTH 8
+
+typedef enum {
+    RAY_PACKET_SCALAR,
+    RAY_PACKET_SSE2,
+    RAY_PACKET_AVX2,
+} RayPacketIsa;
+
+const char* rayPacket_isaName(RayPacketIsa isa) {
+    switch (isa) {
+    case RAY_PACKET_SSE2: return "sse2";
+    case RAY_PACKET_AVX2: return "avx2";
+    default:              return "scalar";
+    }
+}
+
+int rayPacket_width(RayPacketIsa isa) {
+    switch (isa) {
+    case RAY_PACKET_SSE2: return 4;
+    case RAY_PACKET_AVX2: return 8;
+    default:              return 1;
+    }
+}
+
+// Best instruction set the CPU supports, the enums line up
+RayPacketIsa rayPacket_detectIsa(void) {
+    return (RayPacketIsa)cpu_detectSimd();
+}
+
+// Parses "scalar", "sse2" or "avx2" and clamps it to what the CPU supports
+RayPacketIsa rayPacket_parseIsa(const char* name, RayPacketIsa supported) {
+    RayPacketIsa isa = supported;
+    if (strcmp(name, "scalar") == 0) {
+        isa = RAY_PACKET_SCALAR;
+    } else if (strcmp(name, "sse2") == 0) {
+        isa = RAY_PACKET_SSE2;
+    } else if (strcmp(name, "avx2") == 0) {
+        isa = RAY_PACKET_AVX2;
+    }
+    return isa < supported ? isa : supported;
+}
+
+void rayPacket_castScalar(const GameMap* gm, int n,
+                          const float* ox, const float* oy, const float* dx, const float* dy,
+                          float max_dist, RayHit* out)
+{
+    for (int i = 0; i < n; ++i) {
+        out[i] = raycast_dda(gm, (Vec2){ ox[i], oy[i] }, (Vec2){ dx[i], dy[i] }, max_dist);
+    }
+}
+
+// Lane results that don't need the closed-form distance
+static inline void rayPacket_initLane(RayHit* h, float max_dist) {
+    memset(h, 0, sizeof(RayHit));
+    h->face = RAY_FACE_NONE;
+    h->dist = max_dist;
+}
+
+static inline void rayPacket_finishHit(const GameMap* gm, RayHit* h,
+                                       float ox, float oy, float dx, float dy,
+                                       int cx, int cy, RayFace face)
+{
+    raycast_resolveHit(h, (Vec2){ ox, oy }, (Vec2){ dx, dy }, cx, cy, face);
+    h->tile = gameMap_tile(gm, cx, cy);
+}
+
+#ifdef CPU_X86
+
+// floorf for |x| < 2^31: truncation rounds negative values up, so step those down
+CPU_TARGET_SSE2
+static inline __m128i rayPacket_floorSse2(__m128 x) {
+    __m128i t = _mm_cvttps_epi32(x);
+    __m128 too_big = _mm_cmpgt_ps(_mm_cvtepi32_ps(t), x);
+    return _mm_add_epi32(t, _mm_castps_si128(too_big));
+}
+
+CPU_TARGET_SSE2
+static inline __m128i rayPacket_inBoundsSse2(__m128i x, __m128i y, __m128i dim) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i in_x = _mm_andnot_si128(_mm_cmpgt_epi32(zero, x), _mm_cmpgt_epi32(dim, x));
+    __m128i in_y = _mm_andnot_si128(_mm_cmpgt_epi32(zero, y), _mm_cmpgt_epi32(dim, y));
+    return _mm_and_si128(in_x, in_y);
+}
+
+CPU_TARGET_SSE2
+static inline __m128 rayPacket_selectSse2(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+CPU_TARGET_SSE2
+static inline __m128i rayPacket_selectiSse2(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// raycast_sideDist of four lanes, neg is the mask of lanes with dir < 0
+CPU_TARGET_SSE2
+static inline __m128 rayPacket_sideDistSse2(__m128 o, __m128 neg, __m128i c, __m128 delta) {
+    __m128 cf = _mm_cvtepi32_ps(c);
+    __m128 c1f = _mm_cvtepi32_ps(_mm_add_epi32(c, _mm_set1_epi32(1)));
+    return _mm_mul_ps(rayPacket_selectSse2(neg, _mm_sub_ps(o, cf), _mm_sub_ps(c1f, o)), delta);
+}
+
+CPU_TARGET_SSE2
+static inline __m128i rayPacket_laneMaskSse2(int active) {
+    __m128i bits = _mm_setr_epi32(1, 2, 4, 8);
+    return _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(active), bits), bits);
+}
+
+/*
+* Occupancy bit of one lane, 1 for walls.
+* Inactive lanes read cell (0, 0) so there is no branch per lane, the caller masks them.
+*/
+static inline int rayPacket_occLane(const GameMap* gm, int x, int y, int lane_active) {
+    x &= -lane_active;
+    y &= -lane_active;
+    return (int)((gm->occupancy[gameMap_occWord(gm, x, y)] >> gameMap_occBit(x, y)) & 1);
+}
+
+// SSE2 has no gather, load lane by lane. Non-zero lanes are walls.
+CPU_TARGET_SSE2
+static inline __m128i rayPacket_gatherSse2(const GameMap* gm, __m128i cx, __m128i cy, int active) {
+    int x[4], y[4];
+    _mm_storeu_si128((__m128i*)x, cx);
+    _mm_storeu_si128((__m128i*)y, cy);
+    __m128i t = _mm_setr_epi32(
+        rayPacket_occLane(gm, x[0], y[0], active & 1),
+        rayPacket_occLane(gm, x[1], y[1], (active >> 1) & 1),
+        rayPacket_occLane(gm, x[2], y[2], (active >> 2) & 1),
+        rayPacket_occLane(gm, x[3], y[3], (active >> 3) & 1));
+    return _mm_and_si128(t, rayPacket_laneMaskSse2(active));
+}
+
+// Up to 4 rays, lanes past n are masked off
+CPU_TARGET_SSE2
+void rayPacket_castSse2(const GameMap* gm, int n,
+                        const float* ox, const float* oy, const float* dx, const float* dy,
+                        float max_dist, RayHit* out)
+{
+    float lox[4] = { 0 }, loy[4] = { 0 }, ldx[4] = { 0 }, ldy[4] = { 0 };
+    memcpy(lox, ox, n * sizeof(float));
+    memcpy(loy, oy, n * sizeof(float));
+    memcpy(ldx, dx, n * sizeof(float));
+    memcpy(ldy, dy, n * sizeof(float));
+
+    __m128 vox = _mm_loadu_ps(lox);
+    __m128 voy = _mm_loadu_ps(loy);
+    __m128 vdx = _mm_loadu_ps(ldx);
+    __m128 vdy = _mm_loadu_ps(ldy);
+
+    __m128i dim = _mm_set1_epi32(gm->dim);
+    __m128 vmax = _mm_set1_ps(max_dist);
+    __m128 zero = _mm_setzero_ps();
+    __m128 one = _mm_set1_ps(1.f);
+    __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+    for (int l = 0; l < n; ++l) {
+        rayPacket_initLane(&out[l], max_dist);
+    }
+
+    __m128i cx = rayPacket_floorSse2(vox);
+    __m128i cy = rayPacket_floorSse2(voy);
+
+    int active = ((1 << n) - 1) & _mm_movemask_ps(_mm_castsi128_ps(rayPacket_inBoundsSse2(cx, cy, dim)));
+
+    __m128i steps = _mm_sub_epi32(_mm_setzero_si128(), rayPacket_laneMaskSse2(active));
+
+    int lane_x[4], lane_y[4], lane_side_x[4];
+
+    __m128i tile = rayPacket_gatherSse2(gm, cx, cy, active);
+    int solid = active & ~_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(tile, _mm_setzero_si128())));
+    if (solid) {
+        _mm_storeu_si128((__m128i*)lane_x, cx);
+        _mm_storeu_si128((__m128i*)lane_y, cy);
+        for (int l = 0; l < 4; ++l) {
+            if (solid & (1 << l)) {
+                rayPacket_finishHit(gm, &out[l], lox[l], loy[l], ldx[l], ldy[l], lane_x[l], lane_y[l], RAY_FACE_NONE);
+            }
+        }
+        active &= ~solid;
+    }
+
+    __m128 delta_x = _mm_and_ps(_mm_div_ps(one, vdx), abs_mask);
+    __m128 delta_y = _mm_and_ps(_mm_div_ps(one, vdy), abs_mask);
+
+    __m128 neg_x = _mm_cmplt_ps(vdx, zero);
+    __m128 neg_y = _mm_cmplt_ps(vdy, zero);
+
+    __m128i step_x = rayPacket_selectiSse2(_mm_castps_si128(neg_x), _mm_set1_epi32(-1), _mm_set1_epi32(1));
+    __m128i step_y = rayPacket_selectiSse2(_mm_castps_si128(neg_y), _mm_set1_epi32(-1), _mm_set1_epi32(1));
+
+    __m128 side_x = rayPacket_sideDistSse2(vox, neg_x, cx, delta_x);
+    __m128 side_y = rayPacket_sideDistSse2(voy, neg_y, cy, delta_y);
+
+    while (active) {
+        __m128 mx = _mm_cmplt_ps(side_x, side_y);
+        __m128i mxi = _mm_castps_si128(mx);
+
+        __m128 t = rayPacket_selectSse2(mx, side_x, side_y);
+
+        cx = rayPacket_selectiSse2(mxi, _mm_add_epi32(cx, step_x), cx);
+        cy = rayPacket_selectiSse2(mxi, cy, _mm_add_epi32(cy, step_y));
+        // Lanes that didn't step on an axis get the same value again
+        side_x = rayPacket_sideDistSse2(vox, neg_x, cx, delta_x);
+        side_y = rayPacket_sideDistSse2(voy, neg_y, cy, delta_y);
+
+        int in = _mm_movemask_ps(_mm_castsi128_ps(rayPacket_inBoundsSse2(cx, cy, dim)));
+        int past = _mm_movemask_ps(_mm_cmpgt_ps(t, vmax));
+
+        // Missed, results stay as initialized
+        active &= in & ~past;
+
+        steps = _mm_sub_epi32(steps, rayPacket_laneMaskSse2(active));
+
+        tile = rayPacket_gatherSse2(gm, cx, cy, active);
+        int hit = active & ~_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(tile, _mm_setzero_si128())));
+        if (hit) {
+            _mm_storeu_si128((__m128i*)lane_x, cx);
+            _mm_storeu_si128((__m128i*)lane_y, cy);
+            _mm_storeu_si128((__m128i*)lane_side_x, mxi);
+            for (int l = 0; l < 4; ++l) {
+                if (hit & (1 << l)) {
+                    RayFace face = lane_side_x[l]
+                        ? (ldx[l] < 0.f ? RAY_FACE_X_MAX : RAY_FACE_X_MIN)
+                        : (ldy[l] < 0.f ? RAY_FACE_Y_MAX : RAY_FACE_Y_MIN);
+                    rayPacket_finishHit(gm, &out[l], lox[l], loy[l], ldx[l], ldy[l], lane_x[l], lane_y[l], face);
+                }
+            }
+            active &= ~hit;
+        }
+    }
+
+    int lane_steps[4];
+    _mm_storeu_si128((__m128i*)lane_steps, steps);
+    for (int l = 0; l < n; ++l) {
+        out[l].steps = lane_steps[l];
+    }
+}
+
+CPU_TARGET_AVX2
+static inline __m256i rayPacket_inBoundsAvx2(__m256i x, __m256i y, __m256i dim) {
+    __m256i zero = _mm256_setzero_si256();
+    __m256i in_x = _mm256_andnot_si256(_mm256_cmpgt_epi32(zero, x), _mm256_cmpgt_epi32(dim, x));
+    __m256i in_y = _mm256_andnot_si256(_mm256_cmpgt_epi32(zero, y), _mm256_cmpgt_epi32(dim, y));
+    return _mm256_and_si256(in_x, in_y);
+}
+
+// raycast_sideDist of eight lanes, neg is the mask of lanes with dir < 0
+CPU_TARGET_AVX2
+static inline __m256 rayPacket_sideDistAvx2(__m256 o, __m256 neg, __m256i c, __m256 delta) {
+    __m256 cf = _mm256_cvtepi32_ps(c);
+    __m256 c1f = _mm256_cvtepi32_ps(_mm256_add_epi32(c, _mm256_set1_epi32(1)));
+    return _mm256_mul_ps(_mm256_blendv_ps(_mm256_sub_ps(c1f, o), _mm256_sub_ps(o, cf), neg), delta);
+}
+
+CPU_TARGET_AVX2
+static inline __m256i rayPacket_laneMaskAvx2(int active) {
+    __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    return _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(active), bits), bits);
+}
+
+/*
+* Gathers the 32-bit half of each lane's occupancy word that holds its bit
+* (x86 is little-endian, rows 0-3 of a block are the low half).
+* Non-zero lanes are walls.
+*/
+CPU_TARGET_AVX2
+static inline __m256i rayPacket_gatherAvx2(const GameMap* gm, __m256i cx, __m256i cy, int active) {
+    __m256i word = _mm256_add_epi32(_mm256_srli_epi32(cx, 3),
+                                    _mm256_mullo_epi32(_mm256_srli_epi32(cy, 3), _mm256_set1_epi32(gm->occ_stride)));
+    __m256i idx = _mm256_add_epi32(_mm256_slli_epi32(word, 1), _mm256_and_si256(_mm256_srli_epi32(cy, 2), _mm256_set1_epi32(1)));
+    __m256i bit = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(cy, _mm256_set1_epi32(3)), 3),
+                                  _mm256_and_si256(cx, _mm256_set1_epi32(7)));
+    __m256i half = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int*)gm->occupancy, idx,
+                                               rayPacket_laneMaskAvx2(active), 4);
+    return _mm256_and_si256(_mm256_srlv_epi32(half, bit), _mm256_set1_epi32(1));
+}
+
+// Up to 8 rays, lanes past n are masked off
+CPU_TARGET_AVX2
+void rayPacket_castAvx2(const GameMap* gm, int n,
+                        const float* ox, const float* oy, const float* dx, const float* dy,
+                        float max_dist, RayHit* out)
+{
+    float lox[8] = { 0 }, loy[8] = { 0 }, ldx[8] = { 0 }, ldy[8] = { 0 };
+    memcpy(lox, ox, n * sizeof(float));
+    memcpy(loy, oy, n * sizeof(float));
+    memcpy(ldx, dx, n * sizeof(float));
+    memcpy(ldy, dy, n * sizeof(float));
+
+    __m256 vox = _mm256_loadu_ps(lox);
+    __m256 voy = _mm256_loadu_ps(loy);
+    __m256 vdx = _mm256_loadu_ps(ldx);
+    __m256 vdy = _mm256_loadu_ps(ldy);
+
+    __m256i dim = _mm256_set1_epi32(gm->dim);
+    __m256 vmax = _mm256_set1_ps(max_dist);
+    __m256 zero = _mm256_setzero_ps();
+    __m256 one = _mm256_set1_ps(1.f);
+    __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+    for (int l = 0; l < n; ++l) {
+        rayPacket_initLane(&out[l], max_dist);
+    }
+
+    __m256i cx = _mm256_cvttps_epi32(_mm256_floor_ps(vox));
+    __m256i cy = _mm256_cvttps_epi32(_mm256_floor_ps(voy));
+
+    int active = ((1 << n) - 1) & _mm256_movemask_ps(_mm256_castsi256_ps(rayPacket_inBoundsAvx2(cx, cy, dim)));
+
+    __m256i steps = _mm256_sub_epi32(_mm256_setzero_si256(), rayPacket_laneMaskAvx2(active));
+
+    int lane_x[8], lane_y[8], lane_side_x[8];
+
+    // Hits are resolved after the loop, calling non-VEX code with dirty ymm state is very slow
+    int hits = 0;
+    int hit_x[8], hit_y[8];
+    RayFace hit_face[8];
+
+    __m256i tile = rayPacket_gatherAvx2(gm, cx, cy, active);
+    int solid = active & ~_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(tile, _mm256_setzero_si256())));
+    if (solid) {
+        _mm256_storeu_si256((__m256i*)lane_x, cx);
+        _mm256_storeu_si256((__m256i*)lane_y, cy);
+        for (int l = 0; l < 8; ++l) {
+            if (solid & (1 << l)) {
+                hit_x[l] = lane_x[l];
+                hit_y[l] = lane_y[l];
+                hit_face[l] = RAY_FACE_NONE;
+            }
+        }
+        hits |= solid;
+        active &= ~solid;
+    }
+
+    __m256 delta_x = _mm256_and_ps(_mm256_div_ps(one, vdx), abs_mask);
+    __m256 delta_y = _mm256_and_ps(_mm256_div_ps(one, vdy), abs_mask);
+
+    __m256 neg_x = _mm256_cmp_ps(vdx, zero, _CMP_LT_OQ);
+    __m256 neg_y = _mm256_cmp_ps(vdy, zero, _CMP_LT_OQ);
+
+    __m256i step_x = _mm256_or_si256(_mm256_castps_si256(neg_x), _mm256_set1_epi32(1));
+    __m256i step_y = _mm256_or_si256(_mm256_castps_si256(neg_y), _mm256_set1_epi32(1));
+
+    __m256 side_x = rayPacket_sideDistAvx2(vox, neg_x, cx, delta_x);
+    __m256 side_y = rayPacket_sideDistAvx2(voy, neg_y, cy, delta_y);
+
+    while (active) {
+        __m256 mx = _mm256_cmp_ps(side_x, side_y, _CMP_LT_OQ);
+        __m256i mxi = _mm256_castps_si256(mx);
+
+        __m256 t = _mm256_blendv_ps(side_y, side_x, mx);
+
+        cx = _mm256_blendv_epi8(cx, _mm256_add_epi32(cx, step_x), mxi);
+        cy = _mm256_blendv_epi8(_mm256_add_epi32(cy, step_y), cy, mxi);
+        // Lanes that didn't step on an axis get the same value again
+        side_x = rayPacket_sideDistAvx2(vox, neg_x, cx, delta_x);
+        side_y = rayPacket_sideDistAvx2(voy, neg_y, cy, delta_y);
+
+        int in = _mm256_movemask_ps(_mm256_castsi256_ps(rayPacket_inBoundsAvx2(cx, cy, dim)));
+        int past = _mm256_movemask_ps(_mm256_cmp_ps(t, vmax, _CMP_GT_OQ));
+
+        // Missed, results stay as initialized
+        active &= in & ~past;
+
+        steps = _mm256_sub_epi32(steps, rayPacket_laneMaskAvx2(active));
+
+        tile = rayPacket_gatherAvx2(gm, cx, cy, active);
+        int hit = active & ~_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(tile, _mm256_setzero_si256())));
+        if (hit) {
+            _mm256_storeu_si256((__m256i*)lane_x, cx);
+            _mm256_storeu_si256((__m256i*)lane_y, cy);
+            _mm256_storeu_si256((__m256i*)lane_side_x, mxi);
+            for (int l = 0; l < 8; ++l) {
+                if (hit & (1 << l)) {
+                    hit_x[l] = lane_x[l];
+                    hit_y[l] = lane_y[l];
+                    hit_face[l] = lane_side_x[l]
+                        ? (ldx[l] < 0.f ? RAY_FACE_X_MAX : RAY_FACE_X_MIN)
+                        : (ldy[l] < 0.f ? RAY_FACE_Y_MAX : RAY_FACE_Y_MIN);
+                }
+            }
+            hits |= hit;
+            active &= ~hit;
+        }
+    }
+
+    int lane_steps[8];
+    _mm256_storeu_si256((__m256i*)lane_steps, steps);
+    _mm256_zeroupper();
+
+    for (int l = 0; l < n; ++l) {
+        if (hits & (1 << l)) {
+            rayPacket_finishHit(gm, &out[l], lox[l], loy[l], ldx[l], ldy[l], hit_x[l], hit_y[l], hit_face[l]);
+        }
+        out[l].steps = lane_steps[l];
+    }
+}
+
+#endif // CPU_X86
+
+/*
+* Cast n rays given as SoA arrays, in packets of the isa's width.
+* Falls back to the scalar DDA when SIMD isn't available.
+*/
+void rayPacket_cast(const GameMap* gm, RayPacketIsa isa, int n,
+                    const float* ox, const float* oy, const float* dx, const float* dy,
+                    float max_dist, RayHit* out)
+{
+    int width = rayPacket_width(isa);
+
+    for (int i = 0; i < n; i += width) {
+        int lanes = n - i < width ? n - i : width;
+
+        switch (isa) {
+#ifdef CPU_X86
+        case RAY_PACKET_AVX2:
+            rayPacket_castAvx2(gm, lanes, ox + i, oy + i, dx + i, dy + i, max_dist, out + i);
+            break;
+        case RAY_PACKET_SSE2:
+            rayPacket_castSse2(gm, lanes, ox + i, oy + i, dx + i, dy + i, max_dist, out + i);
+            break;
+#endif
+        default:
+            rayPacket_castScalar(gm, lanes, ox + i, oy + i, dx + i, dy + i, max_dist, out + i);
+            break;
+        }
+    }
+}
+
+/*
+* Wall height in rows for each hit distance, corrected by the column's fisheye factor:
+* rows - dist * fisheye * (rows / view_dist), truncated like the scalar renderer.
+*/
+CPU_TARGET_SSE2
+void rayPacket_wallHeights(RayPacketIsa isa, int n, const float* dist, const float* fisheye, int rows, float view_dist, int* heights)
+{
+    int i = 0;
+
+    // One division per call, the columns only multiply
+    float scale = rows / view_dist;
+
+#ifdef CPU_X86
+    if (isa != RAY_PACKET_SCALAR) {
+        __m128 vrows = _mm_set1_ps((float)rows);
+        __m128 vscale = _mm_set1_ps(scale);
+        for (; i + 4 <= n; i += 4) {
+            __m128 d = _mm_mul_ps(_mm_loadu_ps(dist + i), _mm_loadu_ps(fisheye + i));
+            __m128 h = _mm_sub_ps(vrows, _mm_mul_ps(d, vscale));
+            _mm_storeu_si128((__m128i*)(heights + i), _mm_cvttps_epi32(h));
+        }
+    }
+#endif
+
+    for (; i < n; ++i) {
+        heights[i] = rows - dist[i] * fisheye[i] * scale;
+    }
+}
+
+#endif // _RAYCAST_PACKET_H_
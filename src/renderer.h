@@ -0,0 +1,902 @@
+#ifndef _RENDERER_H_
+#define _RENDERER_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "vec2.h"
+#include "screen.h"
+#include "texture_buffer.h"
+#include "game_map.h"
+#include "raycast.h"
+#include "raycast_packet.h"
+#include "thread_pool.h"
+#include "timer.h"
+
+/*
+* Draws a frame of the top view and the first-person view into
+* TextureBuffers. Doesn't need a window or a GL context.
+*/
+
+const Pixel BLACK = PIXEL_INIT(0, 0, 0);
+const Pixel RED   = PIXEL_INIT(255, 0, 0);
+const Pixel GREEN = PIXEL_INIT(0, 255, 0);
+const Pixel BLUE  = PIXEL_INIT(0, 0, 255);
+
+const Pixel YELLOW = PIXEL_INIT(255, 255, 0);
+const Pixel MAGENTA = PIXEL_INIT(255, 0, 255);
+const Pixel CYAN = PIXEL_INIT(0, 255, 255);
+const Pixel GRAY = PIXEL_INIT(96, 96, 96);
+
+typedef struct {
+    Pixel top_clear; // Empty tiles of the top view
+    Pixel top_tile;  // Solid tiles of the top view
+    Pixel pov_clear;
+
+    Pixel ray;
+    Pixel wall;
+    Pixel ceil;
+    Pixel floor;
+
+    Pixel player;
+    Pixel nearest_plane;
+    Pixel look_dir;
+} RenderColors;
+
+// Polygon edge for the scanline fill, stepped from row to row
+typedef struct {
+    int y0;     // First row whose center the edge crosses
+    int y1;     // One past the last one
+    float x;    // Crossing at the center of the current row
+    float dxdy;
+} PolygonEdge;
+
+// Timings of the last drawFrame in seconds, plus the work it did
+typedef struct {
+    double clear;
+    double cast;    // Rays and wall heights
+    double fill;    // POV floor, ceiling and wall columns
+    double overlay; // Top view visibility polygon, player and plane
+
+    long long rays;  // Rays cast, reused columns aren't
+    long long steps; // Cells visited by all rays
+
+    long long reused_rays; // Columns shifted over from the last frame, see renderer_drawFrame
+    bool unchanged;        // Same frame as the last one, nothing was drawn
+} RenderStats;
+
+// Everything the cast of a frame depends on except the look dir
+typedef struct {
+    Vec2 origin; // map space
+    const int* tiles;
+    unsigned int map_epoch;
+    RaycastMode mode;
+    int pov_cols;
+    int pov_rows;
+    float fov;
+    int top_cols;
+    int top_rows;
+    bool snap_yaw;
+} FrameCastKey;
+
+// Everything a frame depends on, two frames with equal keys are the same pixels
+typedef struct {
+    FrameCastKey cast;
+    Vec2 look_dir;
+    RenderColors colors;
+    float plane_dist;
+    const TextureBuffer* top_view;
+    const TextureBuffer* pov;
+    unsigned int top_epoch;
+    unsigned int pov_epoch;
+} FrameKey;
+
+/*
+* Adaptive casting (RAYCAST_MODE_ADAPTIVE) casts every RENDERER_ADAPTIVE_STRIDE-th column,
+* then halves the gaps between cast columns until each one is closed. A gap whose two ends
+* hit the same face of the same cell is closed without casting: no solid cell fits in the
+* wedge between two such rays (it would have to be a grid-aligned square inside a triangle
+* less than one cell wide along the face), so every ray in between hits that face too and
+* raycast_resolveHit gives it the same hit a full cast would.
+*/
+#define RENDERER_ADAPTIVE_STRIDE 16
+
+typedef enum {
+    RENDERER_COLUMN_OPEN,
+    RENDERER_COLUMN_CAST,
+    RENDERER_COLUMN_RESOLVED,
+} RendererColumnState;
+
+typedef struct {
+    Screen* scr;
+    GameMap* gm;
+
+    TextureBuffer* top_view; // top view (left side of the screen)
+    TextureBuffer* pov;      // first-person view (right side of the screen)
+
+    ThreadPool* pool; // NULL renders on the calling thread
+
+    RaycastMode mode;
+    RayPacketIsa isa;
+
+    RenderColors colors;
+
+    /*
+    * Skip frames whose key matches the last one, and with snap_yaw, on pure rotations
+    * shift the last cast over and only cast the columns that came into view.
+    * Off, every frame is drawn from scratch.
+    */
+    bool frame_cache;
+    /*
+    * Column rays point at the absolute angle (yaw index + column) * RAY_ANGLE_STEP,
+    * with the yaw index the look dir rounded to column steps. A turn by whole steps
+    * then gives every column the exact ray another column had, see renderer_snapYaw.
+    */
+    bool snap_yaw;
+    bool frame_valid;
+    FrameKey frame_key;
+
+    // Distance of the near plane drawn in the top view, in top view pixels
+    float plane_dist;
+
+    /*
+    * Map tiles rasterized at the top view's size and layout. Every frame
+    * restores the top view from it, only the overlays are drawn per frame.
+    * Rebuilt when the size, layout or map changes, patched by renderer_setTile.
+    */
+    TextureBuffer map_layer;
+    bool map_layer_built;
+    const int* map_layer_tiles; // gm->map and gm->epoch it was built from
+    unsigned int map_layer_epoch;
+
+    // Results of the last cast, one entry per POV column
+    RayHit* column_hits;
+    Vec2* column_dirs; // top view space
+    int* column_heights; // wall height in POV rows
+    unsigned char* column_state; // RendererColumnState, adaptive casting only
+    int* column_list;            // Columns an adaptive pass casts, each worker uses its own range
+    int column_capacity;
+
+    // Scratch of the top view visibility polygon, sized for one vertex per column plus the player
+    Vec2* overlay_points;
+    PolygonEdge* overlay_edges;
+    int* overlay_active;
+    float* overlay_xs;
+
+    RenderStats stats;
+} Renderer;
+
+// Per-frame state shared by the column workers
+typedef struct {
+    Renderer* r;
+
+    Vec2 origin;    // map space
+    Vec2 look_dir;  // top view space
+    Vec2 tv_to_map;
+
+    float view_dist;
+
+    // Absolute column angles, see Renderer.snap_yaw
+    bool snapped;
+    int yaw_index;
+    float look_len;
+
+    int first; // Column the job's range starts at
+} ColumnJob;
+
+RenderColors renderColors_default(void) {
+    return (RenderColors){
+        .top_clear = BLACK,
+        .top_tile = GRAY,
+        .pov_clear = BLACK,
+
+        .ray = GREEN,
+        .wall = RED,
+        .ceil = GREEN,
+        .floor = YELLOW,
+
+        .player = RED,
+        .nearest_plane = MAGENTA,
+        .look_dir = YELLOW,
+    };
+}
+
+void renderer_init(Renderer* r, Screen* scr, GameMap* gm, TextureBuffer* top_view, TextureBuffer* pov, ThreadPool* pool) {
+    memset(r, 0, sizeof(Renderer));
+
+    r->scr = scr;
+    r->gm = gm;
+    r->top_view = top_view;
+    r->pov = pov;
+    r->pool = pool;
+
+    r->mode = RAYCAST_MODE_PACKET;
+    r->isa = RAY_PACKET_SCALAR;
+
+    r->colors = renderColors_default();
+
+    r->plane_dist = 4;
+
+    r->frame_cache = true;
+}
+
+void renderer_destroy(Renderer* r) {
+    if (r->map_layer_built) {
+        textureBuffer_destroy(&r->map_layer);
+        r->map_layer_built = false;
+    }
+    free(r->column_hits);
+    free(r->column_dirs);
+    free(r->column_heights);
+    free(r->column_state);
+    free(r->column_list);
+    free(r->overlay_points);
+    free(r->overlay_edges);
+    free(r->overlay_active);
+    free(r->overlay_xs);
+    r->column_hits = NULL;
+    r->column_dirs = NULL;
+    r->column_heights = NULL;
+    r->column_state = NULL;
+    r->column_list = NULL;
+    r->overlay_points = NULL;
+    r->overlay_edges = NULL;
+    r->overlay_active = NULL;
+    r->overlay_xs = NULL;
+    r->column_capacity = 0;
+}
+
+void renderer_reserveColumns(Renderer* r, int num_cols) {
+    if (num_cols <= r->column_capacity) {
+        return;
+    }
+
+    RayHit* hits = realloc(r->column_hits, num_cols * sizeof(RayHit));
+    Vec2* dirs = realloc(r->column_dirs, num_cols * sizeof(Vec2));
+    int* heights = realloc(r->column_heights, num_cols * sizeof(int));
+    unsigned char* state = realloc(r->column_state, num_cols * sizeof(unsigned char));
+    int* list = realloc(r->column_list, num_cols * sizeof(int));
+    Vec2* points = realloc(r->overlay_points, (num_cols + 1) * sizeof(Vec2));
+    PolygonEdge* edges = realloc(r->overlay_edges, (num_cols + 1) * sizeof(PolygonEdge));
+    int* active = realloc(r->overlay_active, (num_cols + 1) * sizeof(int));
+    float* xs = realloc(r->overlay_xs, (num_cols + 1) * sizeof(float));
+    if (hits == NULL || dirs == NULL || heights == NULL || state == NULL || list == NULL ||
+        points == NULL || edges == NULL || active == NULL || xs == NULL) {
+        perror("Fatal error: realloc failed");
+        exit(1);
+    }
+    r->column_hits = hits;
+    r->column_dirs = dirs;
+    r->column_heights = heights;
+    r->column_state = state;
+    r->column_list = list;
+    r->overlay_points = points;
+    r->overlay_edges = edges;
+    r->overlay_active = active;
+    r->overlay_xs = xs;
+    r->column_capacity = num_cols;
+}
+
+Vec2 renderer_mapToTopView(const Renderer* r, Vec2 p) {
+    return (Vec2){
+        p.x / r->gm->dim * r->scr->TOP_VIEW_COLS,
+        p.y / r->gm->dim * r->scr->TOP_VIEW_ROWS
+    };
+}
+
+// Scale from top view pixels to map units, so the ray parameter stays in top view pixels
+Vec2 renderer_topViewToMapScale(const Renderer* r) {
+    return (Vec2){
+        r->gm->dim / (float)r->scr->TOP_VIEW_COLS,
+        r->gm->dim / (float)r->scr->TOP_VIEW_ROWS
+    };
+}
+
+// Color of top view pixel (x, y) in the map layer, from the tile under the pixel's center
+static Pixel renderer_mapLayerPixel(const Renderer* r, int x, int y) {
+    int cols = r->scr->TOP_VIEW_COLS;
+    int rows = r->scr->TOP_VIEW_ROWS;
+    int dim = r->gm->dim;
+
+    // Rows are flipped like in renderer_drawTopView
+    int tx = (int)((x + 0.5f) * dim / cols);
+    int ty = (int)((rows - y - 0.5f) * dim / rows);
+    tx = tx < dim - 1 ? tx : dim - 1;
+    ty = ty < dim - 1 ? ty : dim - 1;
+    ty = ty > 0 ? ty : 0;
+
+    return r->gm->map[tx + ty * dim] != 0 ? r->colors.top_tile : r->colors.top_clear;
+}
+
+static void renderer_paintMapLayer(Renderer* r, int x0, int y0, int x1, int y1) {
+    for (int y = y0; y < y1; ++y) {
+        for (int x = x0; x < x1; ++x) {
+            textureBuffer_writePixel(&r->map_layer, x, y, renderer_mapLayerPixel(r, x, y));
+        }
+    }
+}
+
+static bool renderer_mapLayerValid(const Renderer* r) {
+    return r->map_layer_built &&
+           r->map_layer.width == r->top_view->width &&
+           r->map_layer.height == r->top_view->height &&
+           r->map_layer.layout == r->top_view->layout &&
+           r->map_layer_tiles == r->gm->map &&
+           r->map_layer_epoch == r->gm->epoch;
+}
+
+void renderer_buildMapLayer(Renderer* r) {
+    if (r->map_layer_built) {
+        textureBuffer_destroy(&r->map_layer);
+    }
+    textureBuffer_init(&r->map_layer, r->top_view->width, r->top_view->height);
+    textureBuffer_setLayout(&r->map_layer, r->top_view->layout);
+    renderer_paintMapLayer(r, 0, 0, r->map_layer.width, r->map_layer.height);
+
+    r->map_layer_built = true;
+    r->map_layer_tiles = r->gm->map;
+    r->map_layer_epoch = r->gm->epoch;
+
+    // Layer memory is new, so the top view is restored from scratch
+    textureBuffer_dirtyAll(r->top_view);
+}
+
+/*
+* Edits a tile through gameMap_setTile and repaints the pixels it covers in the map layer.
+* Edits made straight on the map are caught by the epoch and rebuild the whole layer.
+*/
+void renderer_setTile(Renderer* r, int x, int y, int tile) {
+    bool in_sync = renderer_mapLayerValid(r);
+    gameMap_setTile(r->gm, x, y, tile);
+    if (!in_sync) {
+        return;
+    }
+    r->map_layer_epoch = r->gm->epoch;
+
+    // Pixels whose center may fall in the tile, one extra pixel around for rounding
+    int cols = r->scr->TOP_VIEW_COLS;
+    int rows = r->scr->TOP_VIEW_ROWS;
+    int dim = r->gm->dim;
+    int x0 = x * cols / dim - 1;
+    int x1 = ((x + 1) * cols + dim - 1) / dim + 1;
+    int y0 = rows - ((y + 1) * rows + dim - 1) / dim - 1;
+    int y1 = rows - y * rows / dim + 1;
+
+    x0 = x0 > 0 ? x0 : 0;
+    y0 = y0 > 0 ? y0 : 0;
+    x1 = x1 < cols ? x1 : cols;
+    y1 = y1 < rows ? y1 : rows;
+
+    renderer_paintMapLayer(r, x0, y0, x1, y1);
+    textureBuffer_invalidateRect(r->top_view, x0, y0, x1, y1);
+}
+
+// Rays end after this many top view pixels
+float renderer_viewDist(const Renderer* r) {
+    return r->scr->TOP_VIEW_ROWS;
+}
+
+void renderer_drawTopView(Renderer* r, float x, float y, Pixel pix) {
+    textureBuffer_setPixel(r->top_view, x, r->scr->TOP_VIEW_ROWS - y, pix);
+}
+
+// Plot a ray in the top view from its origin up to len pixels
+void renderer_drawRay(Renderer* r, Vec2 origin_pixel_space, Vec2 dir, float len, Pixel col)
+{
+    for (float t = 0; t < len; t += 0.5f) {
+        Vec2 rayp = vec2_add(origin_pixel_space, vec2_mulf(dir, t));
+        renderer_drawTopView(r, rayp.x, rayp.y, col);
+    }
+}
+
+static int renderer_compareEdges(const void* a, const void* b) {
+    return ((const PolygonEdge*)a)->y0 - ((const PolygonEdge*)b)->y0;
+}
+
+/*
+* Fills the closed polygon pts[0..n) in the top view with even-odd scanlines.
+* Points are in texture space (y down, pixel (x, y) covers [x, x + 1) x [y, y + 1)),
+* a pixel is inside when its center is. Edges are walked row by row, so the cost
+* is the filled pixels plus the rows the edges span, whatever the polygon's shape.
+*/
+void renderer_fillPolygon(Renderer* r, const Vec2* pts, int n, Pixel col) {
+    TextureBuffer* tb = r->top_view;
+    PolygonEdge* edges = r->overlay_edges;
+    int* active = r->overlay_active;
+    float* xs = r->overlay_xs;
+
+    int num_edges = 0;
+    for (int i = 0; i < n; ++i) {
+        Vec2 a = pts[i];
+        Vec2 b = pts[i + 1 < n ? i + 1 : 0];
+        if (a.y > b.y) {
+            Vec2 t = a;
+            a = b;
+            b = t;
+        }
+
+        // Rows whose center is in [a.y, b.y), clipped to the texture
+        int y0 = (int)ceilf(a.y - 0.5f);
+        int y1 = (int)ceilf(b.y - 0.5f);
+        y0 = y0 > 0 ? y0 : 0;
+        y1 = y1 < tb->height ? y1 : tb->height;
+        if (y0 >= y1) {
+            continue;
+        }
+
+        float dxdy = (b.x - a.x) / (b.y - a.y);
+        edges[num_edges++] = (PolygonEdge){ y0, y1, a.x + (y0 + 0.5f - a.y) * dxdy, dxdy };
+    }
+    if (num_edges == 0) {
+        return;
+    }
+    qsort(edges, num_edges, sizeof(PolygonEdge), renderer_compareEdges);
+
+    int next = 0;
+    int num_active = 0;
+    for (int y = edges[0].y0; next < num_edges || num_active > 0; ++y) {
+        if (num_active == 0 && edges[next].y0 > y) {
+            y = edges[next].y0;
+        }
+        while (next < num_edges && edges[next].y0 == y) {
+            active[num_active++] = next++;
+        }
+
+        // Drop finished edges and sort the crossings of this row
+        int k = 0;
+        for (int i = 0; i < num_active; ++i) {
+            PolygonEdge* e = &edges[active[i]];
+            if (e->y1 <= y) {
+                continue;
+            }
+            active[k] = active[i];
+
+            int j = k++;
+            for (; j > 0 && xs[j - 1] > e->x; --j) {
+                xs[j] = xs[j - 1];
+            }
+            xs[j] = e->x;
+        }
+        num_active = k;
+
+        for (int i = 0; i + 1 < num_active; i += 2) {
+            textureBuffer_setRow(tb, y, (int)ceilf(xs[i] - 0.5f), (int)ceilf(xs[i + 1] - 0.5f), col);
+        }
+
+        for (int i = 0; i < num_active; ++i) {
+            edges[active[i]].x += edges[active[i]].dxdy;
+        }
+    }
+}
+
+void renderer_drawNearestPlane(Renderer* r, Vec2 player_pos_pixel_space, Vec2 player_look_dir)
+{
+    float plane_width = r->plane_dist * tan(degToRad(r->scr->PLAYER_POV / 2.0)) * 2.0;
+
+    Vec2 plane_dir = vec2_perpendicular(player_look_dir);
+    Vec2 plane_center = vec2_muli(player_look_dir, r->plane_dist);
+
+    for (float i = -plane_width / 2; i < plane_width / 2 + 1; i += 1) {
+        // Vec2 vpl = vpy + player_look_dir * (plane_dist) + plane_dir * i;
+
+        Vec2 plane_dir_advanced = vec2_mulf(plane_dir, i);
+
+        Vec2 plane_next = vec2_add(plane_center, plane_dir_advanced);
+
+        Vec2 vpl = vec2_add(player_pos_pixel_space, plane_next);
+
+        renderer_drawTopView(r, vpl.x, vpl.y, r->colors.nearest_plane);
+    }
+}
+
+void renderer_drawPlayer(Renderer* r, Vec2 player_pos_pixel_space)
+{
+    for (int i = -1; i < 2; ++i) {
+        for (int j = -1; j < 2; ++j) {
+            renderer_drawTopView(r, player_pos_pixel_space.x + i, player_pos_pixel_space.y + j, r->colors.player);
+        }
+    }
+}
+
+// Direction of a column's ray in top view space. Every column rotates the look dir on its own so the result doesn't depend on chunking.
+static inline Vec2 renderer_columnDir(const ColumnJob* job, int i) {
+    if (job->snapped) {
+        // Only yaw_index + i goes in, so columns a turn shifted onto each other get the same ray
+        const Screen* scr = job->r->scr;
+        double angle = degToRad(-scr->PLAYER_POV / 2.f) + (double)(job->yaw_index + i) * scr->RAY_ANGLE_STEP;
+        return (Vec2){ job->look_len * (float)cos(angle), job->look_len * (float)sin(angle) };
+    }
+
+    float c = job->r->scr->RAY_COS[i];
+    float s = job->r->scr->RAY_SIN[i];
+    return (Vec2){
+        job->look_dir.x * c - job->look_dir.y * s,
+        job->look_dir.x * s + job->look_dir.y * c
+    };
+}
+
+// Casts the n columns in cols, whose directions are already set, as packets
+static void renderer_castList(const ColumnJob* job, const int* cols, int n) {
+    Renderer* r = job->r;
+
+    for (int b = 0; b < n; b += RAY_PACKET_MAX_WIDTH) {
+        int m = n - b < RAY_PACKET_MAX_WIDTH ? n - b : RAY_PACKET_MAX_WIDTH;
+
+        float ox[RAY_PACKET_MAX_WIDTH], oy[RAY_PACKET_MAX_WIDTH];
+        float dx[RAY_PACKET_MAX_WIDTH], dy[RAY_PACKET_MAX_WIDTH];
+        RayHit hits[RAY_PACKET_MAX_WIDTH];
+
+        for (int k = 0; k < m; ++k) {
+            Vec2 rayd_map = vec2_mul(r->column_dirs[cols[b + k]], job->tv_to_map);
+            ox[k] = job->origin.x;
+            oy[k] = job->origin.y;
+            dx[k] = rayd_map.x;
+            dy[k] = rayd_map.y;
+        }
+
+        rayPacket_cast(r->gm, r->isa, m, ox, oy, dx, dy, job->view_dist, hits);
+
+        for (int k = 0; k < m; ++k) {
+            r->column_hits[cols[b + k]] = hits[k];
+            r->column_state[cols[b + k]] = RENDERER_COLUMN_CAST;
+        }
+    }
+}
+
+static inline bool renderer_sameFace(const RayHit* a, const RayHit* b) {
+    return a->hit && b->hit && a->cell_x == b->cell_x && a->cell_y == b->cell_y && a->face == b->face;
+}
+
+// Adaptive cast of columns [begin, end), see RENDERER_ADAPTIVE_STRIDE
+static void renderer_castAdaptive(const ColumnJob* job, int begin, int end) {
+    Renderer* r = job->r;
+    RayHit* hits = r->column_hits;
+    unsigned char* state = r->column_state;
+    int* list = r->column_list + begin;
+
+    for (int i = begin; i < end; ++i) {
+        r->column_dirs[i] = renderer_columnDir(job, i);
+        state[i] = RENDERER_COLUMN_OPEN;
+    }
+
+    int n = 0;
+    for (int i = begin; i < end; i += RENDERER_ADAPTIVE_STRIDE) {
+        list[n++] = i;
+    }
+    if (list[n - 1] != end - 1) {
+        list[n++] = end - 1;
+    }
+
+    while (n > 0) {
+        renderer_castList(job, list, n);
+        n = 0;
+
+        // Close the gaps between neighbouring known columns, or split them for the next pass
+        int a = begin;
+        for (int b = begin + 1; b < end; ++b) {
+            if (state[b] == RENDERER_COLUMN_OPEN) {
+                continue;
+            }
+            if (b - a > 1 && renderer_sameFace(&hits[a], &hits[b])) {
+                for (int i = a + 1; i < b; ++i) {
+                    RayHit h = { .tile = hits[a].tile };
+                    raycast_resolveHit(&h, job->origin, vec2_mul(r->column_dirs[i], job->tv_to_map),
+                        hits[a].cell_x, hits[a].cell_y, hits[a].face);
+                    hits[i] = h;
+                    state[i] = RENDERER_COLUMN_RESOLVED;
+                }
+            } else if (b - a > 1) {
+                list[n++] = a + (b - a) / 2;
+            }
+            a = b;
+        }
+    }
+}
+
+// Casts rays of POV columns [begin, end)
+void renderer_castColumns(void* ctx, int begin, int end, int worker)
+{
+    const ColumnJob* job = ctx;
+    (void)worker;
+    Renderer* r = job->r;
+
+    begin += job->first;
+    end += job->first;
+
+    if (r->mode == RAYCAST_MODE_ADAPTIVE) {
+        renderer_castAdaptive(job, begin, end);
+        return;
+    }
+
+    // Columns go through in groups of one packet, even when casting one ray at a time
+    for (int b = begin; b < end; b += RAY_PACKET_MAX_WIDTH) {
+        int n = end - b < RAY_PACKET_MAX_WIDTH ? end - b : RAY_PACKET_MAX_WIDTH;
+
+        float ox[RAY_PACKET_MAX_WIDTH], oy[RAY_PACKET_MAX_WIDTH];
+        float dx[RAY_PACKET_MAX_WIDTH], dy[RAY_PACKET_MAX_WIDTH];
+
+        for (int k = 0; k < n; ++k) {
+            Vec2 rayd = renderer_columnDir(job, b + k);
+            r->column_dirs[b + k] = rayd;
+
+            Vec2 rayd_map = vec2_mul(rayd, job->tv_to_map);
+            ox[k] = job->origin.x;
+            oy[k] = job->origin.y;
+            dx[k] = rayd_map.x;
+            dy[k] = rayd_map.y;
+        }
+
+        if (r->mode == RAYCAST_MODE_PACKET) {
+            rayPacket_cast(r->gm, r->isa, n, ox, oy, dx, dy, job->view_dist, r->column_hits + b);
+        } else {
+            for (int k = 0; k < n; ++k) {
+                r->column_hits[b + k] = raycast(r->gm, r->mode, job->origin, (Vec2){ dx[k], dy[k] }, job->view_dist);
+            }
+        }
+    }
+}
+
+// Wall heights of POV columns [begin, end), from their hit distance and the column's fisheye correction
+void renderer_wallHeights(void* ctx, int begin, int end, int worker)
+{
+    const ColumnJob* job = ctx;
+    (void)worker;
+    Renderer* r = job->r;
+    const Screen* scr = r->scr;
+
+    for (int b = begin; b < end; b += RAY_PACKET_MAX_WIDTH) {
+        int n = end - b < RAY_PACKET_MAX_WIDTH ? end - b : RAY_PACKET_MAX_WIDTH;
+
+        float dist[RAY_PACKET_MAX_WIDTH];
+        for (int k = 0; k < n; ++k) {
+            dist[k] = r->column_hits[b + k].dist;
+        }
+        rayPacket_wallHeights(r->isa, n, dist, scr->RAY_COS + b, scr->POV_ROWS, job->view_dist, r->column_heights + b);
+    }
+}
+
+// Fills POV columns [begin, end). Columns own disjoint pixels, so workers never share writes.
+void renderer_fillColumns(void* ctx, int begin, int end, int worker)
+{
+    const ColumnJob* job = ctx;
+    (void)worker;
+    Renderer* r = job->r;
+    const Screen* scr = r->scr;
+
+    int rows = scr->POV_ROWS;
+    int half_r = rows / 2;
+
+    // Floor is below the horizon row, ceiling above
+    int horizon = half_r + 1 < rows ? half_r + 1 : rows;
+
+    for (int i = begin; i < end; ++i) {
+        // Empty wall span at the top when the ray missed
+        int wall_y0 = rows;
+        int wall_y1 = rows;
+
+        if (r->column_hits[i].hit) {
+            int height = r->column_heights[i];
+            int half_h = height / 2;
+
+            wall_y0 = half_r - half_h < 0 ? 0 : half_r - half_h;
+            wall_y1 = half_r + half_h + 1 > rows ? rows : half_r + half_h + 1;
+
+            float brightness = height / (float)rows;
+            textureBuffer_fillColumn(r->pov, i, wall_y0, wall_y1, pixel_mulf(r->colors.wall, brightness));
+        }
+
+        // Each row is written once, floor and ceiling only around the wall
+        textureBuffer_fillColumn(r->pov, i, 0, wall_y0 < horizon ? wall_y0 : horizon, r->colors.floor);
+        textureBuffer_fillColumn(r->pov, i, wall_y1, horizon, r->colors.floor);
+        textureBuffer_fillColumn(r->pov, i, horizon, wall_y0, r->colors.ceil);
+        textureBuffer_fillColumn(r->pov, i, wall_y1 > horizon ? wall_y1 : horizon, rows, r->colors.ceil);
+    }
+}
+
+static FrameKey renderer_frameKey(const Renderer* r, Vec2 player, Vec2 player_look_dir) {
+    // Compared with memcmp, so the padding has to be zero too
+    FrameKey key;
+    memset(&key, 0, sizeof(FrameKey));
+
+    key.cast.origin = player;
+    key.cast.tiles = r->gm->map;
+    key.cast.map_epoch = r->gm->epoch;
+    key.cast.mode = r->mode;
+    key.cast.pov_cols = r->scr->POV_COLS;
+    key.cast.pov_rows = r->scr->POV_ROWS;
+    key.cast.fov = r->scr->PLAYER_POV;
+    key.cast.top_cols = r->scr->TOP_VIEW_COLS;
+    key.cast.top_rows = r->scr->TOP_VIEW_ROWS;
+    key.cast.snap_yaw = r->snap_yaw;
+
+    key.look_dir = player_look_dir;
+    key.colors = r->colors;
+    key.plane_dist = r->plane_dist;
+    key.top_view = r->top_view;
+    key.pov = r->pov;
+    key.top_epoch = r->top_view->epoch;
+    key.pov_epoch = r->pov->epoch;
+    return key;
+}
+
+// Column steps from angle 0 to the look dir, see Renderer.snap_yaw
+static inline int renderer_yawIndex(const Renderer* r, Vec2 look_dir) {
+    return (int)lround(atan2(look_dir.y, look_dir.x) / r->scr->RAY_ANGLE_STEP);
+}
+
+/*
+* Columns the last cast is shifted by when the look dir turned and nothing else the cast
+* depends on changed, 0 if it can't be reused. Column i then sees what column i + shift saw.
+* Only with snap_yaw: rotating the look dir gives a ray that differs from the column's
+* old ray by rounding, and a grazing ray can then hit another cell.
+*/
+static int renderer_reusableShift(const Renderer* r, const FrameKey* key) {
+    if (!r->snap_yaw || !r->frame_valid || memcmp(&key->cast, &r->frame_key.cast, sizeof(FrameCastKey)) != 0) {
+        return 0;
+    }
+
+    // Column rays are scaled by the look dir length, it has to be the same to the bit
+    Vec2 a = r->frame_key.look_dir;
+    Vec2 b = key->look_dir;
+    if (vec2_magnitude(a) != vec2_magnitude(b)) {
+        return 0;
+    }
+
+    int shift = renderer_yawIndex(r, b) - renderer_yawIndex(r, a);
+    return abs(shift) < r->scr->POV_COLS ? shift : 0;
+}
+
+/*
+* Moves the results of the last cast shift columns to the left, see renderer_reusableShift.
+* With snap_yaw the moved columns have the exact rays they were cast with, so their hits
+* are what a cast would find, in every mode.
+*/
+static void renderer_shiftColumns(const ColumnJob* job, int num_cols, int shift) {
+    Renderer* r = job->r;
+    int keep = num_cols - abs(shift);
+    int from = shift > 0 ? shift : 0;
+    int to = shift > 0 ? 0 : -shift;
+    memmove(r->column_hits + to, r->column_hits + from, keep * sizeof(RayHit));
+    memmove(r->column_dirs + to, r->column_dirs + from, keep * sizeof(Vec2));
+}
+
+// Yaw rounded to whole column steps, so with Renderer.snap_yaw turning shifts columns and the last cast can be reused
+double renderer_snapYaw(const Renderer* r, double theta) {
+    double step = r->scr->RAY_ANGLE_STEP;
+    return round(theta / step) * step;
+}
+
+/*
+* Restore both views, cast one ray per POV column from player (map space)
+* and draw the overlays of the top view.
+*/
+void renderer_drawFrame(Renderer* r, Vec2 player, Vec2 player_look_dir)
+{
+    RenderStats* st = &r->stats;
+    memset(st, 0, sizeof(RenderStats));
+
+    FrameKey key = renderer_frameKey(r, player, player_look_dir);
+    int shift = 0;
+    if (r->frame_cache) {
+        // Both buffers still hold this frame and the last upload sent it
+        if (r->frame_valid && memcmp(&key, &r->frame_key, sizeof(FrameKey)) == 0) {
+            st->unchanged = true;
+            return;
+        }
+        shift = renderer_reusableShift(r, &key);
+    }
+
+    // Built on first use, the other modes never need it
+    if (r->mode == RAYCAST_MODE_DISTANCE && r->gm->distance == NULL) {
+        gameMap_buildDistance(r->gm, r->pool);
+    }
+
+    // Like the distance field, built outside of the timed stages
+    if (!renderer_mapLayerValid(r)) {
+        renderer_buildMapLayer(r);
+    }
+
+    double t0 = timer_now();
+    {
+        // Only what earlier frames drew over the map layer is restored
+        textureBuffer_beginFrameOver(r->top_view, &r->map_layer);
+    }
+    {
+        // fillColumns writes every POV pixel, so there is nothing to clear
+        textureBuffer_beginFrame(r->pov, r->colors.pov_clear, true);
+    }
+
+    double t1 = timer_now();
+    st->clear = t1 - t0;
+
+    int num_rays = r->scr->POV_COLS;
+
+    Vec2 player_pos_pixel_space = renderer_mapToTopView(r, player);
+
+    renderer_reserveColumns(r, num_rays);
+
+    ColumnJob job = {
+        .r = r,
+        .origin = player,
+        .look_dir = player_look_dir,
+        .tv_to_map = renderer_topViewToMapScale(r),
+        .view_dist = renderer_viewDist(r),
+        .snapped = r->snap_yaw,
+        .yaw_index = renderer_yawIndex(r, player_look_dir),
+        .look_len = vec2_magnitude(player_look_dir),
+    };
+
+    // Only the columns that turned into view are cast, the rest comes from the last frame
+    int cast_cols = num_rays;
+    if (shift != 0) {
+        renderer_shiftColumns(&job, num_rays, shift);
+        cast_cols = abs(shift);
+        job.first = shift > 0 ? num_rays - shift : 0;
+        st->reused_rays = num_rays - cast_cols;
+    }
+
+    threadPool_parallelFor(r->pool, cast_cols, 0, renderer_castColumns, &job);
+    // Fisheye correction depends on the column, so shifted columns get new heights too
+    threadPool_parallelFor(r->pool, num_rays, 0, renderer_wallHeights, &job);
+
+    double t2 = timer_now();
+    st->cast = t2 - t1;
+
+    threadPool_parallelFor(r->pool, num_rays, 0, renderer_fillColumns, &job);
+    textureBuffer_markAllDirty(r->pov);
+
+    double t3 = timer_now();
+    st->fill = t3 - t2;
+
+    // Resolved columns took no steps
+    st->rays = cast_cols;
+    for (int i = job.first; i < job.first + cast_cols; ++i) {
+        st->steps += r->column_hits[i].steps;
+        if (r->mode == RAYCAST_MODE_ADAPTIVE && r->column_state[i] != RENDERER_COLUMN_CAST) {
+            --st->rays;
+        }
+    }
+
+    // Top view is drawn from the per-column results once all workers are done.
+    // The rays together cover the visibility polygon of the player and every ray's end.
+    int tv_rows = r->scr->TOP_VIEW_ROWS;
+    Vec2* pts = r->overlay_points;
+    pts[0] = (Vec2){ player_pos_pixel_space.x, tv_rows - player_pos_pixel_space.y };
+    for (int i = 0; i < num_rays; ++i) {
+        RayHit rh = r->column_hits[i];
+        Vec2 rayp = vec2_add(player_pos_pixel_space, vec2_mulf(r->column_dirs[i], rh.dist));
+        pts[i + 1] = (Vec2){ rayp.x, tv_rows - rayp.y };
+    }
+    renderer_fillPolygon(r, pts, num_rays + 1, r->colors.ray);
+
+    for (int i = 0; i < num_rays; ++i) {
+        RayHit rh = r->column_hits[i];
+        if (rh.hit) {
+            Vec2 rayp = vec2_add(player_pos_pixel_space, vec2_mulf(r->column_dirs[i], rh.dist));
+            renderer_drawTopView(r, rayp.x, rayp.y, r->colors.wall);
+        }
+    }
+
+    // Draw player
+    renderer_drawPlayer(r, player_pos_pixel_space);
+
+    renderer_drawNearestPlane(r, player_pos_pixel_space, player_look_dir);
+
+    // Draw player look dir
+    for (int i = 0; i < 10; ++i) {
+        float ldx = player_pos_pixel_space.x + player_look_dir.x * i;
+        float ldy = player_pos_pixel_space.y + player_look_dir.y * i;
+
+        renderer_drawTopView(r, ldx, ldy, r->colors.look_dir);
+    }
+
+    st->overlay = timer_now() - t3;
+
+    // Taken after drawing, the buffers' epochs only change through clears
+    r->frame_key = renderer_frameKey(r, player, player_look_dir);
+    r->frame_valid = true;
+}
+
+#endif // _RENDERER_H_
@@ -0,0 +1,210 @@
+#ifndef _SCREEN_H_
+#define _SCREEN_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+
+#define TOP_VIEW_PIX_W 4
+#define TOP_VIEW_PIX_H 4
+
+
+#ifndef M_PI
+#define M_PI   3.14159265358979323846264338327950288
+#endif
+
+#define degToRad(angleInDegrees) ((angleInDegrees) * M_PI / 180.0)
+#define radToDeg(angleInRadians) ((angleInRadians) * 180.0 / M_PI)
+
+#define screen_max(a, b) ((a) > (b) ? (a) : (b))
+
+// Range of the POV render scale, relative to the base resolution
+#define SCREEN_RENDER_SCALE_MIN 0.125f
+#define SCREEN_RENDER_SCALE_MAX 2.f
+
+
+/*
+* tv - top view (TV), left
+* pov - first person view (POV), right
+* map - integer coordinates in map
+*/
+
+typedef struct {
+    int POV_PIX_W;
+    int POV_PIX_H;
+
+    int TOP_VIEW_ROWS;
+    int TOP_VIEW_COLS;
+
+    int POV_ROWS;
+    int POV_COLS;
+
+    int SCR_WIDTH;
+    int SCR_HEIGHT;
+
+    float PLAYER_POV;
+
+    // POV size at render scale 1, fixed by screen_init. Resizing the window only
+    // changes the POV's aspect ratio, its texel count stays the same.
+    int RENDER_BASE_COLS;
+    int RENDER_BASE_ROWS;
+
+    // POV texels per base texel on each axis. The shader scales the POV to its half of the window.
+    float RENDER_SCALE;
+
+    // Step angle diff between two rays in radians
+    float RAY_ANGLE_STEP; // theta
+
+    // One entry per POV column, only rebuilt when PLAYER_POV or POV_COLS change
+    // Rotation of the column's ray away from the look dir. The cosine doubles as
+    // the fisheye correction, from distance along the ray to distance along the look dir.
+    float* RAY_COS;
+    float* RAY_SIN;
+
+    int RAY_TABLE_COLS;
+    float RAY_TABLE_POV;
+
+} Screen;
+
+static void screen_set_pov_cols(Screen* scr, int pov_cols) {
+    scr->POV_COLS = pov_cols;
+    scr->RAY_ANGLE_STEP = degToRad( scr->PLAYER_POV / scr->POV_COLS );
+
+    if (scr->RAY_TABLE_COLS == pov_cols && scr->RAY_TABLE_POV == scr->PLAYER_POV) {
+        return;
+    }
+
+    float* cos_tb = realloc(scr->RAY_COS, pov_cols * sizeof(float));
+    float* sin_tb = realloc(scr->RAY_SIN, pov_cols * sizeof(float));
+    if (cos_tb == NULL || sin_tb == NULL) {
+        perror("Fatal error: realloc failed");
+        exit(1);
+    }
+    scr->RAY_COS = cos_tb;
+    scr->RAY_SIN = sin_tb;
+
+    // Rotate fully to the left of pov. Every column gets its angle directly, so no error adds up across the view.
+    float start_angle = degToRad(-scr->PLAYER_POV / 2.f);
+    for (int i = 0; i < pov_cols; ++i) {
+        float angle = start_angle + i * scr->RAY_ANGLE_STEP;
+        scr->RAY_COS[i] = cos(angle);
+        scr->RAY_SIN[i] = sin(angle);
+    }
+
+    scr->RAY_TABLE_COLS = pov_cols;
+    scr->RAY_TABLE_POV = scr->PLAYER_POV;
+}
+
+/*
+* POV size from the base size and RENDER_SCALE, at least one texel.
+* It takes the aspect ratio of the top view, which is the window's half, at the base's texel count,
+* so the number of rays doesn't grow with the window or its DPI.
+*/
+static void screen_applyRenderScale(Screen* scr)
+{
+    float base_aspect = (float)scr->RENDER_BASE_COLS / scr->RENDER_BASE_ROWS;
+    float aspect = (float)scr->TOP_VIEW_COLS / scr->TOP_VIEW_ROWS;
+    float stretch = sqrtf(aspect / base_aspect);
+
+    int pov_cols = (int)(scr->RENDER_BASE_COLS * stretch * scr->RENDER_SCALE + 0.5f);
+    int pov_rows = (int)(scr->RENDER_BASE_ROWS / stretch * scr->RENDER_SCALE + 0.5f);
+
+    screen_set_pov_cols(scr, screen_max(pov_cols, 1));
+    scr->POV_ROWS = screen_max(pov_rows, 1);
+}
+
+void screen_setRenderScale(Screen* scr, float scale)
+{
+    scale = scale < SCREEN_RENDER_SCALE_MIN ? SCREEN_RENDER_SCALE_MIN : scale;
+    scale = scale > SCREEN_RENDER_SCALE_MAX ? SCREEN_RENDER_SCALE_MAX : scale;
+    scr->RENDER_SCALE = scale;
+    screen_applyRenderScale(scr);
+}
+
+// POV size at render scale 1, whatever the window size
+void screen_setRenderBase(Screen* scr, int cols, int rows)
+{
+    scr->RENDER_BASE_COLS = screen_max(cols, 1);
+    scr->RENDER_BASE_ROWS = screen_max(rows, 1);
+    screen_applyRenderScale(scr);
+}
+
+/*
+* Top view and POV of cols x rows texels, no window involved.
+* The window size it implies is what the viewer would open.
+*/
+void screen_init(Screen* scr, int cols, int rows, float pov)
+{
+    memset(scr, 0, sizeof(Screen));
+
+    scr->PLAYER_POV = pov;
+    scr->RENDER_SCALE = 1.f;
+
+    scr->TOP_VIEW_COLS = cols;
+    scr->TOP_VIEW_ROWS = rows;
+
+    scr->RENDER_BASE_COLS = cols;
+    scr->RENDER_BASE_ROWS = rows;
+
+    screen_set_pov_cols(scr, cols);
+    scr->POV_ROWS = rows;
+
+    scr->SCR_WIDTH = scr->TOP_VIEW_COLS * TOP_VIEW_PIX_W * 2;
+    scr->SCR_HEIGHT = scr->TOP_VIEW_ROWS * TOP_VIEW_PIX_H;
+
+    int half_screen_w = scr->TOP_VIEW_COLS * TOP_VIEW_PIX_W;
+
+    scr->POV_PIX_W = half_screen_w / scr->POV_COLS;
+    scr->POV_PIX_H = scr->POV_PIX_W;
+}
+
+void screen_reset(Screen* scr, int width, int height)
+{
+    // At least 4, if a texel should be bigger, then round to more
+    // Mutpily by 2 to avoid having texture of uneven dimensions (probably bad for OpenGL?)
+    static int screen_round_to = screen_max(screen_max(TOP_VIEW_PIX_W * 2, TOP_VIEW_PIX_H * 2), 4);
+
+    // Window dimensions must be aligned to multiple of 4
+    // because OpenGL doesn't correctly display textures with dimensions unaligned to 4
+    if (width != scr->SCR_WIDTH && width % screen_round_to != 0) {
+        if (width > scr->SCR_WIDTH) {
+            width += screen_round_to - width % screen_round_to;
+        } else {
+            width -= width % screen_round_to;
+        }
+    }
+
+    if (height != scr->SCR_HEIGHT && height % screen_round_to != 0) {
+        if (height > scr->SCR_HEIGHT) {
+            height += screen_round_to - height % screen_round_to;
+        } else {
+            height -= height % screen_round_to;
+        }
+    }
+
+    scr->SCR_WIDTH = width * 2;
+    scr->SCR_HEIGHT = height;
+
+    scr->TOP_VIEW_COLS = width / TOP_VIEW_PIX_W;
+    scr->TOP_VIEW_ROWS = height / TOP_VIEW_PIX_H;
+
+    // The top view follows the window, the POV keeps its base size and only follows the aspect ratio
+    screen_applyRenderScale(scr);
+
+    printf("Screen WIDTH: %d\n", scr->SCR_WIDTH);
+    printf("Screen HEIGHT: %d\n", scr->SCR_HEIGHT);
+    printf("\n\n");
+}
+
+void screen_destroy(Screen* scr)
+{
+    free(scr->RAY_COS);
+    free(scr->RAY_SIN);
+    scr->RAY_COS = NULL;
+    scr->RAY_SIN = NULL;
+    scr->RAY_TABLE_COLS = 0;
+}
+
+#endif // _SCREEN_H_
@@ -2,17 +2,43 @@
 #define _TEXTURE_BUFFER_H_
 
 #include "stdbool.h"
+#include "stdint.h"
+#include "limits.h"
 #include "stdlib.h"
+#include "string.h"
+#include "stdio.h"
 #include "assert.h"
 
-#include "glad/glad.h"
+#include "cpu.h"
 
+/*
+* Pixel format, picked at configure time with RAYC_PIXEL_FORMAT.
+* RGB24 is 3 bytes per pixel. BGRA32 is 4 bytes in the order of
+* GL_BGRA + GL_UNSIGNED_INT_8_8_8_8_REV, which is how drivers store
+* RGBA8 textures, so uploads don't have to unpack and swizzle.
+* Always build pixels with PIXEL_INIT, the member order differs.
+*/
+#ifdef RAYC_PIXEL_BGRA32
+typedef struct {
+    unsigned char b;
+    unsigned char g;
+    unsigned char r;
+    unsigned char a;
+} Pixel;
+
+#define PIXEL_FORMAT_NAME "bgra32"
+#define PIXEL_INIT(r_, g_, b_) { .r = (r_), .g = (g_), .b = (b_), .a = 255 }
+#else
 typedef struct {
     unsigned char r;
     unsigned char g;
     unsigned char b;
 } Pixel;
 
+#define PIXEL_FORMAT_NAME "rgb24"
+#define PIXEL_INIT(r_, g_, b_) { .r = (r_), .g = (g_), .b = (b_) }
+#endif
+
 Pixel pixel_mulf(Pixel p, float f)
 {
     p.r *= f;
@@ -21,22 +47,273 @@ Pixel pixel_mulf(Pixel p, float f)
     return p;
 }
 
+// Integer BT.601 luma
+static inline unsigned char pixel_luma(Pixel p) {
+    return (unsigned char)((77 * p.r + 150 * p.g + 29 * p.b) >> 8);
+}
+
+// A whole number of pixels and of 16 and 32 byte vectors, for both formats
+#define PIXEL_PATTERN_BYTES 96
+
+// Spans shorter than this are filled one pixel at a time
+#define PIXEL_FILL_MIN_SIMD 32
+
+// Fills this large don't fit in cache anyway, they bypass it with streaming stores
+#define PIXEL_FILL_STREAM_BYTES (1 << 20)
+
+#ifdef CPU_X86
+// Both kernels store whole patterns to vector-aligned dst and return the bytes written
+CPU_TARGET_SSE2
+static size_t pixel_fillSse2(unsigned char* dst, size_t bytes, const unsigned char* pattern) {
+    __m128i a = _mm_loadu_si128((const __m128i*)pattern);
+    __m128i b = _mm_loadu_si128((const __m128i*)(pattern + 16));
+    __m128i c = _mm_loadu_si128((const __m128i*)(pattern + 32));
+
+    size_t done = 0;
+    if (bytes >= PIXEL_FILL_STREAM_BYTES) {
+        for (; done + 48 <= bytes; done += 48) {
+            _mm_stream_si128((__m128i*)(dst + done), a);
+            _mm_stream_si128((__m128i*)(dst + done + 16), b);
+            _mm_stream_si128((__m128i*)(dst + done + 32), c);
+        }
+        _mm_sfence();
+        return done;
+    }
+    for (; done + 48 <= bytes; done += 48) {
+        _mm_store_si128((__m128i*)(dst + done), a);
+        _mm_store_si128((__m128i*)(dst + done + 16), b);
+        _mm_store_si128((__m128i*)(dst + done + 32), c);
+    }
+    return done;
+}
+
+CPU_TARGET_AVX2
+static size_t pixel_fillAvx2(unsigned char* dst, size_t bytes, const unsigned char* pattern) {
+    __m256i a = _mm256_loadu_si256((const __m256i*)pattern);
+    __m256i b = _mm256_loadu_si256((const __m256i*)(pattern + 32));
+    __m256i c = _mm256_loadu_si256((const __m256i*)(pattern + 64));
+
+    size_t done = 0;
+    if (bytes >= PIXEL_FILL_STREAM_BYTES) {
+        for (; done + 96 <= bytes; done += 96) {
+            _mm256_stream_si256((__m256i*)(dst + done), a);
+            _mm256_stream_si256((__m256i*)(dst + done + 32), b);
+            _mm256_stream_si256((__m256i*)(dst + done + 64), c);
+        }
+        _mm_sfence();
+        return done;
+    }
+    for (; done + 96 <= bytes; done += 96) {
+        _mm256_store_si256((__m256i*)(dst + done), a);
+        _mm256_store_si256((__m256i*)(dst + done + 32), b);
+        _mm256_store_si256((__m256i*)(dst + done + 64), c);
+    }
+    return done;
+}
+#endif
+
+/*
+* Writes p to n consecutive pixels. A few pixels are written one by one until
+* dst is vector-aligned, 3 byte pixels get there too since 3 and 16 are coprime,
+* then the kernel repeats a pattern of whole pixels.
+*/
+void pixel_fill(Pixel* dst, size_t n, Pixel p, CpuSimd simd) {
+#ifdef CPU_X86
+    if (simd != CPU_SIMD_NONE && n >= PIXEL_FILL_MIN_SIMD) {
+        uintptr_t vec = simd == CPU_SIMD_AVX2 ? 32 : 16;
+        while (((uintptr_t)dst & (vec - 1)) != 0 && n > 0) {
+            *dst++ = p;
+            --n;
+        }
+
+        unsigned char pattern[PIXEL_PATTERN_BYTES];
+        for (size_t i = 0; i < PIXEL_PATTERN_BYTES; i += sizeof(Pixel)) {
+            memcpy(pattern + i, &p, sizeof(Pixel));
+        }
+
+        size_t bytes = n * sizeof(Pixel);
+        size_t done = simd == CPU_SIMD_AVX2 ? pixel_fillAvx2((unsigned char*)dst, bytes, pattern)
+                                            : pixel_fillSse2((unsigned char*)dst, bytes, pattern);
+        dst += done / sizeof(Pixel);
+        n -= done / sizeof(Pixel);
+    }
+#else
+    (void)simd;
+#endif
+    for (size_t i = 0; i < n; ++i) {
+        dst[i] = p;
+    }
+}
+
+/*
+* Order of pixels in TextureBuffer.data. x and y are the same in both,
+* only the memory layout changes.
+*/
+typedef enum {
+    TEXTURE_LAYOUT_ROW_MAJOR,    // data[x + y * width], what GL expects
+    TEXTURE_LAYOUT_COLUMN_MAJOR, // data[y + x * height], a column is contiguous
+    TEXTURE_LAYOUT_COUNT
+} TextureLayout;
+
+const char* textureLayout_name(TextureLayout layout) {
+    switch (layout) {
+    case TEXTURE_LAYOUT_ROW_MAJOR:    return "row";
+    case TEXTURE_LAYOUT_COLUMN_MAJOR: return "column";
+    default:                          return "unknown";
+    }
+}
+
+bool textureLayout_parse(const char* name, TextureLayout* layout) {
+    for (int l = 0; l < TEXTURE_LAYOUT_COUNT; ++l) {
+        if (strcmp(name, textureLayout_name(l)) == 0) {
+            *layout = l;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Slots in the streaming upload ring of texture_buffer_gl.h
+#define TEXTURE_BUFFER_PBO_RING 3
+
+// Written part [lo, hi) of one line of memory, empty when lo >= hi
+typedef struct {
+    int lo;
+    int hi;
+} TextureSpan;
+
+#define TEXTURE_SPAN_EMPTY ((TextureSpan){ INT_MAX, 0 })
+
+// Rectangle in memory coordinates: x along a line of memory, y across lines
+typedef struct {
+    int x;
+    int y;
+    int w;
+    int h;
+} TextureRect;
+
 typedef struct {
     unsigned int gl_tex_id;
     unsigned int gl_tex_unit;
+    // Allocated texture size, in texture orientation. Uploads only fill the part the buffer covers.
+    int gl_tex_width;
+    int gl_tex_height;
 
     bool gl_tex_init;
 
+    // Persistently mapped upload ring, 0 if unused. While it exists data points into its current slot.
+    unsigned int gl_pbo_id;
+    unsigned char* gl_pbo_map;
+    size_t gl_pbo_slot_bytes;
+    int gl_pbo_slot;
+    void* gl_pbo_fences[TEXTURE_BUFFER_PBO_RING]; // GLsync of the last upload from each slot
+
     bool updated_this_frame;
-    
+
+    /*
+    * Dirty tracking per line of memory, a row or a column when column-major,
+    * see textureBuffer_beginFrame. Slot spans are what each ring slot shows
+    * on top of the background, changed spans what the upload has to send.
+    */
+    TextureSpan* dirty_slots; // TEXTURE_BUFFER_PBO_RING * dirty_lines
+    TextureSpan* dirty_changed;
+    int dirty_lines; // Capacity, enough for either layout
+    int dirty_last_slot;
+    // Background the slot spans are relative to, a color or a layer (see textureBuffer_beginFrameOver)
+    Pixel dirty_clear;
+    const Pixel* dirty_background;
+
     int width;
     int height;
+    size_t capacity; // Pixels data has room for, see textureBuffer_resize
+    // Bumped by every clear, also behind resets, resizes and layout changes.
+    // Lets caches of what the buffer shows tell that it no longer does.
+    unsigned int epoch;
+
+    TextureLayout layout;
+
+    // Kernels used by clear and the span fills
+    CpuSimd simd;
 
     Pixel* data;
 } TextureBuffer;
 
 void textureBuffer_clear(TextureBuffer* tb, Pixel col);
 
+// Alignment of TextureBuffer.data, a cache line so clears and rows start on vector boundaries
+#define TEXTURE_BUFFER_ALIGN 64
+
+// Size of the pixels rounded up to the alignment, aligned allocators and ring slots want a multiple of it
+static size_t textureBuffer_allocBytes(int width, int height) {
+    size_t bytes = (size_t)width * height * sizeof(Pixel);
+    return (bytes + TEXTURE_BUFFER_ALIGN - 1) & ~(size_t)(TEXTURE_BUFFER_ALIGN - 1);
+}
+
+static Pixel* textureBuffer_alloc(int width, int height) {
+    size_t bytes = textureBuffer_allocBytes(width, height);
+
+    void* tmp = NULL;
+#ifdef _WIN32
+    tmp = _aligned_malloc(bytes, TEXTURE_BUFFER_ALIGN);
+#else
+    if (posix_memalign(&tmp, TEXTURE_BUFFER_ALIGN, bytes) != 0) {
+        tmp = NULL;
+    }
+#endif
+    if (tmp == NULL) {
+        perror("Fatal error: aligned allocation failed");
+        exit(1);
+    }
+    return tmp;
+}
+
+static void textureBuffer_free(Pixel* data) {
+#ifdef _WIN32
+    _aligned_free(data);
+#else
+    free(data);
+#endif
+}
+
+// Lines of memory and pixels per line in the current layout
+static inline int textureBuffer_lines(const TextureBuffer* tb) {
+    return tb->layout == TEXTURE_LAYOUT_COLUMN_MAJOR ? tb->width : tb->height;
+}
+
+static inline int textureBuffer_lineLength(const TextureBuffer* tb) {
+    return tb->layout == TEXTURE_LAYOUT_COLUMN_MAJOR ? tb->height : tb->width;
+}
+
+// Slot of the upload ring data points into, 0 without a ring
+static inline int textureBuffer_slot(const TextureBuffer* tb) {
+    return tb->gl_pbo_map != NULL ? tb->gl_pbo_slot : 0;
+}
+
+static void textureBuffer_allocDirty(TextureBuffer* tb) {
+    tb->dirty_lines = tb->width > tb->height ? tb->width : tb->height;
+
+    TextureSpan* slots = realloc(tb->dirty_slots, (size_t)TEXTURE_BUFFER_PBO_RING * tb->dirty_lines * sizeof(TextureSpan));
+    TextureSpan* changed = realloc(tb->dirty_changed, (size_t)tb->dirty_lines * sizeof(TextureSpan));
+    if (slots == NULL || changed == NULL) {
+        perror("Fatal error: realloc failed");
+        exit(1);
+    }
+    tb->dirty_slots = slots;
+    tb->dirty_changed = changed;
+}
+
+// Every slot may show anything and all of it has to be uploaded
+void textureBuffer_dirtyAll(TextureBuffer* tb) {
+    TextureSpan full = { 0, textureBuffer_lineLength(tb) };
+    for (int i = 0; i < TEXTURE_BUFFER_PBO_RING * tb->dirty_lines; ++i) {
+        tb->dirty_slots[i] = full;
+    }
+    for (int l = 0; l < tb->dirty_lines; ++l) {
+        tb->dirty_changed[l] = full;
+    }
+    tb->updated_this_frame = true;
+}
+
 void textureBuffer_init(TextureBuffer* tb, int width, int height) {
     memset(tb, 0, sizeof(TextureBuffer));
     tb->data = NULL;
@@ -46,66 +323,261 @@ void textureBuffer_init(TextureBuffer* tb, int width, int height) {
     tb->updated_this_frame = false;
     tb->width = width;
     tb->height = height;
+    tb->simd = cpu_detectSimd();
 
-    assert(sizeof(Pixel) == 3);
+    tb->data = textureBuffer_alloc(tb->width, tb->height);
+    tb->capacity = (size_t)width * height;
+    textureBuffer_allocDirty(tb);
 
-    void* tmp = malloc(tb->width * tb->height * sizeof(Pixel));
-    if (tmp == NULL) {
-        perror("Fatal error: malloc failed");
-        exit(1);
+    Pixel magenta = PIXEL_INIT(255, 0, 255);
+
+    textureBuffer_clear(tb, magenta);
+}
+
+// The upload ring owns data while it exists, textureBuffer_glStreamDestroy gives it back
+void textureBuffer_destroy(TextureBuffer* tb) {
+    assert(tb->gl_pbo_map == NULL);
+    textureBuffer_free(tb->data);
+    free(tb->dirty_slots);
+    free(tb->dirty_changed);
+    tb->data = NULL;
+    tb->dirty_slots = NULL;
+    tb->dirty_changed = NULL;
+}
+
+// The buffer is contiguous in both layouts, so it is one long span
+void textureBuffer_clear(TextureBuffer* tb, Pixel col) {
+    pixel_fill(tb->data, (size_t)tb->width * tb->height, col, tb->simd);
+    ++tb->epoch;
+
+    // Other ring slots still show something else
+    textureBuffer_dirtyAll(tb);
+    tb->dirty_clear = col;
+    tb->dirty_background = NULL;
+}
+
+// Records that [lo, hi) of a memory line was written this frame
+static inline void textureBuffer_markSpan(TextureBuffer* tb, int line, int lo, int hi) {
+    TextureSpan* cur = &tb->dirty_slots[textureBuffer_slot(tb) * tb->dirty_lines + line];
+    TextureSpan* changed = &tb->dirty_changed[line];
+    cur->lo = lo < cur->lo ? lo : cur->lo;
+    cur->hi = hi > cur->hi ? hi : cur->hi;
+    changed->lo = lo < changed->lo ? lo : changed->lo;
+    changed->hi = hi > changed->hi ? hi : changed->hi;
+    tb->updated_this_frame = true;
+}
+
+// For frames that write every pixel, in place of marking each write
+void textureBuffer_markAllDirty(TextureBuffer* tb) {
+    TextureSpan full = { 0, textureBuffer_lineLength(tb) };
+    TextureSpan* cur = &tb->dirty_slots[textureBuffer_slot(tb) * tb->dirty_lines];
+    int lines = textureBuffer_lines(tb);
+    for (int l = 0; l < lines; ++l) {
+        cur[l] = full;
+        tb->dirty_changed[l] = full;
     }
-    tb->data = tmp;
+    tb->updated_this_frame = true;
+}
 
-    assert(sizeof(Pixel) == 3);
+// Resets the spans the current slot shows to the background, a layer if there is one, else col
+static void textureBuffer_beginFrameWith(TextureBuffer* tb, const TextureBuffer* layer, Pixel col, bool overwrite) {
+    const Pixel* background = layer != NULL ? layer->data : NULL;
+    bool new_background = background != tb->dirty_background ||
+                          (background == NULL && memcmp(&col, &tb->dirty_clear, sizeof(Pixel)) != 0);
+    if (!overwrite && new_background) {
+        // Every pixel changes
+        textureBuffer_dirtyAll(tb);
+        tb->dirty_clear = col;
+        tb->dirty_background = background;
+    }
 
-    Pixel magenta = { 255, 0, 255 };
+    int lines = textureBuffer_lines(tb);
+    int len = textureBuffer_lineLength(tb);
+    int slot = textureBuffer_slot(tb);
+    const TextureSpan* last = &tb->dirty_slots[tb->dirty_last_slot * tb->dirty_lines];
+    TextureSpan* cur = &tb->dirty_slots[slot * tb->dirty_lines];
 
-    textureBuffer_clear(tb, magenta);
+    bool changed = false;
+    for (int l = 0; l < lines; ++l) {
+        tb->dirty_changed[l] = last[l];
+        changed |= last[l].lo < last[l].hi;
+    }
+
+    for (int l = 0; l < lines; ++l) {
+        if (!overwrite && cur[l].lo < cur[l].hi) {
+            size_t i = (size_t)l * len + cur[l].lo;
+            size_t n = cur[l].hi - cur[l].lo;
+            if (background != NULL) {
+                memcpy(tb->data + i, background + i, n * sizeof(Pixel));
+            } else {
+                pixel_fill(tb->data + i, n, col, tb->simd);
+            }
+        }
+        cur[l] = TEXTURE_SPAN_EMPTY;
+    }
+
+    tb->dirty_last_slot = slot;
+    tb->updated_this_frame = changed;
 }
 
-void textureBuffer_clear(TextureBuffer* tb, Pixel col) {
-    for (int h = 0; h < tb->height; ++h) {
-        for (int w = 0; w < tb->width; ++w) {
-            tb->data[w + h * tb->width] = col;
+/*
+* Starts a frame drawn over a background of col, in place of clearing the buffer.
+* Only the lines the current slot still shows from the last frame drawn into it
+* are reset to col, and what the previous frame drew is marked changed because
+* it goes back to the background. With overwrite the frame writes every pixel
+* itself (and marks them with textureBuffer_markAllDirty), so nothing is cleared.
+* Between beginFrame and the upload, writes are tracked by setPixel only,
+* writePixel and the span fills leave that to the caller.
+*/
+void textureBuffer_beginFrame(TextureBuffer* tb, Pixel col, bool overwrite) {
+    textureBuffer_beginFrameWith(tb, NULL, col, overwrite);
+}
+
+/*
+* Like textureBuffer_beginFrame over a static image instead of a color, the
+* reset spans are copied from layer. layer has the same size and layout as tb.
+* When pixels of layer change, textureBuffer_invalidateRect brings them over.
+*/
+void textureBuffer_beginFrameOver(TextureBuffer* tb, const TextureBuffer* layer) {
+    assert(layer->width == tb->width && layer->height == tb->height && layer->layout == tb->layout);
+    Pixel none = PIXEL_INIT(0, 0, 0);
+    textureBuffer_beginFrameWith(tb, layer, none, false);
+}
+
+// Pixels [x0, x1) x [y0, y1) are reset and uploaded again by the next frame of every slot
+void textureBuffer_invalidateRect(TextureBuffer* tb, int x0, int y0, int x1, int y1) {
+    x0 = x0 < 0 ? 0 : x0;
+    y0 = y0 < 0 ? 0 : y0;
+    x1 = x1 > tb->width ? tb->width : x1;
+    y1 = y1 > tb->height ? tb->height : y1;
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+
+    bool column_major = tb->layout == TEXTURE_LAYOUT_COLUMN_MAJOR;
+    int l0 = column_major ? x0 : y0;
+    int l1 = column_major ? x1 : y1;
+    int lo = column_major ? y0 : x0;
+    int hi = column_major ? y1 : x1;
+
+    for (int slot = 0; slot < TEXTURE_BUFFER_PBO_RING; ++slot) {
+        TextureSpan* spans = &tb->dirty_slots[slot * tb->dirty_lines];
+        for (int l = l0; l < l1; ++l) {
+            spans[l].lo = lo < spans[l].lo ? lo : spans[l].lo;
+            spans[l].hi = hi > spans[l].hi ? hi : spans[l].hi;
+        }
+    }
+}
+
+// Upload rectangles per frame at most
+#define TEXTURE_BUFFER_MAX_RECTS 8
+
+static TextureRect textureRect_union(TextureRect a, TextureRect b) {
+    int x0 = a.x < b.x ? a.x : b.x;
+    int y0 = a.y < b.y ? a.y : b.y;
+    int x1 = a.x + a.w > b.x + b.w ? a.x + a.w : b.x + b.w;
+    int y1 = a.y + a.h > b.y + b.h ? a.y + a.h : b.y + b.h;
+    return (TextureRect){ x0, y0, x1 - x0, y1 - y0 };
+}
+
+/*
+* Covers the changed spans with at most max_rects rectangles. Every run of
+* changed lines is one rectangle, past max_rects the two neighbours with
+* the fewest unchanged lines between them are merged.
+*/
+int textureBuffer_changedRects(const TextureBuffer* tb, TextureRect* rects, int max_rects) {
+    int n = 0;
+    int lines = textureBuffer_lines(tb);
+    for (int l = 0; l < lines; ++l) {
+        TextureSpan s = tb->dirty_changed[l];
+        if (s.lo >= s.hi) {
+            continue;
+        }
+
+        TextureRect r = { s.lo, l, s.hi - s.lo, 1 };
+        if (n > 0 && rects[n - 1].y + rects[n - 1].h == l) {
+            rects[n - 1] = textureRect_union(rects[n - 1], r);
+            continue;
         }
+
+        if (n == max_rects) {
+            // The last gap is the one to the new run
+            int best = n - 1;
+            int best_gap = l - (rects[n - 1].y + rects[n - 1].h);
+            for (int i = 0; i + 1 < n; ++i) {
+                int gap = rects[i + 1].y - (rects[i].y + rects[i].h);
+                if (gap < best_gap) {
+                    best_gap = gap;
+                    best = i;
+                }
+            }
+
+            if (best == n - 1) {
+                rects[n - 1] = textureRect_union(rects[n - 1], r);
+                continue;
+            }
+            rects[best] = textureRect_union(rects[best], rects[best + 1]);
+            memmove(&rects[best + 1], &rects[best + 2], (n - best - 2) * sizeof(TextureRect));
+            --n;
+        }
+        rects[n++] = r;
     }
+    return n;
 }
 
+static inline size_t textureBuffer_index(const TextureBuffer* tb, int x, int y) {
+    return tb->layout == TEXTURE_LAYOUT_COLUMN_MAJOR ? y + (size_t)x * tb->height
+                                                     : x + (size_t)y * tb->width;
+}
+
+// Contents are undefined in the new layout, so the buffer is cleared like after init
+void textureBuffer_setLayout(TextureBuffer* tb, TextureLayout layout) {
+    tb->layout = layout;
+
+    Pixel magenta = PIXEL_INIT(255, 0, 255);
+
+    textureBuffer_clear(tb, magenta);
+}
 
 void textureBuffer_reset(TextureBuffer* tb, int width, int height) {
     tb->width = width;
     tb->height = height;
 
-    void* tmp = realloc(tb->data, tb->width * tb->height * sizeof(Pixel));
-    if (tmp == NULL) {
-        perror("Fatal error: realloc failed");
-        exit(1);
-    }
-    tb->data = tmp;
+    assert(tb->gl_pbo_map == NULL);
 
-    assert(sizeof(Pixel) == 3);
+    // No aligned realloc, the contents are cleared anyway
+    textureBuffer_free(tb->data);
+    tb->data = textureBuffer_alloc(tb->width, tb->height);
+    tb->capacity = (size_t)width * height;
+    textureBuffer_allocDirty(tb);
 
-    Pixel magenta = {255, 0, 255};
+    Pixel magenta = PIXEL_INIT(255, 0, 255);
 
     textureBuffer_clear(tb, magenta);
-
-    //https://stackoverflow.com/questions/8866904/differences-and-relationship-between-glactivetexture-and-glbindtexture
-    glActiveTexture(GL_TEXTURE0 + tb->gl_tex_unit);
-    // Update the texture size on GPU
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, tb->width, tb->height, 0, GL_RGB, GL_UNSIGNED_BYTE, tb->data);
 }
 
-void textureBuffer_loadTexData(TextureBuffer* tb) {
-    assert(tb->gl_tex_init);
+/*
+* Changes the size within the current allocation, lines are packed at the new length.
+* Works with the upload ring too. Returns false and changes nothing if the size doesn't fit,
+* textureBuffer_reset has to grow the buffer then.
+*/
+bool textureBuffer_resize(TextureBuffer* tb, int width, int height) {
+    int lines = width > height ? width : height;
+    if ((size_t)width * height > tb->capacity || lines > tb->dirty_lines) {
+        return false;
+    }
 
-    glActiveTexture(GL_TEXTURE0 + tb->gl_tex_unit);
-    glBindTexture(GL_TEXTURE_2D, tb->gl_tex_id);
+    tb->width = width;
+    tb->height = height;
 
-    // Load texture to GPU. Fails if size is different so we game sure glTexImage2D is called before.
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, tb->width, tb->height, GL_RGB, GL_UNSIGNED_BYTE, tb->data);
+    Pixel magenta = PIXEL_INIT(255, 0, 255);
+
+    textureBuffer_clear(tb, magenta);
+    return true;
 }
 
-void textureBuffer_setPixel(TextureBuffer* tb, int x, int y, Pixel p) {
+// Doesn't touch updated_this_frame or the dirty spans, so threads can write disjoint pixels concurrently
+void textureBuffer_writePixel(TextureBuffer* tb, int x, int y, Pixel p) {
     if (x < 0 || x >= tb->width ||
         y < 0 || y >= tb->height) {
         return;
@@ -114,8 +586,230 @@ void textureBuffer_setPixel(TextureBuffer* tb, int x, int y, Pixel p) {
     assert(x > -1 && x < tb->width);
     assert(y > -1 && y < tb->height);
 
-    tb->data[x + y * tb->width] = p;
-    tb->updated_this_frame = true;
+    tb->data[textureBuffer_index(tb, x, y)] = p;
+}
+
+void textureBuffer_setPixel(TextureBuffer* tb, int x, int y, Pixel p) {
+    if (x < 0 || x >= tb->width ||
+        y < 0 || y >= tb->height) {
+        return;
+    }
+
+    textureBuffer_writePixel(tb, x, y, p);
+
+    if (tb->layout == TEXTURE_LAYOUT_COLUMN_MAJOR) {
+        textureBuffer_markSpan(tb, x, y, y + 1);
+    } else {
+        textureBuffer_markSpan(tb, y, x, x + 1);
+    }
+}
+
+/*
+* Span API: vertical runs of rows [y0, y1) in column x, clipped once per span
+* instead of per pixel. Empty or fully clipped spans are no-ops.
+* Like writePixel they don't touch updated_this_frame or the dirty spans.
+*/
+static inline bool textureBuffer_clipSpan(const TextureBuffer* tb, int x, int* y0, int* y1) {
+    if (x < 0 || x >= tb->width) {
+        return false;
+    }
+    if (*y0 < 0) {
+        *y0 = 0;
+    }
+    if (*y1 > tb->height) {
+        *y1 = tb->height;
+    }
+    return *y0 < *y1;
+}
+
+void textureBuffer_fillColumn(TextureBuffer* tb, int x, int y0, int y1, Pixel p) {
+    if (!textureBuffer_clipSpan(tb, x, &y0, &y1)) {
+        return;
+    }
+
+    if (tb->layout == TEXTURE_LAYOUT_COLUMN_MAJOR) {
+        pixel_fill(tb->data + textureBuffer_index(tb, x, y0), y1 - y0, p, tb->simd);
+        return;
+    }
+
+    Pixel* dst = tb->data + x + (size_t)y0 * tb->width;
+    for (int y = y0; y < y1; ++y, dst += tb->width) {
+        *dst = p;
+    }
+}
+
+// Columns [x0, x1) of row y, contiguous unless the buffer is column-major
+void textureBuffer_fillRow(TextureBuffer* tb, int y, int x0, int x1, Pixel p) {
+    if (y < 0 || y >= tb->height) {
+        return;
+    }
+    x0 = x0 < 0 ? 0 : x0;
+    x1 = x1 > tb->width ? tb->width : x1;
+    if (x0 >= x1) {
+        return;
+    }
+
+    if (tb->layout == TEXTURE_LAYOUT_ROW_MAJOR) {
+        pixel_fill(tb->data + textureBuffer_index(tb, x0, y), x1 - x0, p, tb->simd);
+        return;
+    }
+
+    Pixel* dst = tb->data + textureBuffer_index(tb, x0, y);
+    for (int x = x0; x < x1; ++x, dst += tb->height) {
+        *dst = p;
+    }
+}
+
+// fillRow that records the write like setPixel, for single-threaded drawing
+void textureBuffer_setRow(TextureBuffer* tb, int y, int x0, int x1, Pixel p) {
+    x0 = x0 < 0 ? 0 : x0;
+    x1 = x1 > tb->width ? tb->width : x1;
+    if (y < 0 || y >= tb->height || x0 >= x1) {
+        return;
+    }
+
+    textureBuffer_fillRow(tb, y, x0, x1, p);
+
+    if (tb->layout == TEXTURE_LAYOUT_ROW_MAJOR) {
+        textureBuffer_markSpan(tb, y, x0, x1);
+        return;
+    }
+    for (int x = x0; x < x1; ++x) {
+        textureBuffer_markSpan(tb, x, y, y + 1);
+    }
+}
+
+// Blends linearly from c0 at row y0 to c1 at row y1 - 1, clipping keeps the blend of the whole span
+void textureBuffer_fillColumnGradient(TextureBuffer* tb, int x, int y0, int y1, Pixel c0, Pixel c1) {
+    int len = y1 - y0;
+    int first = y0;
+    if (!textureBuffer_clipSpan(tb, x, &y0, &y1)) {
+        return;
+    }
+
+    // 16.16 fixed point per channel, one add per channel and pixel
+    int div = len > 1 ? len - 1 : 1;
+    int dr = ((c1.r - c0.r) * 65536) / div;
+    int dg = ((c1.g - c0.g) * 65536) / div;
+    int db = ((c1.b - c0.b) * 65536) / div;
+
+    int skip = y0 - first;
+    int r = c0.r * 65536 + dr * skip + 32768;
+    int g = c0.g * 65536 + dg * skip + 32768;
+    int b = c0.b * 65536 + db * skip + 32768;
+
+    int stride = tb->layout == TEXTURE_LAYOUT_COLUMN_MAJOR ? 1 : tb->width;
+
+    Pixel* dst = tb->data + textureBuffer_index(tb, x, y0);
+    for (int y = y0; y < y1; ++y, dst += stride) {
+        *dst = (Pixel)PIXEL_INIT(r >> 16, g >> 16, b >> 16);
+        r += dr;
+        g += dg;
+        b += db;
+    }
+}
+
+// Side of the square tiles the transpose goes through
+#define TEXTURE_BUFFER_TRANSPOSE_BLOCK 64
+
+/*
+* Copies the pixels to dst in row-major order, which is what GL uploads expect.
+* Column-major buffers are transposed tile by tile, so the source columns
+* of a tile stay cached while its destination rows are written in order.
+*/
+void textureBuffer_copyRowMajor(const TextureBuffer* tb, Pixel* dst) {
+    if (tb->layout == TEXTURE_LAYOUT_ROW_MAJOR) {
+        memcpy(dst, tb->data, (size_t)tb->width * tb->height * sizeof(Pixel));
+        return;
+    }
+
+    const int block = TEXTURE_BUFFER_TRANSPOSE_BLOCK;
+    for (int x0 = 0; x0 < tb->width; x0 += block) {
+        int x1 = x0 + block < tb->width ? x0 + block : tb->width;
+        for (int y0 = 0; y0 < tb->height; y0 += block) {
+            int y1 = y0 + block < tb->height ? y0 + block : tb->height;
+            for (int y = y0; y < y1; ++y) {
+                const Pixel* src = tb->data + y + (size_t)x0 * tb->height;
+                Pixel* out = dst + x0 + (size_t)y * tb->width;
+                for (int x = x0; x < x1; ++x, src += tb->height) {
+                    *out++ = *src;
+                }
+            }
+        }
+    }
+}
+
+// Pixels in row-major order, a copy only for column-major buffers. Free with textureBuffer_freeRowMajor.
+static const Pixel* textureBuffer_rowMajor(const TextureBuffer* tb) {
+    if (tb->layout == TEXTURE_LAYOUT_ROW_MAJOR) {
+        return tb->data;
+    }
+    Pixel* copy = malloc((size_t)tb->width * tb->height * sizeof(Pixel));
+    if (copy == NULL) {
+        perror("Fatal error: malloc failed");
+        exit(1);
+    }
+    textureBuffer_copyRowMajor(tb, copy);
+    return copy;
+}
+
+static void textureBuffer_freeRowMajor(const TextureBuffer* tb, const Pixel* pixels) {
+    if (pixels != tb->data) {
+        free((void*)pixels);
+    }
+}
+
+// Row 0 is the bottom of the texture, so rows are written in reverse
+int textureBuffer_writePPM(const TextureBuffer* tb, const char* filename) {
+    FILE* file = fopen(filename, "wb");
+    if (file == NULL) {
+        printf("Failed to open file: %s\n", filename);
+        return -1;
+    }
+
+    const Pixel* pixels = textureBuffer_rowMajor(tb);
+
+    // PPM is RGB whatever the pixel format
+    unsigned char* line = malloc((size_t)tb->width * 3);
+    if (line == NULL) {
+        perror("Fatal error: malloc failed");
+        exit(1);
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", tb->width, tb->height);
+    for (int h = tb->height - 1; h >= 0; --h) {
+        const Pixel* src = &pixels[(size_t)h * tb->width];
+        for (int w = 0; w < tb->width; ++w) {
+            line[w * 3 + 0] = src[w].r;
+            line[w * 3 + 1] = src[w].g;
+            line[w * 3 + 2] = src[w].b;
+        }
+        fwrite(line, 3, tb->width, file);
+    }
+
+    free(line);
+    textureBuffer_freeRowMajor(tb, pixels);
+    fclose(file);
+    return 0;
+}
+
+/*
+* FNV-1a over the pixels in row-major order, for comparing frames between builds and layouts.
+* Only r, g and b are hashed in that order, so both pixel formats give the same hashes.
+*/
+unsigned long long textureBuffer_hash(const TextureBuffer* tb) {
+    const Pixel* pixels = textureBuffer_rowMajor(tb);
+
+    unsigned long long hash = 14695981039346656037ULL;
+    size_t len = (size_t)tb->width * tb->height;
+    for (size_t i = 0; i < len; ++i) {
+        hash = (hash ^ pixels[i].r) * 1099511628211ULL;
+        hash = (hash ^ pixels[i].g) * 1099511628211ULL;
+        hash = (hash ^ pixels[i].b) * 1099511628211ULL;
+    }
+
+    textureBuffer_freeRowMajor(tb, pixels);
+    return hash;
 }
 
 #endif // _TEXTURE_BUFFER_H_
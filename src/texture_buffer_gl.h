@@ -0,0 +1,270 @@
+#ifndef _TEXTURE_BUFFER_GL_H_
+#define _TEXTURE_BUFFER_GL_H_
+
+#include "glad/glad.h"
+
+#include "texture_buffer.h"
+
+/*
+* OpenGL side of TextureBuffer. Only the viewer includes this,
+* everything in texture_buffer.h works without a GL context.
+* Column-major buffers are uploaded as they are, so the texture is
+* height x width and the shader samples it with x and y swapped.
+*
+* With textureBuffer_glStreamInit the pixels live in a ring of persistently
+* mapped pixel buffer slots instead of client memory. The renderer writes
+* straight into the current slot, glTexSubImage2D copies from it on the GPU
+* timeline, and the next frame goes to the next slot once its last upload
+* has been fenced off. Mapped memory may be write-combined, which is fine
+* because the renderer only ever writes pixels.
+*/
+
+#ifdef RAYC_PIXEL_BGRA32
+// Same byte order as the driver's RGBA8 storage, uploads are a straight copy
+#define TEXTURE_BUFFER_GL_INTERNAL GL_RGBA8
+#define TEXTURE_BUFFER_GL_FORMAT GL_BGRA
+#define TEXTURE_BUFFER_GL_TYPE GL_UNSIGNED_INT_8_8_8_8_REV
+#else
+// The driver expands and reorders every pixel on upload
+#define TEXTURE_BUFFER_GL_INTERNAL GL_RGB
+#define TEXTURE_BUFFER_GL_FORMAT GL_RGB
+#define TEXTURE_BUFFER_GL_TYPE GL_UNSIGNED_BYTE
+#endif
+
+// How the fragment shader scales a texture up to the window, see shaders/shader.frag
+typedef enum {
+    TEXTURE_UPSCALE_NEAREST,
+    TEXTURE_UPSCALE_SHARP_BILINEAR, // Nearest inside a texel, a one pixel wide blend at its border
+    TEXTURE_UPSCALE_EDGE,           // Bilinear, sharpened across color edges only
+    TEXTURE_UPSCALE_COUNT,
+} TextureUpscale;
+
+const char* textureUpscale_name(TextureUpscale upscale) {
+    switch (upscale) {
+    case TEXTURE_UPSCALE_NEAREST:        return "nearest";
+    case TEXTURE_UPSCALE_SHARP_BILINEAR: return "sharp";
+    case TEXTURE_UPSCALE_EDGE:           return "edge";
+    default:                             return "unknown";
+    }
+}
+
+bool textureUpscale_parse(const char* name, TextureUpscale* upscale) {
+    for (int u = 0; u < TEXTURE_UPSCALE_COUNT; ++u) {
+        if (strcmp(name, textureUpscale_name(u)) == 0) {
+            *upscale = u;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void textureBuffer_glSize(const TextureBuffer* tb, int* w, int* h) {
+    bool transposed = tb->layout == TEXTURE_LAYOUT_COLUMN_MAJOR;
+    *w = transposed ? tb->height : tb->width;
+    *h = transposed ? tb->width : tb->height;
+}
+
+void textureBuffer_glInit(TextureBuffer* tb, unsigned int tex_unit) {
+    tb->gl_tex_unit = tex_unit;
+    glActiveTexture(GL_TEXTURE0 + tex_unit);
+
+    glGenTextures(1, &tb->gl_tex_id);
+    glBindTexture(GL_TEXTURE_2D, tb->gl_tex_id);
+    // set the texture wrapping parameters
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	// set texture wrapping to GL_REPEAT (default wrapping method)
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    // set texture filtering parameters
+    /*glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);*/
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    // Rows of 3 byte pixels are only 4 byte aligned for some sizes, 4 byte pixels always are
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    int w, h;
+    textureBuffer_glSize(tb, &w, &h);
+    glTexImage2D(GL_TEXTURE_2D, 0, TEXTURE_BUFFER_GL_INTERNAL, w, h, 0, TEXTURE_BUFFER_GL_FORMAT, TEXTURE_BUFFER_GL_TYPE, tb->data);
+    tb->gl_tex_width = w;
+    tb->gl_tex_height = h;
+
+    tb->gl_tex_init = true;
+}
+
+// GL_NEAREST or GL_LINEAR sampling of texture(), texelFetch ignores it
+void textureBuffer_glSetFilter(TextureBuffer* tb, GLint filter) {
+    glActiveTexture(GL_TEXTURE0 + tb->gl_tex_unit);
+    glBindTexture(GL_TEXTURE_2D, tb->gl_tex_id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+}
+
+// Points data at a ring slot, waiting until the GPU is done reading the slot's last upload
+static void textureBuffer_glAcquireSlot(TextureBuffer* tb, int slot) {
+    GLsync fence = tb->gl_pbo_fences[slot];
+    if (fence != NULL) {
+        // Flush once, so the fence can signal at all, then wait as long as it takes
+        GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+        while (glClientWaitSync(fence, flags, 1000000000) == GL_TIMEOUT_EXPIRED) {
+            flags = 0;
+        }
+        glDeleteSync(fence);
+        tb->gl_pbo_fences[slot] = NULL;
+    }
+
+    tb->gl_pbo_slot = slot;
+    tb->data = (Pixel*)(tb->gl_pbo_map + (size_t)slot * tb->gl_pbo_slot_bytes);
+}
+
+/*
+* Moves the pixels into a ring of TEXTURE_BUFFER_PBO_RING persistently mapped slots.
+* Needs glBufferStorage (GL 4.4), returns false and keeps client memory without it.
+*/
+bool textureBuffer_glStreamInit(TextureBuffer* tb) {
+    if (!GLAD_GL_VERSION_4_4 || tb->gl_pbo_id != 0) {
+        return tb->gl_pbo_id != 0;
+    }
+
+    // Slots start aligned, the map itself is at least 64 byte aligned
+    size_t slot_bytes = textureBuffer_allocBytes(tb->width, tb->height);
+    size_t ring_bytes = slot_bytes * TEXTURE_BUFFER_PBO_RING;
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    glGenBuffers(1, &tb->gl_pbo_id);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, tb->gl_pbo_id);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, ring_bytes, NULL, flags);
+    void* map = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, ring_bytes, flags);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    if (map == NULL) {
+        glDeleteBuffers(1, &tb->gl_pbo_id);
+        tb->gl_pbo_id = 0;
+        return false;
+    }
+
+    tb->gl_pbo_map = map;
+    tb->gl_pbo_slot_bytes = slot_bytes;
+    memset(tb->gl_pbo_fences, 0, sizeof(tb->gl_pbo_fences));
+
+    // Whatever was drawn so far carries over into the first slot
+    memcpy(tb->gl_pbo_map, tb->data, (size_t)tb->width * tb->height * sizeof(Pixel));
+    textureBuffer_free(tb->data);
+    textureBuffer_glAcquireSlot(tb, 0);
+
+    // The other slots start with garbage
+    textureBuffer_dirtyAll(tb);
+    return true;
+}
+
+// Back to client memory, keeping the pixels of the current slot
+void textureBuffer_glStreamDestroy(TextureBuffer* tb) {
+    if (tb->gl_pbo_id == 0) {
+        return;
+    }
+
+    Pixel* pixels = textureBuffer_alloc(tb->width, tb->height);
+    memcpy(pixels, tb->data, (size_t)tb->width * tb->height * sizeof(Pixel));
+
+    for (int i = 0; i < TEXTURE_BUFFER_PBO_RING; ++i) {
+        if (tb->gl_pbo_fences[i] != NULL) {
+            glDeleteSync(tb->gl_pbo_fences[i]);
+            tb->gl_pbo_fences[i] = NULL;
+        }
+    }
+
+    // Deletion waits for uploads still reading from the buffer
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, tb->gl_pbo_id);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &tb->gl_pbo_id);
+
+    tb->gl_pbo_id = 0;
+    tb->gl_pbo_map = NULL;
+    tb->data = pixels;
+    textureBuffer_dirtyAll(tb);
+}
+
+// Resize the CPU buffer and the texture on GPU
+void textureBuffer_glReset(TextureBuffer* tb, int width, int height) {
+    // The ring is sized for the old texture
+    bool stream = tb->gl_pbo_id != 0;
+    textureBuffer_glStreamDestroy(tb);
+
+    textureBuffer_reset(tb, width, height);
+
+    //https://stackoverflow.com/questions/8866904/differences-and-relationship-between-glactivetexture-and-glbindtexture
+    glActiveTexture(GL_TEXTURE0 + tb->gl_tex_unit);
+    // Update the texture size on GPU
+    int w, h;
+    textureBuffer_glSize(tb, &w, &h);
+    glTexImage2D(GL_TEXTURE_2D, 0, TEXTURE_BUFFER_GL_INTERNAL, w, h, 0, TEXTURE_BUFFER_GL_FORMAT, TEXTURE_BUFFER_GL_TYPE, tb->data);
+    tb->gl_tex_width = w;
+    tb->gl_tex_height = h;
+
+    if (stream) {
+        textureBuffer_glStreamInit(tb);
+    }
+}
+
+/*
+* Resize that keeps the texture, the buffer and the upload ring when the new size fits in them.
+* The pixels then cover the bottom left corner of the texture, the shader has to know the size.
+* Only falls back to textureBuffer_glReset, reallocating everything, to grow.
+*/
+void textureBuffer_glResize(TextureBuffer* tb, int width, int height) {
+    bool transposed = tb->layout == TEXTURE_LAYOUT_COLUMN_MAJOR;
+    int w = transposed ? height : width;
+    int h = transposed ? width : height;
+
+    if (w <= tb->gl_tex_width && h <= tb->gl_tex_height && textureBuffer_resize(tb, width, height)) {
+        return;
+    }
+    textureBuffer_glReset(tb, width, height);
+}
+
+// Uploads the changed rectangles of the frame, see textureBuffer_beginFrame
+void textureBuffer_loadTexData(TextureBuffer* tb) {
+    assert(tb->gl_tex_init);
+
+    TextureRect rects[TEXTURE_BUFFER_MAX_RECTS];
+    int num_rects = textureBuffer_changedRects(tb, rects, TEXTURE_BUFFER_MAX_RECTS);
+    if (num_rects == 0) {
+        tb->updated_this_frame = false;
+        return;
+    }
+
+    glActiveTexture(GL_TEXTURE0 + tb->gl_tex_unit);
+    glBindTexture(GL_TEXTURE_2D, tb->gl_tex_id);
+
+    // With a buffer bound the pointer is an offset into it, the copy runs on the GPU timeline
+    const unsigned char* base = (const unsigned char*)tb->data;
+    if (tb->gl_pbo_id != 0) {
+        base = (const unsigned char*)((size_t)tb->gl_pbo_slot * tb->gl_pbo_slot_bytes);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, tb->gl_pbo_id);
+    }
+
+    // Rectangles are cut out of the full lines. Fails if size is different so we game sure glTexImage2D is called before.
+    int w, h;
+    textureBuffer_glSize(tb, &w, &h);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, w);
+    for (int i = 0; i < num_rects; ++i) {
+        TextureRect r = rects[i];
+        size_t offset = ((size_t)r.y * w + r.x) * sizeof(Pixel);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, r.x, r.y, r.w, r.h, TEXTURE_BUFFER_GL_FORMAT, TEXTURE_BUFFER_GL_TYPE, base + offset);
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    tb->updated_this_frame = false;
+
+    if (tb->gl_pbo_id == 0) {
+        return;
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    tb->gl_pbo_fences[tb->gl_pbo_slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    // The next frame is drawn into another slot, so it doesn't wait on this upload.
+    // textureBuffer_beginFrame clears what that slot still shows from its last frame.
+    textureBuffer_glAcquireSlot(tb, (tb->gl_pbo_slot + 1) % TEXTURE_BUFFER_PBO_RING);
+}
+
+#endif // _TEXTURE_BUFFER_GL_H_
@@ -0,0 +1,296 @@
+#ifndef _THREAD_POOL_H_
+#define _THREAD_POOL_H_
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN 1
+#endif
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+/*
+* Persistent worker pool for data-parallel loops.
+* The calling thread takes part as worker 0, so a pool of 1 thread
+* spawns nothing and runs every chunk in order on the caller.
+*/
+
+#ifdef _MSC_VER
+#define threadPool_atomicFetchAdd(p, v) InterlockedExchangeAdd((volatile LONG*)(p), (v))
+#define threadPool_atomicLoad(p)        (*(p))
+#else
+#define threadPool_atomicFetchAdd(p, v) __atomic_fetch_add((p), (v), __ATOMIC_RELAXED)
+#define threadPool_atomicLoad(p)        __atomic_load_n((p), __ATOMIC_RELAXED)
+#endif
+
+#define THREAD_POOL_MAX_THREADS 64
+
+// Called with a half-open index range and the index of the worker running it
+typedef void (*ThreadPoolFn)(void* ctx, int begin, int end, int worker);
+
+typedef struct {
+    // Next unclaimed index of this worker's range. Other workers steal from it when they run dry.
+    volatile long next;
+    int end;
+    char pad[64 - sizeof(long) - sizeof(int)];
+} ThreadPoolRange;
+
+typedef struct ThreadPool ThreadPool;
+
+typedef struct {
+    ThreadPool* pool;
+    int index;
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    pthread_t handle;
+#endif
+} ThreadPoolWorker;
+
+struct ThreadPool {
+    int num_threads;
+
+    ThreadPoolWorker* workers;
+    ThreadPoolRange* ranges;
+
+#ifdef _WIN32
+    CRITICAL_SECTION lock;
+    CONDITION_VARIABLE start_cv;
+    CONDITION_VARIABLE done_cv;
+#else
+    pthread_mutex_t lock;
+    pthread_cond_t start_cv;
+    pthread_cond_t done_cv;
+#endif
+
+    // Bumped for every parallelFor, workers wake up when it changes
+    unsigned int generation;
+    int active;
+    bool quit;
+
+    ThreadPoolFn fn;
+    void* ctx;
+    int chunk;
+};
+
+int threadPool_hardwareConcurrency(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+#ifdef _WIN32
+#define threadPool_lock(tp)          EnterCriticalSection(&(tp)->lock)
+#define threadPool_unlock(tp)        LeaveCriticalSection(&(tp)->lock)
+#define threadPool_wait(tp, cv)      SleepConditionVariableCS(&(tp)->cv, &(tp)->lock, INFINITE)
+#define threadPool_broadcast(tp, cv) WakeAllConditionVariable(&(tp)->cv)
+#else
+#define threadPool_lock(tp)          pthread_mutex_lock(&(tp)->lock)
+#define threadPool_unlock(tp)        pthread_mutex_unlock(&(tp)->lock)
+#define threadPool_wait(tp, cv)      pthread_cond_wait(&(tp)->cv, &(tp)->lock)
+#define threadPool_broadcast(tp, cv) pthread_cond_broadcast(&(tp)->cv)
+#endif
+
+// Claim the next chunk of range r, returns false once it is exhausted
+static inline bool threadPool_claim(ThreadPool* tp, ThreadPoolRange* r, int* begin, int* end) {
+    // Cheap check first, so thieves don't keep bumping exhausted ranges
+    if (threadPool_atomicLoad(&r->next) >= r->end) {
+        return false;
+    }
+    int b = (int)threadPool_atomicFetchAdd(&r->next, tp->chunk);
+    if (b >= r->end) {
+        return false;
+    }
+    *begin = b;
+    *end = b + tp->chunk < r->end ? b + tp->chunk : r->end;
+    return true;
+}
+
+// Drain own range first, then steal from the others
+static void threadPool_runChunks(ThreadPool* tp, int worker) {
+    int begin, end;
+    for (int k = 0; k < tp->num_threads; ++k) {
+        ThreadPoolRange* r = &tp->ranges[(worker + k) % tp->num_threads];
+        while (threadPool_claim(tp, r, &begin, &end)) {
+            tp->fn(tp->ctx, begin, end, worker);
+        }
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI threadPool_workerMain(LPVOID arg)
+#else
+static void* threadPool_workerMain(void* arg)
+#endif
+{
+    ThreadPoolWorker* w = arg;
+    ThreadPool* tp = w->pool;
+
+    unsigned int seen = 0;
+
+    for (;;) {
+        threadPool_lock(tp);
+        while (!tp->quit && tp->generation == seen) {
+            threadPool_wait(tp, start_cv);
+        }
+        if (tp->quit) {
+            threadPool_unlock(tp);
+            break;
+        }
+        seen = tp->generation;
+        threadPool_unlock(tp);
+
+        threadPool_runChunks(tp, w->index);
+
+        threadPool_lock(tp);
+        if (--tp->active == 0) {
+            threadPool_broadcast(tp, done_cv);
+        }
+        threadPool_unlock(tp);
+    }
+
+    return 0;
+}
+
+/*
+* num_threads <= 0 picks the hardware concurrency.
+* Returns 0 on success.
+*/
+int threadPool_init(ThreadPool* tp, int num_threads) {
+    memset(tp, 0, sizeof(ThreadPool));
+
+    if (num_threads <= 0) {
+        num_threads = threadPool_hardwareConcurrency();
+    }
+    if (num_threads > THREAD_POOL_MAX_THREADS) {
+        num_threads = THREAD_POOL_MAX_THREADS;
+    }
+    tp->num_threads = num_threads;
+
+    tp->workers = calloc(num_threads, sizeof(ThreadPoolWorker));
+    tp->ranges = calloc(num_threads, sizeof(ThreadPoolRange));
+    if (tp->workers == NULL || tp->ranges == NULL) {
+        printf("Failed to allocate thread pool\n");
+        return -1;
+    }
+
+#ifdef _WIN32
+    InitializeCriticalSection(&tp->lock);
+    InitializeConditionVariable(&tp->start_cv);
+    InitializeConditionVariable(&tp->done_cv);
+#else
+    pthread_mutex_init(&tp->lock, NULL);
+    pthread_cond_init(&tp->start_cv, NULL);
+    pthread_cond_init(&tp->done_cv, NULL);
+#endif
+
+    // Worker 0 is the caller of parallelFor
+    for (int i = 1; i < num_threads; ++i) {
+        ThreadPoolWorker* w = &tp->workers[i];
+        w->pool = tp;
+        w->index = i;
+#ifdef _WIN32
+        w->handle = CreateThread(NULL, 0, threadPool_workerMain, w, 0, NULL);
+        bool failed = w->handle == NULL;
+#else
+        bool failed = pthread_create(&w->handle, NULL, threadPool_workerMain, w) != 0;
+#endif
+        if (failed) {
+            printf("Failed to create worker thread %d, continuing with %d\n", i, i);
+            tp->num_threads = i;
+            break;
+        }
+    }
+
+    return 0;
+}
+
+void threadPool_destroy(ThreadPool* tp) {
+    threadPool_lock(tp);
+    tp->quit = true;
+    threadPool_broadcast(tp, start_cv);
+    threadPool_unlock(tp);
+
+    for (int i = 1; i < tp->num_threads; ++i) {
+#ifdef _WIN32
+        WaitForSingleObject(tp->workers[i].handle, INFINITE);
+        CloseHandle(tp->workers[i].handle);
+#else
+        pthread_join(tp->workers[i].handle, NULL);
+#endif
+    }
+
+#ifdef _WIN32
+    DeleteCriticalSection(&tp->lock);
+#else
+    pthread_mutex_destroy(&tp->lock);
+    pthread_cond_destroy(&tp->start_cv);
+    pthread_cond_destroy(&tp->done_cv);
+#endif
+
+    free(tp->workers);
+    free(tp->ranges);
+    memset(tp, 0, sizeof(ThreadPool));
+}
+
+/*
+* Run fn over [0, count) and wait for it to finish.
+* Each worker starts on its own contiguous slice and steals chunks
+* of the others once it runs out. chunk <= 0 picks a size automatically.
+*/
+void threadPool_parallelFor(ThreadPool* tp, int count, int chunk, ThreadPoolFn fn, void* ctx) {
+    if (count <= 0) {
+        return;
+    }
+
+    if (tp == NULL || tp->num_threads <= 1) {
+        fn(ctx, 0, count, 0);
+        return;
+    }
+
+    int n = tp->num_threads;
+
+    if (chunk <= 0) {
+        chunk = count / (n * 8);
+        if (chunk < 1) {
+            chunk = 1;
+        }
+    }
+
+    tp->fn = fn;
+    tp->ctx = ctx;
+    tp->chunk = chunk;
+
+    for (int i = 0; i < n; ++i) {
+        tp->ranges[i].next = (long)((long long)count * i / n);
+        tp->ranges[i].end = (int)((long long)count * (i + 1) / n);
+    }
+
+    threadPool_lock(tp);
+    tp->active = n - 1;
+    ++tp->generation;
+    threadPool_broadcast(tp, start_cv);
+    threadPool_unlock(tp);
+
+    threadPool_runChunks(tp, 0);
+
+    threadPool_lock(tp);
+    while (tp->active > 0) {
+        threadPool_wait(tp, done_cv);
+    }
+    threadPool_unlock(tp);
+}
+
+#endif // _THREAD_POOL_H_
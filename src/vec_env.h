@@ -0,0 +1,371 @@
+#ifndef _VEC_ENV_H_
+#define _VEC_ENV_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "vec2.h"
+#include "screen.h"
+#include "game_map.h"
+#include "raycast.h"
+#include "raycast_packet.h"
+#include "thread_pool.h"
+#include "renderer.h"
+#include "camera_path.h"
+
+/*
+* Many copies of the game stepped together, for training agents.
+* Poses and actions are SoA arrays with one entry per env, every env has its own
+* map pointer (envs can share one). A step applies the viewer's gameLogic rules:
+* turn, move along the look dir and its perpendicular, and step back from walls
+* closer than stop_dist along the move. The observations are then rendered.
+*
+* An observation is the POV the renderer draws at obs_cols x obs_rows, each env's
+* in one contiguous buffer: num_envs x obs_rows x obs_cols x channels bytes,
+* top row first. 3 channels are RGB, 1 is luma.
+* Envs are split across the thread pool, nothing is allocated per step.
+*/
+
+// Per worker, obs_cols entries each
+typedef struct {
+    float* ox;
+    float* oy;
+    float* dx;
+    float* dy;
+    float* dist;
+    RayHit* hits;
+    int* heights;
+    int* wall_y0; // POV rows counted from the bottom, like renderer_fillColumns
+    int* wall_y1;
+    Pixel* wall_col;
+    unsigned char* wall_luma;
+} VecEnvScratch;
+
+typedef struct {
+    int num_envs;
+    int obs_cols;
+    int obs_rows;
+    int channels;
+
+    float speed;     // Tiles per second, mov_speed of the viewer
+    float dt;        // Seconds per step
+    float stop_dist; // Tiles, 0 uses 5 texels of the viewer's 128 x 128 top view on each env's map
+
+    RayPacketIsa isa;
+    RenderColors colors;
+
+    // Per env
+    const GameMap** maps;
+    float* pos_x;
+    float* pos_y;
+    float* theta; // Radians, the look dir is (cos, sin)
+
+    // Actions of the next step, per env. forward and strafe are in -1..1 of speed, turn in radians.
+    float* act_forward;
+    float* act_strafe;
+    float* act_turn;
+
+    unsigned char* obs;
+    bool* collided; // The last step's move was pushed back from a wall
+
+    ThreadPool* pool;
+    Screen view; // Ray tables of the observation
+
+    VecEnvScratch* scratch;
+    int num_workers;
+} VecEnv;
+
+static void* vecEnv_alloc(size_t size) {
+    void* p = malloc(size);
+    if (p == NULL) {
+        perror("Fatal error: malloc failed");
+        exit(1);
+    }
+    return p;
+}
+
+/*
+* num_envs envs on gm, all at its spawn looking along +x.
+* channels is 1 or 3. pool can be NULL to step on the calling thread.
+*/
+void vecEnv_init(VecEnv* env, int num_envs, const GameMap* gm, int obs_cols, int obs_rows, int channels, float fov,
+                 ThreadPool* pool)
+{
+    memset(env, 0, sizeof(VecEnv));
+
+    env->num_envs = num_envs;
+    env->obs_cols = obs_cols;
+    env->obs_rows = obs_rows;
+    env->channels = channels == 1 ? 1 : 3;
+
+    env->speed = 3;
+    env->dt = 1.f / 30;
+
+    env->isa = RAY_PACKET_SCALAR;
+    env->colors = renderColors_default();
+
+    env->maps = vecEnv_alloc(num_envs * sizeof(const GameMap*));
+    env->pos_x = vecEnv_alloc(num_envs * sizeof(float));
+    env->pos_y = vecEnv_alloc(num_envs * sizeof(float));
+    env->theta = vecEnv_alloc(num_envs * sizeof(float));
+    env->act_forward = vecEnv_alloc(num_envs * sizeof(float));
+    env->act_strafe = vecEnv_alloc(num_envs * sizeof(float));
+    env->act_turn = vecEnv_alloc(num_envs * sizeof(float));
+    env->obs = vecEnv_alloc((size_t)num_envs * obs_rows * obs_cols * env->channels);
+    env->collided = vecEnv_alloc(num_envs * sizeof(bool));
+
+    Vec2 spawn = gameMap_findSpawn(gm);
+    for (int i = 0; i < num_envs; ++i) {
+        env->maps[i] = gm;
+        env->pos_x[i] = spawn.x;
+        env->pos_y[i] = spawn.y;
+        env->theta[i] = 0;
+        env->act_forward[i] = 0;
+        env->act_strafe[i] = 0;
+        env->act_turn[i] = 0;
+        env->collided[i] = false;
+    }
+
+    env->pool = pool;
+    screen_init(&env->view, obs_cols, obs_rows, fov);
+
+    env->num_workers = pool != NULL ? pool->num_threads : 1;
+    env->scratch = vecEnv_alloc(env->num_workers * sizeof(VecEnvScratch));
+    for (int w = 0; w < env->num_workers; ++w) {
+        VecEnvScratch* sc = &env->scratch[w];
+        sc->ox = vecEnv_alloc(obs_cols * sizeof(float));
+        sc->oy = vecEnv_alloc(obs_cols * sizeof(float));
+        sc->dx = vecEnv_alloc(obs_cols * sizeof(float));
+        sc->dy = vecEnv_alloc(obs_cols * sizeof(float));
+        sc->dist = vecEnv_alloc(obs_cols * sizeof(float));
+        sc->hits = vecEnv_alloc(obs_cols * sizeof(RayHit));
+        sc->heights = vecEnv_alloc(obs_cols * sizeof(int));
+        sc->wall_y0 = vecEnv_alloc(obs_cols * sizeof(int));
+        sc->wall_y1 = vecEnv_alloc(obs_cols * sizeof(int));
+        sc->wall_col = vecEnv_alloc(obs_cols * sizeof(Pixel));
+        sc->wall_luma = vecEnv_alloc(obs_cols);
+    }
+}
+
+void vecEnv_destroy(VecEnv* env) {
+    free(env->maps);
+    free(env->pos_x);
+    free(env->pos_y);
+    free(env->theta);
+    free(env->act_forward);
+    free(env->act_strafe);
+    free(env->act_turn);
+    free(env->obs);
+    free(env->collided);
+    for (int w = 0; w < env->num_workers; ++w) {
+        VecEnvScratch* sc = &env->scratch[w];
+        free(sc->ox);
+        free(sc->oy);
+        free(sc->dx);
+        free(sc->dy);
+        free(sc->dist);
+        free(sc->hits);
+        free(sc->heights);
+        free(sc->wall_y0);
+        free(sc->wall_y1);
+        free(sc->wall_col);
+        free(sc->wall_luma);
+    }
+    free(env->scratch);
+    screen_destroy(&env->view);
+    memset(env, 0, sizeof(VecEnv));
+}
+
+// Puts env i on gm at pos, looking at theta. Its observation is drawn by the next step or vecEnv_observe.
+void vecEnv_reset(VecEnv* env, int i, const GameMap* gm, Vec2 pos, float theta) {
+    env->maps[i] = gm;
+    env->pos_x[i] = pos.x;
+    env->pos_y[i] = pos.y;
+    env->theta[i] = theta;
+    env->collided[i] = false;
+}
+
+size_t vecEnv_obsSize(const VecEnv* env) {
+    return (size_t)env->obs_rows * env->obs_cols * env->channels;
+}
+
+static inline Vec2 vecEnv_lookDir(float theta) {
+    return vec2_normalized((Vec2){ cosf(theta), sinf(theta) });
+}
+
+// Like gameLogic: move, then step back along the move when a wall is closer than the stop distance
+static void vecEnv_move(VecEnv* env, int i) {
+    const GameMap* gm = env->maps[i];
+
+    env->theta[i] += env->act_turn[i];
+    Vec2 look = vecEnv_lookDir(env->theta[i]);
+    Vec2 plane = vec2_perpendicular(look);
+
+    float step = env->speed * env->dt;
+    Vec2 delta = vec2_add(vec2_mulf(plane, env->act_strafe[i] * step), vec2_mulf(look, env->act_forward[i] * step));
+    Vec2 pos = vec2_add((Vec2){ env->pos_x[i], env->pos_y[i] }, delta);
+
+    env->collided[i] = false;
+    if (delta.x != 0.f || delta.y != 0.f) {
+        float stop_dist = env->stop_dist > 0 ? env->stop_dist : 5.f * gm->dim / 128;
+        RayHit coll = raycast_dda(gm, pos, vec2_normalized(delta), stop_dist);
+        if (coll.hit && coll.dist < stop_dist) {
+            pos = vec2_sub(pos, vec2_mulf(delta, 1.1f));
+            env->collided[i] = true;
+        }
+    }
+
+    env->pos_x[i] = pos.x;
+    env->pos_y[i] = pos.y;
+}
+
+// Luma of one tensor row, POV row p: wall where wall_y0 <= p < wall_y1, bg elsewhere
+static inline void vecEnv_lumaRow(unsigned char* out, const int* wall_y0, const int* wall_y1, const unsigned char* wall,
+                                  int begin, int end, int p, unsigned char bg)
+{
+    for (int c = begin; c < end; ++c) {
+        out[c] = p >= wall_y0[c] && p < wall_y1[c] ? wall[c] : bg;
+    }
+}
+
+#ifdef CPU_X86
+
+// 16 columns per step, the compares are 32-bit and narrowed to a byte mask
+CPU_TARGET_SSE2
+static void vecEnv_lumaRowSse2(unsigned char* out, const int* wall_y0, const int* wall_y1, const unsigned char* wall,
+                               int cols, int p, unsigned char bg)
+{
+    __m128i vp = _mm_set1_epi32(p);
+    __m128i vbg = _mm_set1_epi8((char)bg);
+
+    int c = 0;
+    for (; c + 16 <= cols; c += 16) {
+        __m128i m[4];
+        for (int k = 0; k < 4; ++k) {
+            __m128i y0 = _mm_loadu_si128((const __m128i*)(wall_y0 + c + 4 * k));
+            __m128i y1 = _mm_loadu_si128((const __m128i*)(wall_y1 + c + 4 * k));
+            m[k] = _mm_andnot_si128(_mm_cmpgt_epi32(y0, vp), _mm_cmpgt_epi32(y1, vp));
+        }
+        __m128i mask = _mm_packs_epi16(_mm_packs_epi32(m[0], m[1]), _mm_packs_epi32(m[2], m[3]));
+        __m128i w = _mm_loadu_si128((const __m128i*)(wall + c));
+        _mm_storeu_si128((__m128i*)(out + c), _mm_or_si128(_mm_and_si128(mask, w), _mm_andnot_si128(mask, vbg)));
+    }
+    vecEnv_lumaRow(out, wall_y0, wall_y1, wall, c, cols, p, bg);
+}
+
+#endif // CPU_X86
+
+/*
+* Casts and fills env i's observation the way renderer_drawFrame draws a POV of that size:
+* the observation stands in for the top view whose texels the rays are measured in.
+*/
+static void vecEnv_render(VecEnv* env, int i, int worker) {
+    const GameMap* gm = env->maps[i];
+    const Screen* view = &env->view;
+    int cols = env->obs_cols;
+    int rows = env->obs_rows;
+
+    VecEnvScratch* sc = &env->scratch[worker];
+    float* ox = sc->ox;
+    float* oy = sc->oy;
+    float* dx = sc->dx;
+    float* dy = sc->dy;
+    float* dist = sc->dist;
+    RayHit* hits = sc->hits;
+    int* heights = sc->heights;
+    int* wall_y0 = sc->wall_y0;
+    int* wall_y1 = sc->wall_y1;
+    Pixel* wall_col = sc->wall_col;
+    unsigned char* wall_luma = sc->wall_luma;
+
+    Vec2 look = vecEnv_lookDir(env->theta[i]);
+    Vec2 tv_to_map = { gm->dim / (float)view->TOP_VIEW_COLS, gm->dim / (float)view->TOP_VIEW_ROWS };
+    float view_dist = view->TOP_VIEW_ROWS;
+
+    for (int c = 0; c < cols; ++c) {
+        float rc = view->RAY_COS[c];
+        float rs = view->RAY_SIN[c];
+        Vec2 rayd = { look.x * rc - look.y * rs, look.x * rs + look.y * rc };
+        ox[c] = env->pos_x[i];
+        oy[c] = env->pos_y[i];
+        dx[c] = rayd.x * tv_to_map.x;
+        dy[c] = rayd.y * tv_to_map.y;
+    }
+
+    rayPacket_cast(gm, env->isa, cols, ox, oy, dx, dy, view_dist, hits);
+    for (int c = 0; c < cols; ++c) {
+        dist[c] = hits[c].dist;
+    }
+    rayPacket_wallHeights(env->isa, cols, dist, view->RAY_COS, rows, view_dist, heights);
+
+    int half_r = rows / 2;
+    int horizon = half_r + 1 < rows ? half_r + 1 : rows;
+
+    for (int c = 0; c < cols; ++c) {
+        wall_y0[c] = rows;
+        wall_y1[c] = rows;
+        if (hits[c].hit) {
+            int half_h = heights[c] / 2;
+            wall_y0[c] = half_r - half_h < 0 ? 0 : half_r - half_h;
+            wall_y1[c] = half_r + half_h + 1 > rows ? rows : half_r + half_h + 1;
+            wall_col[c] = pixel_mulf(env->colors.wall, heights[c] / (float)rows);
+            wall_luma[c] = pixel_luma(wall_col[c]);
+        }
+    }
+
+    // Tensor rows go top down, POV rows bottom up
+    unsigned char* out = env->obs + (size_t)i * vecEnv_obsSize(env);
+    for (int y = 0; y < rows; ++y) {
+        int p = rows - 1 - y;
+        Pixel bg = p < horizon ? env->colors.floor : env->colors.ceil;
+
+        if (env->channels == 1) {
+#ifdef CPU_X86
+            if (env->isa != RAY_PACKET_SCALAR) {
+                vecEnv_lumaRowSse2(out, wall_y0, wall_y1, wall_luma, cols, p, pixel_luma(bg));
+            } else
+#endif
+            {
+                vecEnv_lumaRow(out, wall_y0, wall_y1, wall_luma, 0, cols, p, pixel_luma(bg));
+            }
+            out += cols;
+        } else {
+            for (int c = 0; c < cols; ++c) {
+                Pixel px = p >= wall_y0[c] && p < wall_y1[c] ? wall_col[c] : bg;
+                out[0] = px.r;
+                out[1] = px.g;
+                out[2] = px.b;
+                out += 3;
+            }
+        }
+    }
+}
+
+static void vecEnv_stepRange(void* ctx, int begin, int end, int worker) {
+    VecEnv* env = ctx;
+    for (int i = begin; i < end; ++i) {
+        vecEnv_move(env, i);
+        vecEnv_render(env, i, worker);
+    }
+}
+
+static void vecEnv_observeRange(void* ctx, int begin, int end, int worker) {
+    VecEnv* env = ctx;
+    for (int i = begin; i < end; ++i) {
+        vecEnv_render(env, i, worker);
+    }
+}
+
+// Applies every env's action and renders the observations that follow
+void vecEnv_step(VecEnv* env) {
+    threadPool_parallelFor(env->pool, env->num_envs, 0, vecEnv_stepRange, env);
+}
+
+// Renders the observations of the current poses, after resets
+void vecEnv_observe(VecEnv* env) {
+    threadPool_parallelFor(env->pool, env->num_envs, 0, vecEnv_observeRange, env);
+}
+
+#endif // _VEC_ENV_H_
@@ -0,0 +1,47 @@
+# Differential check through rayc-headless: every candidate must print the reference's run hash.
+#
+#   cmake -DHEADLESS=<rayc-headless> -DCONFIGS="<opts>|<opts>" -DREFERENCE="<opts>"
+#         -DCANDIDATES="<opts>|<opts>" -P compare_hashes.cmake
+#
+# Each config is run once with REFERENCE appended and once per candidate.
+# Options are split like a shell command line, configs and candidates by '|'.
+
+if(NOT HEADLESS OR NOT CONFIGS OR NOT CANDIDATES)
+    message(FATAL_ERROR "HEADLESS, CONFIGS and CANDIDATES are required")
+endif()
+
+string(REPLACE "|" ";" configs "${CONFIGS}")
+string(REPLACE "|" ";" candidates "${CANDIDATES}")
+separate_arguments(reference UNIX_COMMAND "${REFERENCE}")
+
+function(run_hash out)
+    execute_process(COMMAND "${HEADLESS}" -q ${ARGN}
+        OUTPUT_VARIABLE output ERROR_VARIABLE output RESULT_VARIABLE result)
+    string(STRIP "${output}" output)
+    if(NOT result EQUAL 0 OR NOT output MATCHES "^hash [0-9a-f]+$")
+        message(FATAL_ERROR "rayc-headless ${ARGN} failed (${result}): ${output}")
+    endif()
+    set(${out} "${output}" PARENT_SCOPE)
+endfunction()
+
+set(runs 0)
+set(failures 0)
+foreach(config IN LISTS configs)
+    separate_arguments(config_args UNIX_COMMAND "${config}")
+    run_hash(want ${config_args} ${reference})
+
+    foreach(candidate IN LISTS candidates)
+        separate_arguments(candidate_args UNIX_COMMAND "${candidate}")
+        run_hash(got ${config_args} ${candidate_args})
+        math(EXPR runs "${runs} + 1")
+        if(NOT got STREQUAL want)
+            math(EXPR failures "${failures} + 1")
+            message("MISMATCH ${config} | ${candidate}: ${got}, ${REFERENCE}: ${want}")
+        endif()
+    endforeach()
+endforeach()
+
+if(failures GREATER 0)
+    message(FATAL_ERROR "${failures} of ${runs} runs differ from the reference")
+endif()
+message("${runs} runs match the reference")
@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "screen.h"
+#include "texture_buffer.h"
+#include "game_map.h"
+#include "renderer.h"
+#include "camera_path.h"
+
+/*
+* Dirty rectangle uploads: a shadow of the texture that only receives the
+* rectangles of textureBuffer_changedRects must equal a full upload of the
+* same frame drawn from scratch, by a renderer without frame cache or ring
+* whose map layer is rebuilt on every edit. The upload ring of
+* texture_buffer_gl.h is emulated in client memory, its slots start as garbage.
+*/
+
+#define TEST_FRAMES 48
+
+static int failures = 0;
+
+// What textureBuffer_glStreamInit does, without a GL buffer behind the map
+static void emulatedStreamInit(TextureBuffer* tb) {
+    size_t slot_bytes = textureBuffer_allocBytes(tb->width, tb->height);
+    tb->gl_pbo_map = malloc(slot_bytes * TEXTURE_BUFFER_PBO_RING);
+    tb->gl_pbo_slot_bytes = slot_bytes;
+    memset(tb->gl_pbo_map, 0x5a, slot_bytes * TEXTURE_BUFFER_PBO_RING);
+
+    memcpy(tb->gl_pbo_map, tb->data, (size_t)tb->width * tb->height * sizeof(Pixel));
+    textureBuffer_free(tb->data);
+    tb->gl_pbo_slot = 0;
+    tb->data = (Pixel*)tb->gl_pbo_map;
+    textureBuffer_dirtyAll(tb);
+}
+
+static void emulatedStreamDestroy(TextureBuffer* tb) {
+    Pixel* pixels = textureBuffer_alloc(tb->width, tb->height);
+    memcpy(pixels, tb->data, (size_t)tb->width * tb->height * sizeof(Pixel));
+    free(tb->gl_pbo_map);
+    tb->gl_pbo_map = NULL;
+    tb->data = pixels;
+}
+
+// textureBuffer_loadTexData into shadow, which is laid out like the buffer's memory
+static void emulatedUpload(TextureBuffer* tb, Pixel* shadow) {
+    if (!tb->updated_this_frame) {
+        return;
+    }
+
+    TextureRect rects[TEXTURE_BUFFER_MAX_RECTS];
+    int num_rects = textureBuffer_changedRects(tb, rects, TEXTURE_BUFFER_MAX_RECTS);
+    tb->updated_this_frame = false;
+    if (num_rects == 0) {
+        return;
+    }
+
+    int len = textureBuffer_lineLength(tb);
+    for (int i = 0; i < num_rects; ++i) {
+        TextureRect r = rects[i];
+        for (int l = r.y; l < r.y + r.h; ++l) {
+            size_t offset = (size_t)l * len + r.x;
+            memcpy(shadow + offset, tb->data + offset, r.w * sizeof(Pixel));
+        }
+    }
+
+    if (tb->gl_pbo_map != NULL) {
+        tb->gl_pbo_slot = (tb->gl_pbo_slot + 1) % TEXTURE_BUFFER_PBO_RING;
+        tb->data = (Pixel*)(tb->gl_pbo_map + (size_t)tb->gl_pbo_slot * tb->gl_pbo_slot_bytes);
+    }
+}
+
+// Index of the first pixel where the shadow differs from the full frame, -1 if none
+static long firstDifference(const Pixel* shadow, const Pixel* frame, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        if (memcmp(&shadow[i], &frame[i], sizeof(Pixel)) != 0) {
+            return (long)i;
+        }
+    }
+    return -1;
+}
+
+static void runCase(bool ring, bool frame_cache, TextureLayout layout) {
+    GameMap gm;
+    if (gameMap_initGenerated(&gm, 32, 0.15f, 11) != 0) {
+        ++failures;
+        return;
+    }
+
+    Screen scr;
+    screen_init(&scr, 96, 64, 90);
+
+    TextureBuffer top_view_tb, pov_tb;
+    textureBuffer_init(&top_view_tb, scr.TOP_VIEW_COLS, scr.TOP_VIEW_ROWS);
+    textureBuffer_init(&pov_tb, scr.POV_COLS, scr.POV_ROWS);
+    textureBuffer_setLayout(&pov_tb, layout);
+
+    Renderer renderer;
+    renderer_init(&renderer, &scr, &gm, &top_view_tb, &pov_tb, NULL);
+    renderer.frame_cache = frame_cache;
+
+    TextureBuffer full_top_view_tb, full_pov_tb;
+    textureBuffer_init(&full_top_view_tb, scr.TOP_VIEW_COLS, scr.TOP_VIEW_ROWS);
+    textureBuffer_init(&full_pov_tb, scr.POV_COLS, scr.POV_ROWS);
+    textureBuffer_setLayout(&full_pov_tb, layout);
+
+    Renderer full;
+    renderer_init(&full, &scr, &gm, &full_top_view_tb, &full_pov_tb, NULL);
+    full.frame_cache = false;
+
+    if (ring) {
+        emulatedStreamInit(&top_view_tb);
+        emulatedStreamInit(&pov_tb);
+    }
+
+    // What the textures hold before the first upload, nothing the frames draw
+    size_t top_view_pixels = (size_t)top_view_tb.width * top_view_tb.height;
+    size_t pov_pixels = (size_t)pov_tb.width * pov_tb.height;
+    Pixel* top_view_shadow = malloc(top_view_pixels * sizeof(Pixel));
+    Pixel* pov_shadow = malloc(pov_pixels * sizeof(Pixel));
+    memset(top_view_shadow, 0x33, top_view_pixels * sizeof(Pixel));
+    memset(pov_shadow, 0x33, pov_pixels * sizeof(Pixel));
+
+    Vec2 spawn = gameMap_findSpawn(&gm);
+    unsigned int edits = 0;
+    for (int f = 0; f < TEST_FRAMES; ++f) {
+        // Every third frame holds still, so the frame cache skips some
+        int step = f - f / 3;
+        Camera cam = cameraPath_eval(CAMERA_PATH_ORBIT, &gm, spawn, step, TEST_FRAMES);
+
+        // Walls come and go around the path now and then, repainting parts of the map layer.
+        // The full renderer sees the new epoch and rebuilds its layer.
+        if (f % 3 == 1) {
+            int x = (int)cam.pos.x + (int)(edits % 5) - 2;
+            int y = (int)cam.pos.y + (int)(edits % 7) - 3;
+            if (gameMap_inBounds(&gm, x, y) && (x != (int)cam.pos.x || y != (int)cam.pos.y)) {
+                renderer_setTile(&renderer, x, y, gameMap_isSolid(&gm, x, y) ? 0 : 1);
+            }
+            ++edits;
+        }
+
+        renderer_drawFrame(&renderer, cam.pos, camera_lookDir(&cam));
+        renderer_drawFrame(&full, cam.pos, camera_lookDir(&cam));
+
+        emulatedUpload(&top_view_tb, top_view_shadow);
+        emulatedUpload(&pov_tb, pov_shadow);
+
+        long tv = firstDifference(top_view_shadow, full_top_view_tb.data, top_view_pixels);
+        long pv = firstDifference(pov_shadow, full_pov_tb.data, pov_pixels);
+        if (tv >= 0 || pv >= 0) {
+            printf("FAIL ring %d cache %d layout %d frame %d: top view pixel %ld, pov pixel %ld differ\n",
+                ring, frame_cache, (int)layout, f, tv, pv);
+            ++failures;
+            break;
+        }
+    }
+
+    if (ring) {
+        emulatedStreamDestroy(&top_view_tb);
+        emulatedStreamDestroy(&pov_tb);
+    }
+
+    free(top_view_shadow);
+    free(pov_shadow);
+    renderer_destroy(&renderer);
+    renderer_destroy(&full);
+    screen_destroy(&scr);
+    textureBuffer_destroy(&top_view_tb);
+    textureBuffer_destroy(&pov_tb);
+    textureBuffer_destroy(&full_top_view_tb);
+    textureBuffer_destroy(&full_pov_tb);
+    gameMap_destroy(&gm);
+}
+
+int main(void)
+{
+    int cases = 0;
+    for (int ring = 0; ring < 2; ++ring) {
+        for (int cache = 0; cache < 2; ++cache) {
+            runCase(ring, cache, TEXTURE_LAYOUT_ROW_MAJOR);
+            runCase(ring, cache, TEXTURE_LAYOUT_COLUMN_MAJOR);
+            cases += 2;
+        }
+    }
+
+    if (failures == 0) {
+        printf("dirty rects: %d cases match full uploads\n", cases);
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "game_map.h"
+
+/*
+* Incremental distance field repair: after random wall edits through gameMap_setTile,
+* the field must equal a full gameMap_buildDistance of the same tiles.
+*/
+
+typedef struct {
+    int dim;
+    float density;
+    int edits;
+    int check_every;
+} DistanceCase;
+
+static unsigned int test_random(unsigned int* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+// Full rebuild of ref's tiles, the field is dropped again so later edits don't repair it
+static int compareRebuilt(const GameMap* gm, GameMap* ref, int edit) {
+    if (gameMap_buildDistance(ref, NULL) != 0) {
+        return 1;
+    }
+
+    int mismatches = 0;
+    size_t cells = (size_t)gm->dim * gm->dim;
+    for (size_t i = 0; i < cells; ++i) {
+        if (gm->distance[i] != ref->distance[i]) {
+            if (mismatches == 0) {
+                printf("FAIL dim %d after %d edits: cell (%d, %d) is %d, rebuilt %d\n", gm->dim, edit,
+                    (int)(i % gm->dim), (int)(i / gm->dim), gm->distance[i], ref->distance[i]);
+            }
+            ++mismatches;
+        }
+    }
+
+    free(ref->distance);
+    ref->distance = NULL;
+    ref->distance_owned = false;
+    return mismatches;
+}
+
+int main(void)
+{
+    // Dense maps, and one sparse enough for distances past the 255 cap
+    const DistanceCase cases[] = {
+        { 16, 0.3f, 400, 1 },
+        { 64, 0.1f, 2000, 10 },
+        { 200, 0.02f, 2000, 100 },
+        { 700, 0.f, 200, 20 },
+    };
+    int failures = 0;
+
+    for (int c = 0; c < (int)(sizeof(cases) / sizeof(cases[0])); ++c) {
+        const DistanceCase* dc = &cases[c];
+
+        GameMap gm, ref;
+        if (gameMap_initGenerated(&gm, dc->dim, dc->density, c + 1) != 0 ||
+            gameMap_initGenerated(&ref, dc->dim, dc->density, c + 1) != 0 ||
+            gameMap_buildDistance(&gm, NULL) != 0) {
+            return 1;
+        }
+
+        unsigned int state = 12345u + c;
+        for (int e = 1; e <= dc->edits; ++e) {
+            // Edits cluster around a few spots now and then, so repairs overlap
+            int x = test_random(&state) % dc->dim;
+            int y = test_random(&state) % dc->dim;
+            if (e % 4 != 0) {
+                x = (dc->dim / 3 + (int)(test_random(&state) % 9)) % dc->dim;
+                y = (dc->dim / 2 + (int)(test_random(&state) % 9)) % dc->dim;
+            }
+            // Toggles, so walls are added and removed
+            int tile = gm.map[x + y * gm.dim] != 0 ? 0 : 1;
+
+            gameMap_setTile(&gm, x, y, tile);
+            gameMap_setTile(&ref, x, y, tile);
+
+            if (e % dc->check_every == 0 || e == dc->edits) {
+                int mismatches = compareRebuilt(&gm, &ref, e);
+                if (mismatches != 0) {
+                    ++failures;
+                    break;
+                }
+            }
+        }
+
+        gameMap_destroy(&gm);
+        gameMap_destroy(&ref);
+    }
+
+    if (failures == 0) {
+        printf("distance field: %d maps repaired exactly\n", (int)(sizeof(cases) / sizeof(cases[0])));
+    }
+    return failures == 0 ? 0 : 1;
+}
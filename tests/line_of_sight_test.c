@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "game_map.h"
+#include "raycast_packet.h"
+#include "line_of_sight.h"
+
+/*
+* Line of sight from outside of the map: segments are walked from where they enter it,
+* by los_query and by batches on every packet width.
+*/
+
+#define DIM 16
+
+typedef struct {
+    const char* name;
+    LosQuery q;
+    bool visible;
+    float dist;
+} LosCase;
+
+static int failures = 0;
+
+static void check(const char* name, const char* path, LosResult got, bool visible, float dist) {
+    if (got.visible != visible || fabsf(got.dist - dist) > 1e-4f) {
+        printf("FAIL %s (%s): got visible %d dist %f, want visible %d dist %f\n",
+            name, path, got.visible, got.dist, visible, dist);
+        ++failures;
+    }
+}
+
+int main(void)
+{
+    GameMap gm;
+    if (gameMap_initGenerated(&gm, DIM, 0.f, 1) != 0) {
+        return 1;
+    }
+
+    // Open the border on the left and right, keep it on the bottom and top
+    for (int y = 1; y < DIM - 1; ++y) {
+        gameMap_setTile(&gm, 0, y, 0);
+        gameMap_setTile(&gm, DIM - 1, y, 0);
+    }
+    gameMap_setTile(&gm, 3, 8, 1);
+    gameMap_setTile(&gm, 12, 8, 1);
+
+    const LosCase cases[] = {
+        { "enters from the left into a wall",   { { -5.f, 8.5f }, { 8.5f, 8.5f } }, false, 8.f },
+        { "enters from the right into a wall",  { { 20.f, 8.5f }, { 8.5f, 8.5f } }, false, 7.f },
+        { "passes through the map",             { { -2.f, 4.5f }, { 20.f, 4.5f } }, true, 22.f },
+        { "crosses the map into a wall",        { { -2.f, 8.5f }, { 20.f, 8.5f } }, false, 5.f },
+        { "enters through the bottom border",   { { 4.5f, -3.f }, { 4.5f, 4.5f } }, false, 3.f },
+        { "misses the map",                     { { -5.f, -5.f }, { -1.f, 20.f } }, true, sqrtf(16.f + 625.f) },
+        { "stops before the map",               { { -5.f, 8.5f }, { -1.f, 8.5f } }, true, 4.f },
+        { "ends before the wall",               { { -5.f, 8.5f }, { 2.5f, 8.5f } }, true, 7.5f },
+        { "from inside, unchanged",             { { 1.5f, 8.5f }, { 8.5f, 8.5f } }, false, 1.5f },
+    };
+    int n = sizeof(cases) / sizeof(cases[0]);
+
+    LosQuery queries[sizeof(cases) / sizeof(cases[0])];
+    LosResult results[sizeof(cases) / sizeof(cases[0])];
+    for (int i = 0; i < n; ++i) {
+        queries[i] = cases[i].q;
+        check(cases[i].name, "query", los_query(&gm, cases[i].q.from, cases[i].q.to), cases[i].visible, cases[i].dist);
+    }
+
+    RayPacketIsa best = rayPacket_detectIsa();
+    for (RayPacketIsa isa = RAY_PACKET_SCALAR; isa <= best; ++isa) {
+        los_batch(&gm, NULL, isa, queries, results, n);
+        for (int i = 0; i < n; ++i) {
+            check(cases[i].name, rayPacket_isaName(isa), results[i], cases[i].visible, cases[i].dist);
+        }
+    }
+
+    gameMap_destroy(&gm);
+
+    if (failures == 0) {
+        printf("line of sight: %d cases passed\n", n);
+    }
+    return failures == 0 ? 0 : 1;
+}
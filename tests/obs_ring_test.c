@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "screen.h"
+#include "texture_buffer.h"
+#include "game_map.h"
+#include "renderer.h"
+#include "camera_path.h"
+#include "obs_ring.h"
+
+/*
+* Observation ring between two mappings of the same name, like a renderer and a reader
+* in separate processes. The POV buffer is swapped out after each frame the way the
+* viewer's PBO upload ring does, frames the frame cache skips must still arrive intact.
+*/
+
+#define RING_SLOTS 4
+#define RING_COLS  32
+#define RING_ROWS  24
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf("FAIL: " __VA_ARGS__); printf("\n"); ++failures; } } while (0)
+
+// Nearest resample of the POV, top row first, written out independently of obsRing_writePov
+static void expectedPixels(const TextureBuffer* pov, unsigned char* out) {
+    for (int y = 0; y < RING_ROWS; ++y) {
+        int sy = pov->height - 1 - y * pov->height / RING_ROWS;
+        for (int x = 0; x < RING_COLS; ++x) {
+            Pixel p = pov->data[textureBuffer_index(pov, x * pov->width / RING_COLS, sy)];
+            *out++ = p.r;
+            *out++ = p.g;
+            *out++ = p.b;
+        }
+    }
+}
+
+int main(void)
+{
+    GameMap gm;
+    if (gameMap_initGenerated(&gm, 16, 0.2f, 7) != 0) {
+        return 1;
+    }
+
+    Screen scr;
+    screen_init(&scr, 64, 48, 90);
+
+    TextureBuffer top_view_tb, pov_tb;
+    textureBuffer_init(&top_view_tb, scr.TOP_VIEW_COLS, scr.TOP_VIEW_ROWS);
+    textureBuffer_init(&pov_tb, scr.POV_COLS, scr.POV_ROWS);
+
+    Renderer renderer;
+    renderer_init(&renderer, &scr, &gm, &top_view_tb, &pov_tb, NULL);
+
+    char name[64];
+    snprintf(name, sizeof(name), "rayc_test_%u", (unsigned)(timer_now() * 1e6));
+
+    ObsRing producer, reader;
+    if (obsRing_create(&producer, name, RING_SLOTS, RING_COLS, RING_ROWS, 3, 8) != 0) {
+        return 1;
+    }
+    if (obsRing_open(&reader, name) != 0) {
+        printf("FAIL: can't open %s\n", name);
+        return 1;
+    }
+
+    size_t pixel_bytes = RING_COLS * RING_ROWS * 3;
+    unsigned char* expected = malloc(pixel_bytes);
+
+    // What the next upload slot holds, anything but the frame
+    Pixel* stale = malloc(pov_tb.capacity * sizeof(Pixel));
+    memset(stale, 0xa5, pov_tb.capacity * sizeof(Pixel));
+    Pixel* pixels = pov_tb.data;
+
+    Vec2 pos = gameMap_findSpawn(&gm);
+    Vec2 look = { 1.f, 0.f };
+
+    // A drawn frame, then the same camera again, which the frame cache skips
+    for (int f = 0; f < 2; ++f) {
+        renderer_drawFrame(&renderer, pos, look);
+        CHECK(renderer.stats.unchanged == (f == 1), "frame %d unchanged %d", f, renderer.stats.unchanged);
+        if (f == 0) {
+            expectedPixels(&pov_tb, expected);
+        }
+
+        CHECK(obsRing_publishFrame(&producer, &renderer, pos, look), "frame %d not published", f);
+
+        // The upload after the frame moves the POV to the next slot
+        pov_tb.data = stale;
+
+        const ObsRingFrame* frame = obsRing_beginRead(&reader);
+        CHECK(frame != NULL, "frame %d not received", f);
+        if (frame == NULL) {
+            break;
+        }
+        CHECK(frame->seq == (uint64_t)f, "frame %d has seq %llu", f, (unsigned long long)frame->seq);
+        CHECK(frame->src_cols == (uint32_t)scr.POV_COLS && frame->src_rows == (uint32_t)scr.POV_ROWS, "frame %d source size", f);
+        CHECK(memcmp(obsRing_pixels(&reader, frame), expected, pixel_bytes) == 0, "frame %d pixels differ from the drawn frame", f);
+
+        // Depth is the distance to the wall along each column's ray
+        const float* depth = obsRing_depth(&reader, frame);
+        for (int x = 0; x < RING_COLS; ++x) {
+            int c = x * scr.POV_COLS / RING_COLS;
+            Vec2 dir = vec2_normalized(vec2_mul(renderer.column_dirs[c], renderer_topViewToMapScale(&renderer)));
+            float want = raycast_dda(&gm, pos, dir, 1000.f).dist;
+            CHECK(fabsf(depth[x] - want) < 1e-3f, "frame %d column %d depth %f, want %f", f, x, depth[x], want);
+        }
+        obsRing_endRead(&reader);
+    }
+    pov_tb.data = pixels;
+
+    // With every slot held by the reader, frames are refused
+    for (int f = 0; f < RING_SLOTS; ++f) {
+        CHECK(obsRing_publishFrame(&producer, &renderer, pos, look), "slot %d not free", f);
+    }
+    CHECK(!obsRing_publishFrame(&producer, &renderer, pos, look), "full ring took a frame");
+    for (int f = 0; f < RING_SLOTS; ++f) {
+        CHECK(obsRing_beginRead(&reader) != NULL, "slot %d not readable", f);
+        obsRing_endRead(&reader);
+    }
+    CHECK(obsRing_beginRead(&reader) == NULL, "empty ring returned a frame");
+
+    // Actions come back in order
+    for (int a = 0; a < 3; ++a) {
+        ObsRingAction action = { .frame = a, .forward = 0.5f * a, .strafe = -1.f, .turn = 0.25f };
+        CHECK(obsRing_pushAction(&reader, &action), "action %d not queued", a);
+    }
+    for (int a = 0; a < 3; ++a) {
+        ObsRingAction action;
+        CHECK(obsRing_popAction(&producer, &action) && action.frame == (uint64_t)a && action.forward == 0.5f * a,
+            "action %d not received in order", a);
+    }
+    ObsRingAction none;
+    CHECK(!obsRing_popAction(&producer, &none), "empty action ring returned an action");
+
+    obsRing_close(&reader);
+    obsRing_close(&producer);
+
+    free(expected);
+    free(stale);
+    renderer_destroy(&renderer);
+    screen_destroy(&scr);
+    textureBuffer_destroy(&top_view_tb);
+    textureBuffer_destroy(&pov_tb);
+    gameMap_destroy(&gm);
+
+    if (failures == 0) {
+        printf("observation ring: passed\n");
+    }
+    return failures == 0 ? 0 : 1;
+}
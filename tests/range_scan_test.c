@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "game_map.h"
+#include "raycast.h"
+#include "raycast_packet.h"
+#include "thread_pool.h"
+#include "range_scan.h"
+
+/*
+* Range scans: every mode but march, on every packet width and on a thread pool,
+* gives exactly the distances raycast_dda gives for each ray on its own.
+* Origins at cell centres send the diagonal rays through exact cell corners.
+*/
+
+#define DIM         128
+#define NUM_DIRS    1000
+#define NUM_ORIGINS 50
+#define MAX_RANGE   100.f
+
+static int failures = 0;
+
+static unsigned int test_random(unsigned int* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static void compareScan(const char* name, const float* got, const float* want,
+                        const float* origin_x, const float* origin_y, const float* dir_x, const float* dir_y)
+{
+    int mismatches = 0;
+    for (int i = 0; i < NUM_ORIGINS * NUM_DIRS; ++i) {
+        if (got[i] != want[i]) {
+            if (mismatches == 0) {
+                int o = i / NUM_DIRS;
+                int d = i % NUM_DIRS;
+                printf("FAIL %s: origin (%.9g, %.9g) dir (%.9g, %.9g) gives %.9g, dda %.9g\n", name,
+                    origin_x[o], origin_y[o], dir_x[d], dir_y[d], got[i], want[i]);
+            }
+            ++mismatches;
+        }
+    }
+    if (mismatches > 0) {
+        printf("FAIL %s: %d of %d distances differ\n", name, mismatches, NUM_ORIGINS * NUM_DIRS);
+        ++failures;
+    }
+}
+
+int main(void)
+{
+    // Sparse enough for empty pyramid blocks and long distance field jumps
+    GameMap gm;
+    if (gameMap_initGenerated(&gm, DIM, 0.02f, 13) != 0 || gameMap_buildDistance(&gm, NULL) != 0) {
+        return 1;
+    }
+
+    ThreadPool pool;
+    if (threadPool_init(&pool, 3) != 0) {
+        return 1;
+    }
+
+    // The axes and diagonals are in the circle, the rest of the directions are oblique
+    float dir_x[NUM_DIRS], dir_y[NUM_DIRS];
+    rangeScan_circle(NUM_DIRS, 0.f, dir_x, dir_y);
+
+    // Half of the origins at cell centres, the rest anywhere in empty cells, one inside a wall
+    float origin_x[NUM_ORIGINS], origin_y[NUM_ORIGINS];
+    unsigned int state = 17;
+    for (int o = 0; o < NUM_ORIGINS; ++o) {
+        do {
+            origin_x[o] = (test_random(&state) >> 8) * (DIM / 16777216.f);
+            origin_y[o] = (test_random(&state) >> 8) * (DIM / 16777216.f);
+            if (o % 2 == 0) {
+                origin_x[o] = (int)origin_x[o] + 0.5f;
+                origin_y[o] = (int)origin_y[o] + 0.5f;
+            }
+        } while (o > 0 && gameMap_isSolid(&gm, (int)origin_x[o], (int)origin_y[o]));
+    }
+    origin_x[0] = 0.5f;
+    origin_y[0] = 0.5f;
+
+    float* want = malloc(sizeof(float) * NUM_ORIGINS * NUM_DIRS);
+    float* got = malloc(sizeof(float) * NUM_ORIGINS * NUM_DIRS);
+    if (want == NULL || got == NULL) {
+        return 1;
+    }
+
+    for (int o = 0; o < NUM_ORIGINS; ++o) {
+        for (int d = 0; d < NUM_DIRS; ++d) {
+            Vec2 origin = { origin_x[o], origin_y[o] };
+            Vec2 dir = { dir_x[d], dir_y[d] };
+            want[o * NUM_DIRS + d] = raycast_dda(&gm, origin, dir, MAX_RANGE).dist;
+        }
+    }
+
+    RayPacketIsa best = rayPacket_detectIsa();
+    int cases = 0;
+    for (RaycastMode mode = 0; mode < RAYCAST_MODE_COUNT; ++mode) {
+        // The marcher is only accurate to its step
+        if (mode == RAYCAST_MODE_MARCH) {
+            continue;
+        }
+        for (RayPacketIsa isa = RAY_PACKET_SCALAR; isa <= best; ++isa) {
+            for (int threaded = 0; threaded < 2; ++threaded) {
+                char name[64];
+                snprintf(name, sizeof(name), "%s %s%s", raycast_modeName(mode), rayPacket_isaName(isa),
+                    threaded ? " pool" : "");
+
+                memset(got, 0, sizeof(float) * NUM_ORIGINS * NUM_DIRS);
+                rangeScan_scan(&gm, threaded ? &pool : NULL, mode, isa, origin_x, origin_y, NUM_ORIGINS,
+                    dir_x, dir_y, NUM_DIRS, MAX_RANGE, got);
+                compareScan(name, got, want, origin_x, origin_y, dir_x, dir_y);
+                ++cases;
+            }
+        }
+    }
+
+    free(want);
+    free(got);
+    threadPool_destroy(&pool);
+    gameMap_destroy(&gm);
+
+    if (failures == 0) {
+        printf("range scan: %d scans match raycast_dda\n", cases);
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,215 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "game_map.h"
+#include "raycast_packet.h"
+#include "thread_pool.h"
+#include "vec_env.h"
+
+/*
+* Batched environments: stepped on every packet width, with luma or RGB observations,
+* on the calling thread or a pool, the envs go through the same poses, collisions and
+* observations as a scalar run on the calling thread. Envs walking into walls are
+* pushed back from them.
+*/
+
+// Odd sizes leave remainders after the packets, the 16 column luma rows and the pool's slices
+#define NUM_ENVS  37
+#define OBS_COLS  61
+#define OBS_ROWS  40
+#define STEPS     40
+#define FOV       70.f
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf("FAIL: " __VA_ARGS__); printf("\n"); ++failures; } } while (0)
+
+// What every step left behind, STEPS entries of each
+typedef struct {
+    unsigned char* obs;
+    float* pos_x;
+    float* pos_y;
+    bool* collided;
+    size_t obs_size;
+} EnvTrace;
+
+static float testRandom(unsigned int* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return (*state >> 8) * (1.f / 16777216.f);
+}
+
+// Envs start at random empty cells facing random ways, then take the same random actions on every run
+static void runEnvs(const GameMap* gm, RayPacketIsa isa, int channels, ThreadPool* pool, EnvTrace* trace) {
+    VecEnv env;
+    vecEnv_init(&env, NUM_ENVS, gm, OBS_COLS, OBS_ROWS, channels, FOV, pool);
+    env.isa = isa;
+
+    unsigned int state = 9;
+    for (int i = 0; i < NUM_ENVS; ++i) {
+        Vec2 pos;
+        do {
+            pos = (Vec2){ testRandom(&state) * gm->dim, testRandom(&state) * gm->dim };
+        } while (gameMap_isSolid(gm, (int)pos.x, (int)pos.y));
+        vecEnv_reset(&env, i, gm, pos, testRandom(&state) * 6.2831853f);
+    }
+
+    trace->obs_size = vecEnv_obsSize(&env) * NUM_ENVS;
+    trace->obs = malloc(trace->obs_size * STEPS);
+    trace->pos_x = malloc(sizeof(float) * NUM_ENVS * STEPS);
+    trace->pos_y = malloc(sizeof(float) * NUM_ENVS * STEPS);
+    trace->collided = malloc(sizeof(bool) * NUM_ENVS * STEPS);
+
+    for (int s = 0; s < STEPS; ++s) {
+        // Mostly forward, so envs run into walls
+        for (int i = 0; i < NUM_ENVS; ++i) {
+            env.act_forward[i] = testRandom(&state) < 0.8f ? 1.f : -1.f;
+            env.act_strafe[i] = (int)(testRandom(&state) * 3) - 1.f;
+            env.act_turn[i] = (testRandom(&state) - 0.5f) * 0.2f;
+        }
+        vecEnv_step(&env);
+
+        memcpy(trace->obs + s * trace->obs_size, env.obs, trace->obs_size);
+        memcpy(trace->pos_x + s * NUM_ENVS, env.pos_x, sizeof(float) * NUM_ENVS);
+        memcpy(trace->pos_y + s * NUM_ENVS, env.pos_y, sizeof(float) * NUM_ENVS);
+        memcpy(trace->collided + s * NUM_ENVS, env.collided, sizeof(bool) * NUM_ENVS);
+    }
+
+    vecEnv_destroy(&env);
+}
+
+static void freeTrace(EnvTrace* trace) {
+    free(trace->obs);
+    free(trace->pos_x);
+    free(trace->pos_y);
+    free(trace->collided);
+}
+
+// Poses and collisions of every step, which don't depend on the observations
+static void comparePoses(const char* name, const EnvTrace* got, const EnvTrace* want) {
+    for (int k = 0; k < NUM_ENVS * STEPS; ++k) {
+        if (got->pos_x[k] != want->pos_x[k] || got->pos_y[k] != want->pos_y[k] || got->collided[k] != want->collided[k]) {
+            CHECK(false, "%s: step %d env %d at (%f, %f) collided %d, want (%f, %f) collided %d", name,
+                k / NUM_ENVS, k % NUM_ENVS, got->pos_x[k], got->pos_y[k], got->collided[k],
+                want->pos_x[k], want->pos_y[k], want->collided[k]);
+            return;
+        }
+    }
+}
+
+static void compareObs(const char* name, const EnvTrace* got, const EnvTrace* want) {
+    for (size_t b = 0; b < want->obs_size * STEPS; ++b) {
+        if (got->obs[b] != want->obs[b]) {
+            CHECK(false, "%s: step %d observation byte %zu is %d, want %d", name,
+                (int)(b / want->obs_size), b % want->obs_size, got->obs[b], want->obs[b]);
+            return;
+        }
+    }
+}
+
+// Luma observations are the luma of the RGB ones, pixel for pixel
+static void compareLuma(const char* name, const EnvTrace* luma, const EnvTrace* rgb) {
+    for (size_t p = 0; p < luma->obs_size * STEPS; ++p) {
+        const unsigned char* c = rgb->obs + 3 * p;
+        Pixel px = PIXEL_INIT(c[0], c[1], c[2]);
+        if (luma->obs[p] != pixel_luma(px)) {
+            CHECK(false, "%s: step %d luma %zu is %d, want %d of (%d, %d, %d)", name,
+                (int)(p / luma->obs_size), p % luma->obs_size, luma->obs[p], pixel_luma(px), c[0], c[1], c[2]);
+            return;
+        }
+    }
+}
+
+// One env walking into the left border, one in the open, on an otherwise empty map
+static void checkPushBack(void) {
+    GameMap gm;
+    if (gameMap_initGenerated(&gm, 32, 0.f, 1) != 0) {
+        ++failures;
+        return;
+    }
+
+    VecEnv env;
+    vecEnv_init(&env, 2, &gm, OBS_COLS, OBS_ROWS, 1, FOV, NULL);
+    vecEnv_reset(&env, 0, &gm, (Vec2){ 1.6f, 16.5f }, 3.14159265f);
+    vecEnv_reset(&env, 1, &gm, (Vec2){ 16.5f, 16.5f }, 3.14159265f);
+    env.act_forward[0] = 1.f;
+    env.act_forward[1] = 1.f;
+    vecEnv_step(&env);
+
+    // The move is speed * dt = 0.1 tiles, stop_dist 1.25 tiles on a 32 map
+    CHECK(env.collided[0], "env next to the wall didn't collide");
+    CHECK(env.pos_x[0] > 1.6f && fabsf(env.pos_x[0] - 1.61f) < 1e-4f,
+        "env next to the wall is at x %f, want pushed back to 1.61", env.pos_x[0]);
+    CHECK(!env.collided[1], "env in the open collided");
+    CHECK(fabsf(env.pos_x[1] - 16.4f) < 1e-4f, "env in the open is at x %f, want 16.4", env.pos_x[1]);
+
+    vecEnv_destroy(&env);
+    gameMap_destroy(&gm);
+}
+
+int main(void)
+{
+    GameMap gm;
+    if (gameMap_initGenerated(&gm, 32, 0.15f, 11) != 0) {
+        return 1;
+    }
+
+    ThreadPool pool;
+    if (threadPool_init(&pool, 3) != 0) {
+        return 1;
+    }
+
+    RayPacketIsa best = rayPacket_detectIsa();
+    int cases = 0;
+
+    EnvTrace ref[2];
+    runEnvs(&gm, RAY_PACKET_SCALAR, 1, NULL, &ref[0]);
+    runEnvs(&gm, RAY_PACKET_SCALAR, 3, NULL, &ref[1]);
+
+    int collisions = 0;
+    for (int k = 0; k < NUM_ENVS * STEPS; ++k) {
+        collisions += ref[0].collided[k];
+    }
+    CHECK(collisions > 0, "no env collided, the runs don't cover the push back");
+
+    comparePoses("3 channels", &ref[1], &ref[0]);
+    compareLuma("1 against 3 channels", &ref[0], &ref[1]);
+
+    for (int c = 0; c < 2; ++c) {
+        int channels = c == 0 ? 1 : 3;
+        for (RayPacketIsa isa = RAY_PACKET_SCALAR; isa <= best; ++isa) {
+            for (int threaded = 0; threaded < 2; ++threaded) {
+                if (isa == RAY_PACKET_SCALAR && !threaded) {
+                    continue;
+                }
+
+                char name[64];
+                snprintf(name, sizeof(name), "%s, %d channels%s", rayPacket_isaName(isa), channels,
+                    threaded ? ", pool" : "");
+
+                EnvTrace got;
+                runEnvs(&gm, isa, channels, threaded ? &pool : NULL, &got);
+                comparePoses(name, &got, &ref[c]);
+                compareObs(name, &got, &ref[c]);
+                freeTrace(&got);
+                ++cases;
+            }
+        }
+    }
+
+    checkPushBack();
+
+    freeTrace(&ref[0]);
+    freeTrace(&ref[1]);
+    threadPool_destroy(&pool);
+    gameMap_destroy(&gm);
+
+    if (failures == 0) {
+        printf("vec env: %d runs match the scalar run, %d collisions\n", cases, collisions);
+    }
+    return failures == 0 ? 0 : 1;
+}